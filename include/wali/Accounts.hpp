@@ -0,0 +1,63 @@
+#ifndef WALI_ACCOUNTS_H
+#define WALI_ACCOUNTS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+#include <wali/Common.hpp>
+
+
+// Edits the account databases of the installed system (passwd, shadow, group, gshadow),
+// rather than running useradd/chpasswd/chsh in a chroot. Changes are held in memory until
+// save(), so many accounts can be changed in one pass.
+class Accounts
+{
+  using Record = std::vector<std::string>;  // fields of one line
+  using Database = std::vector<Record>;
+
+public:
+  Accounts(const fs::path& root);
+
+  bool load();
+  bool save();
+
+  // Creates the user with a group of the same name, and /home/<user> from /etc/skel
+  bool add_user(const std::string_view user, const std::string_view shell, const std::vector<std::string_view>& groups);
+  bool set_password(const std::string_view user, const std::string_view password);
+  bool set_shell(const std::string_view user, const std::string_view shell);
+  bool has_user(const std::string_view user);
+
+  // Adds or removes the user from the group's members, if not already
+  bool set_group_member(const std::string_view group, const std::string_view user, const bool member);
+
+  // Locks login for normal users (UID_MIN to UID_MAX) other than keep, i.e. those of
+  // a deployed archive not in the answer file. Returns the locked users.
+  std::vector<std::string> lock_users_except(const std::string_view keep);
+
+  // Path of an installed shell from /etc/shells, i.e. zsh to /usr/bin/zsh. Empty if not installed.
+  // Reads the file, so doesn't require load().
+  std::string find_shell(const std::string_view name) const;
+
+private:
+  bool read(const fs::path& path, Database& db);
+  bool write(const fs::path& path, const Database& db, const mode_t mode) const;
+  void read_login_defs();
+
+  Record * find(Database& db, const std::string_view name);
+  bool add_group_member(const std::string_view group, const std::string_view user);
+  bool remove_group_member(const std::string_view group, const std::string_view user);
+  static bool is_member(const Record& record, const std::string_view user);
+  unsigned next_id(const Database& db, const std::size_t field, const unsigned min, const unsigned max) const;
+  std::string hash(const std::string_view password) const;
+  bool create_home(const fs::path& home, const uid_t uid, const gid_t gid) const;
+
+private:
+  fs::path m_root;
+  Database m_passwd, m_shadow, m_group, m_gshadow;
+  unsigned m_uid_min{1000}, m_uid_max{60000};
+  unsigned m_gid_min{1000}, m_gid_max{60000};
+  unsigned long m_yescrypt_cost{5};
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef WALI_ANSWERFILE_H
+#define WALI_ANSWERFILE_H
+
+#include <string>
+#include <wali/Common.hpp>
+#include <wali/widgets/WidgetData.hpp>
+
+
+// WidgetData as JSON, for unattended installs (see Headless). An answer file is
+// exported from the UI, or written by hand:
+//
+// {
+//   "mounts":   { "boot_dev": "/dev/sda1", "boot_fs": "vfat", "root_dev": "/dev/sda2", "root_fs": "ext4",
+//                 "home_target": "root", "boot_loader": "systemd-boot", "zram": true, ... },
+//   "accounts": { "root_pass": "...", "user_username": "arch", "user_pass": "...", "user_shell": "zsh", "user_sudo": true },
+//   "localise": { "timezone": "Europe/London", "locale": "en_GB.UTF-8", "keymap": "uk" },
+//   "network":  { "hostname": "archlinux", "ntp": true, "copy_config": true },
+//   "desktop":  { "packages": ["plasma-meta"], "dm": ["sddm"], "services": ["sddm.service"], "iwd": false, "netmanager": true },
+//   "video":    { "drivers": ["mesa"] },
+//   "packages": { "additional": ["firefox", "git"] }
+// }
+//
+// To install into a sparse image file rather than disks, for VMs and CI, add
+// "image": { "path": "/srv/arch.img", "size_gib": 20, "compact": true } to "mounts".
+//
+// To archive a complete install, or install from an archive rather than with pacman, add
+// "archive": { "capture": "/srv/golden", "deploy": "/srv/golden", "blocks": false } (see GoldenImage).
+//
+// Absent keys keep their default. Passwords are plain text, so the file should be
+// treated as a secret.
+class AnswerFile
+{
+public:
+  // returns false if the file can't be read, isn't JSON or a value has the wrong type
+  static bool read(const fs::path& path, WidgetData& data);
+  static bool parse(const std::string& json, WidgetData& data);
+
+  static std::string write(const WidgetData& data);
+};
+
+#endif
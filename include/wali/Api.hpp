@@ -0,0 +1,28 @@
+#ifndef WALI_API_H
+#define WALI_API_H
+
+#include <Wt/WServer.h>
+
+
+// JSON endpoints so a provisioning system can configure, start and monitor an install
+// without the UI. Enabled with --api. The API has its own configuration and install,
+// independent of UI sessions.
+//
+//  GET     /api/facts          system facts and disks
+//  GET     /api/config         configuration, as an answer file (see AnswerFile)
+//  PUT     /api/config         replace the configuration, returns validation messages
+//  GET     /api/install        state, current stage and number of events
+//  POST    /api/install        start the install
+//  DELETE  /api/install        cancel the install
+//  GET     /api/events         events since ?since=N, as NDJSON, or server-sent events if
+//                              the request accepts text/event-stream. Streamed whilst the
+//                              install is running, unless ?stream=0.
+//
+// facts and install status are small and cached, so can be polled by many clients.
+class Api
+{
+public:
+  static void add_resources(Wt::WServer& server);
+};
+
+#endif
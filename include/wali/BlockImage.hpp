@@ -0,0 +1,52 @@
+#ifndef WALI_BLOCKIMAGE_H
+#define WALI_BLOCKIMAGE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <wali/Commands.hpp>
+#include <wali/Common.hpp>
+
+
+struct BlockImageInfo
+{
+  std::string fs;
+  int64_t fs_size{};    // bytes, the target must be at least this
+  int64_t used{};       // bytes captured
+  unsigned streams{};
+};
+
+
+// A filesystem's used blocks, found from its allocation bitmaps (like partclone), then
+// written to the target device rather than extracting files. Only ext4: btrfs records
+// allocations in its extent tree rather than bitmaps.
+//
+// The image is a directory of zstd streams, each a contiguous region of the filesystem
+// so each is decompressed and written concurrently. A stream is records of an offset,
+// length and CRC-32C, then the blocks. The device is read and written with O_DIRECT,
+// with two buffers per stream so reading the next record overlaps writing the last.
+//
+// The deployed filesystem is the captured size with the captured UUID, so Install
+// grows it and sets a new UUID (see RestoreExt4).
+class BlockImage
+{
+public:
+  using Stop = std::function<bool()>;
+
+  static bool can_capture(const std::string_view fs) { return fs == "ext4"; }
+
+  // the filesystem must be unmounted, or mounted at mount_path, which is frozen while
+  // the blocks are read
+  static bool capture(const std::string_view dev, const fs::path& image_dir, const fs::path& mount_path, OutputHandler handler, Stop stop);
+  static bool deploy(const fs::path& image_dir, const std::string_view dev, OutputHandler handler, Stop stop);
+
+  static bool read_info(const fs::path& image_dir, BlockImageInfo& info);
+
+private:
+  static bool write_info(const fs::path& image_dir, const BlockImageInfo& info);
+
+  static constexpr const char * InfoName = "info";
+};
+
+#endif
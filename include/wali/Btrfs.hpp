@@ -0,0 +1,20 @@
+#ifndef WALI_BTRFS_H
+#define WALI_BTRFS_H
+
+#include <string>
+#include <string_view>
+#include <wali/Common.hpp>
+#include <wali/widgets/WidgetData.hpp>
+
+
+class Btrfs
+{
+public:
+  static bool create_subvolume(const fs::path& parent, const std::string_view name);
+  static bool set_nodatacow(const fs::path& dir);
+
+  // options for all subvolumes on a device, excluding subvol=
+  static std::string mount_options(const BtrfsData& data, const bool ssd, const bool discard);
+};
+
+#endif
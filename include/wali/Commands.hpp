@@ -143,6 +143,10 @@ public:
 // chroot
 struct Chroot : public ReadCommand
 {
+  explicit Chroot(const fs::path& root) : m_root(root)
+  {
+  }
+
   virtual bool operator()(const std::string_view cmd)
   {
     return operator()(cmd, [](const std::string_view m) { PLOGI << m; });
@@ -150,22 +154,46 @@ struct Chroot : public ReadCommand
 
   virtual bool operator()(const std::string_view cmd, OutputHandler handler)
   {
-    const auto chroot_cmd = std::format("arch-chroot {} {}", RootMnt.string(), cmd);
+    const auto chroot_cmd = std::format("arch-chroot {} {}", m_root.string(), cmd);
     return execute(chroot_cmd, std::move(handler)) == CmdSuccess;
   }
+
+private:
+  fs::path m_root;
 };
 
-struct ChrootWrite : public ReadCommand
+// encryption
+// The passphrase is written to stdin (--key-file=-) so it isn't visible in the process list.
+// cryptsetup reads all of stdin as the key, so no trailing newline.
+struct CryptSetup : public Command
 {
-  bool operator()(const std::string_view input)
+  bool operator()(const std::string_view args, const std::string_view passphrase)
   {
-    // use process substituion because:
-    //  - with: `(command1) | (command2)`
-    //  - the webserver would not shutdown with ctrc+c, because command2 did not exit, even if command1 had done
-    //  - So instead, call /bin/bash within chroot so it treats the `input` as a schell script (without an actual script file)
+    const auto cmd = std::format("cryptsetup --batch-mode --key-file=- {}", args);
+
+    if (m_fd = ::popen(cmd.data(), "w"); !m_fd)
+    {
+      PLOGE << "Failed to open pipe to: " << cmd;
+      return false;
+    }
+
+    std::fwrite(passphrase.data(), 1, passphrase.size(), m_fd);
 
-    const auto cmd = std::format("arch-chroot {} /bin/bash < <(echo \"{}\")", RootMnt.string(), input);
-    return execute(cmd, [](const std::string_view m) { PLOGI << m; }) == CmdSuccess;
+    if (const int stat = close(); stat != CmdSuccess)
+    {
+      PLOGE << "Command '" << cmd << "' exited with: " << stat;
+      return false;
+    }
+
+    return true;
+  }
+};
+
+struct CryptClose : public ReadCommand
+{
+  bool operator()(const std::string_view name)
+  {
+    return execute(std::format("cryptsetup close {}", name)) == CmdSuccess;
   }
 };
 
@@ -188,43 +216,6 @@ struct GetTimeZones : public ReadCommand
 };
 
 
-struct GetLocales
-{
-  std::vector<std::string> operator()()
-  {
-    static const fs::path SupportedLocalesPath {"/usr/share/i18n/SUPPORTED"};
-
-    std::vector<std::string> locales;
-    locales.reserve(500); // "cat /usr/share/i18n/SUPPORTED | wc -l" returns 500
-
-    char buff[512] = {'\0'};
-    std::ifstream stream{SupportedLocalesPath};
-
-    while (stream.getline(buff, sizeof(buff)).good())
-    {
-      auto is_utf8 = [buff]() -> std::optional<std::string_view>
-      {
-        const std::string_view line{buff};
-        const auto space = line.find(' ');
-
-        if (space == std::string_view::npos || space+1 == line.size())
-          return {};
-
-        if (const auto charset = line.substr(space+1); charset == "UTF-8")
-          return line.substr(0, space);
-        else
-          return {};
-      };
-
-      if (const auto locale = is_utf8(); locale)
-        locales.emplace_back(*locale);
-    }
-
-    return locales;
-  }
-};
-
-
 struct GetKeyMaps : public ReadCommand
 {
   std::vector<std::string> operator()()
@@ -313,6 +304,25 @@ struct CreateFilesystem : public ReadCommand
     return CreateFilesystem{}("btrfs -n 16k", dev);
   }
 
+  // multi-device, data_profile and meta_profile are raid0, raid1, etc
+  static bool btrfs (const std::vector<std::string>& devs, const std::string_view data_profile, const std::string_view meta_profile)
+  {
+    return CreateFilesystem{}(std::format("btrfs -f -n 16k -d {} -m {}", data_profile, meta_profile), flatten(devs));
+  }
+
+  static bool xfs (const std::string_view dev, const unsigned agcount = 0)
+  {
+    // more allocation groups allow more concurrent allocations (0 is mkfs default)
+    const auto ag = agcount ? std::format(" -d agcount={}", agcount) : "";
+    return CreateFilesystem{}(std::format("xfs -f -m reflink=1{}", ag), dev);
+  }
+
+  static bool f2fs (const std::string_view dev)
+  {
+    // compression requires extra_attr
+    return CreateFilesystem{}("f2fs -f -O extra_attr,inode_checksum,sb_checksum,compression", dev);
+  }
+
 private:
   bool operator()(const std::string_view mkfs, const std::string_view dev)
   {
@@ -320,21 +330,54 @@ private:
   }
 };
 
+// An ext4 written from a block image (see BlockImage): a new UUID so it doesn't clash
+// with the captured machine's, then grown to the device. Both require a checked filesystem.
+struct RestoreExt4 : public ReadCommand
+{
+  bool operator()(const std::string_view dev, OutputHandler handler)
+  {
+    // e2fsck exits 1 if it corrected the free counts, which are only updated when unmounted
+    const auto cmd = std::format("{{ e2fsck -f -y {0}; [ $? -le 1 ] && tune2fs -U random {0} && resize2fs {0}; }}", dev);
+    return execute(cmd, std::move(handler)) == CmdSuccess;
+  }
+};
+
 
-struct CreateBtrfsSubVolume : public ReadCommand
+// md raid
+struct CreateRaid : public ReadCommand
 {
-  bool operator()(const std::string_view path)
+  bool operator()(const std::string_view md_dev, const std::string_view level, const std::vector<std::string>& devs, OutputHandler handler)
   {
-    const auto stat = execute(std::format("btrfs subvolume create {}", path), [](const std::string_view m)
+    // --run: don't ask for confirmation if a member appears to be in use
+    const auto cmd = std::format("mdadm --create {} --run --metadata=1.2 --level={} --raid-devices={} {}",
+                                  md_dev, level, devs.size(), flatten(devs));
+
+    return execute(cmd, std::move(handler)) == CmdSuccess;
+  }
+};
+
+struct StopRaid : public ReadCommand
+{
+  bool operator()(const std::string_view md_dev)
+  {
+    return execute(std::format("mdadm --stop {}", md_dev)) == CmdSuccess;
+  }
+};
+
+struct GetRaidConfig : public ReadCommand
+{
+  // ARRAY lines for mdadm.conf, only for md_devs because other installs may have arrays
+  std::vector<std::string> operator()(const std::vector<std::string>& md_devs)
+  {
+    std::vector<std::string> arrays;
+
+    const auto stat = execute(std::format("mdadm --detail --brief {}", flatten(md_devs)), [&arrays](const std::string_view line)
     {
-      PLOGI << m;
+      if (line.starts_with("ARRAY"))
+        arrays.emplace_back(line);
     });
 
-    if (stat != CmdSuccess)
-    {
-      PLOGE << "Failed to create btrfs subvolume";
-    }
-    return stat == CmdSuccess;
+    return stat == CmdSuccess ? arrays : std::vector<std::string>{};
   }
 };
 
@@ -392,23 +435,6 @@ struct SetPartitionType : public ReadCommand
 };
 
 // mount
-struct Mount : public ReadCommand
-{
-  bool operator()(const std::string_view dev, const std::string_view path, const std::string_view opts = "")
-  {
-    const auto opts_str = opts.empty() ? "" : std::format("-o {}", opts);
-    return execute(std::format("mount {} --mkdir {} {}", opts_str, dev, path)) == CmdSuccess;
-  }
-};
-
-struct Unmount : public ReadCommand
-{
-  bool operator()(const std::string_view mount_point, const bool recursive)
-  {
-    return execute(std::format("umount {} {}", recursive ? "-R" : "", mount_point)) == CmdSuccess;
-  }
-};
-
 // general
 struct PlatformSizeValid : public ReadCommand
 {
@@ -468,11 +494,11 @@ struct ProgramExists : public ReadCommand
 
 struct CountPackages
 {
-  std::size_t operator()(const fs::path root_dev)
+  std::size_t operator()(const fs::path& root)
   {
     std::size_t n{};
 
-    Chroot{}("pacman -Q | wc -l", [&n](const std::string_view m)
+    Chroot{root}("pacman -Q | wc -l", [&n](const std::string_view m)
     {
       if (!m.empty())
         n = std::stoul(std::string{m.data(), m.size()});
@@ -485,12 +511,12 @@ struct CountPackages
 
 struct GetDevSpace
 {
-  std::pair<std::string, std::string> operator()(const std::string_view dev)
+  std::pair<std::string, std::string> operator()(const fs::path& root, const std::string_view dev)
   {
     std::string size, used;
 
-    Chroot{}(std::format("df -h --output=size {} | tail -n 1", dev), [&](const auto m){ size = m; });
-    Chroot{}(std::format("df -h --output=used {} | tail -n 1", dev), [&](const auto m){ used = m ;});
+    Chroot{root}(std::format("df -h --output=size {} | tail -n 1", dev), [&](const auto m){ size = m; });
+    Chroot{root}(std::format("df -h --output=used {} | tail -n 1", dev), [&](const auto m){ used = m ;});
 
     return {size, used};
   }
@@ -20,10 +20,7 @@ using WaliClock = chrono::steady_clock;
 
 
 inline static const fs::path InstallLogPath {"/var/log/ali/install.log"};
-inline static const fs::path RootMnt{"/mnt"};
-inline static const fs::path BootMnt{"/mnt/boot"};
-inline static const fs::path HomeMnt{"/mnt/home"};
-inline static const fs::path FsTabPath{"/mnt/etc/fstab"};
+inline static const fs::path RootMnt{"/mnt"}; // each install mounts its target below, see Install
 
 using StringViewVec = std::vector<std::string_view>;
 using PackageSet = std::set<std::string>;
@@ -34,6 +31,7 @@ inline static const constexpr auto STAGE_MOUNT        = "Mount";
 inline static const constexpr auto STAGE_VCONSOLE     = "Console Keymap";
 inline static const constexpr auto STAGE_PACSTRAP     = "Pacstrap";
 inline static const constexpr auto STAGE_FSTAB        = "Generate Filesystem Table";
+inline static const constexpr auto STAGE_INITRAMFS    = "Initramfs";
 inline static const constexpr auto STAGE_ROOT_ACC     = "Root Account";
 inline static const constexpr auto STAGE_BOOT_LOADER  = "Bootloader";
 inline static const constexpr auto STAGE_USER_ACC     = "User Account";
@@ -46,11 +44,12 @@ inline static const constexpr auto STAGE_UNMOUNT      = "Unmount";
 inline static const constexpr auto STAGE_SWAP         = "Swap";
 
 
-inline static constexpr std::array<const char *, 14> Stages = {
+inline static constexpr std::array<const char *, 15> Stages = {
   STAGE_FS,
   STAGE_MOUNT,
   STAGE_PACSTRAP,
   STAGE_FSTAB,
+  STAGE_INITRAMFS,
   STAGE_ROOT_ACC,
   STAGE_BOOT_LOADER,
   STAGE_USER_ACC,
@@ -10,6 +10,17 @@
 #include <wali/Common.hpp>
 
 
+enum class DeviceClass
+{
+  Unknown,
+  Hdd,
+  Ssd,
+  Nvme,
+  Mmc,    // eMMC/SD
+  Raid    // md array
+};
+
+
 struct Disk
 {
   Disk(const std::string& dev) : dev(dev)
@@ -19,6 +30,9 @@ struct Disk
   std::string dev;
   int64_t size{};
   bool is_gpt{};
+  DeviceClass device_class{DeviceClass::Unknown};
+  bool is_rotational{true};
+  bool is_discard{};      // supports discard/trim
 };
 
 inline bool operator<(const Disk& a, const Disk& b)
@@ -59,10 +73,17 @@ using Tree = std::map<Disk, Partitions>;
 using TreePair = Tree::value_type;
 
 
+inline static const StringViewVec Filesystems {"ext4", "btrfs", "xfs", "f2fs"};
+
+
 // Hex codes: https://gist.github.com/gotbletu/a05afe8a76d0d0e8ec6659e9194110d2
 inline static const constexpr char PartTypeEfi[] = "ef00";
 inline static const constexpr char PartTypeRoot[] = "8304";
 inline static const constexpr char PartTypeHome[] = "8302";
+inline static const constexpr char PartTypeRaid[] = "fd00";
+
+inline static const constexpr char MdRootDev[] = "/dev/md/wali_root";
+inline static const constexpr char MdHomeDev[] = "/dev/md/wali_home";
 
 
 class DiskUtils
@@ -73,9 +94,15 @@ public:
 
   static std::optional<int64_t> get_disk_size (const std::string_view dev);
   static int get_partition_part_number (const Tree& tree, const std::string_view dev);
+  static int64_t get_partition_size (const Tree& tree, const std::string_view dev);
   static std::string get_partition_disk (const Tree& tree, const std::string_view dev);
   static std::string get_partition_uuid(const Tree& tree, const std::string_view dev);
   static std::string get_partition_fs(const Tree& tree, const std::string_view dev);
+  static bool is_ssd(const Tree& tree, const std::string_view dev);
+  static bool has_discard(const Tree& tree, const std::string_view dev);
+  static DeviceClass get_device_class(const Tree& tree, const std::string_view dev);
+  static std::string_view get_device_class_name(const DeviceClass dc);
+  static std::string_view get_recommended_fs(const Tree& tree, const std::string_view dev);
 
   static bool is_path_mounted(const std::string_view path);
   static bool is_dev_mounted(const std::string_view path);
@@ -86,6 +113,8 @@ private:
   static bool probe_partition(Partition& partition);
 
   static std::optional<std::reference_wrapper<const Partition>> get_partition(const Tree& tree, const std::string_view dev);
+  static std::optional<std::reference_wrapper<const Disk>> get_disk(const Tree& tree, const std::string_view dev);
+  static bool read_queue_value(const std::string_view disk_dev, const std::string_view name, int64_t& value);
 
   static bool is_mounted(const std::string_view path_or_dev, const bool is_dev);
 };
@@ -0,0 +1,45 @@
+#ifndef WALI_FILEDESCRIPTOR_H
+#define WALI_FILEDESCRIPTOR_H
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utility>
+#include <plog/Log.h>
+#include <wali/Common.hpp>
+
+
+// Owns a file descriptor, closed on destruction
+struct FileDescriptor
+{
+  FileDescriptor(const fs::path& path, const int flags, const mode_t mode = 0) : fd(::open(path.c_str(), flags, mode))
+  {
+    if (fd == -1)
+      PLOGE << "Failed to open " << path.string() << ": " << strerror(errno);
+  }
+
+  // takes ownership, i.e. from socket() or accept()
+  explicit FileDescriptor(const int fd) : fd(fd)
+  {
+  }
+
+  FileDescriptor(const FileDescriptor&) = delete;
+  FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+  FileDescriptor(FileDescriptor&& other) noexcept : fd(std::exchange(other.fd, -1))
+  {
+  }
+
+  ~FileDescriptor()
+  {
+    if (fd != -1)
+      ::close(fd);
+  }
+
+  bool valid() const { return fd != -1; }
+
+  int fd{-1};
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef WALI_FILEOPS_H
+#define WALI_FILEOPS_H
+
+#include <string_view>
+#include <sys/types.h>
+#include <wali/Common.hpp>
+
+
+// File operations on the installed system, rather than spawning echo/cp/ln in a chroot.
+// Writes are atomic: content is written to a temporary file in the same directory then renamed,
+// so a file is either unchanged or complete.
+class FileOps
+{
+public:
+  // creates the parent directories if required
+  static bool write(const fs::path& path, const std::string_view content, const mode_t mode = 0644);
+
+  // appends line if no line is equal to it, so repeating is harmless
+  static bool append_if_missing(const fs::path& path, const std::string_view line);
+
+  // replaces an existing file or link
+  static bool symlink(const fs::path& target, const fs::path& link);
+
+  // copies files, directories and symlinks below src into dest, overwriting existing files
+  static bool copy_tree(const fs::path& src, const fs::path& dest);
+
+private:
+  static bool copy_file(const fs::path& src, const fs::path& dest);
+};
+
+#endif
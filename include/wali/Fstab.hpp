@@ -0,0 +1,45 @@
+#ifndef WALI_FSTAB_H
+#define WALI_FSTAB_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <wali/Common.hpp>
+
+
+struct FstabEntry
+{
+  std::string source;   // device path, or UUID=...
+  std::string target;   // relative to the install root, i.e. /home
+  std::string fstype;
+  std::string options;
+  std::string subvol;   // btrfs only, from the mount's root
+  int freq{};
+  int passno{};
+};
+
+
+class Fstab
+{
+public:
+  using UuidResolver = std::function<std::string(const std::string& dev)>;
+
+  // Mounts at or below root from mountinfo, in mount order. mountinfo is only
+  // changed by the tests, to read a fixture.
+  static std::vector<FstabEntry> read(const fs::path& root, const fs::path& mountinfo = "/proc/self/mountinfo");
+
+  // Prepares entries from read() for the installed system:
+  //  - source is UUID=, unless uuid() returns empty
+  //  - options are as mounted (mount_options is keyed by absolute mount path), otherwise
+  //    btrfs_options with the subvolume, minus the subvolid which changes on a rollback
+  //  - passno is 0 for btrfs and xfs, which check on mount
+  //  - a tmpfs for /tmp is appended
+  static void prepare(std::vector<FstabEntry>& entries, const fs::path& root, const std::map<std::string, std::string>& mount_options,
+                      const std::string_view btrfs_options, UuidResolver uuid);
+
+  static std::string format(const std::vector<FstabEntry>& entries);
+  static bool write(const fs::path& path, const std::vector<FstabEntry>& entries);
+};
+
+#endif
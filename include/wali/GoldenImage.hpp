@@ -0,0 +1,77 @@
+#ifndef WALI_GOLDENIMAGE_H
+#define WALI_GOLDENIMAGE_H
+
+#include <string>
+#include <vector>
+#include <wali/Commands.hpp>
+#include <wali/Common.hpp>
+
+
+// One tar (zstd) of a golden image, extracted concurrently with the other parts
+struct ArchivePart
+{
+  std::string file;     // within the image directory, i.e. root.tar.zst
+  std::string dir;      // relative to the root, "." for the root
+  std::string members;  // archived from dir, only required when capturing
+  std::string exclude;  // in another part, only required when capturing
+};
+
+using ArchiveParts = std::vector<ArchivePart>;
+
+// A file removed from a captured root (see GoldenImage::read_machine_files())
+struct MachineFile
+{
+  fs::path path;
+  std::string content;
+  fs::perms perms;
+};
+
+using MachineFiles = std::vector<MachineFile>;
+
+
+// A finished install captured to a directory of archives, then deployed to other
+// machines instead of pacstrap and pacman (see ArchiveData).
+//
+// There is a part per mounted filesystem, so each is archived and extracted concurrently,
+// with root's /usr in its own part because it is most of root. File metadata (xattrs,
+// including capabilities, and ACLs) is kept. Files that are specific to a machine (fstab,
+// machine-id, host keys, etc) and the package cache are not captured, the install
+// stages create them for each machine.
+//
+// Alternatively, an ext4 root is captured as a block image, which is written to the
+// root partition rather than creating a filesystem (see BlockImage). The files that
+// are specific to a machine are removed from the captured root before its blocks are
+// read, so they are not in the image.
+class GoldenImage
+{
+public:
+  // mounts are relative to the root, "." for the root
+  static ArchiveParts plan(const std::vector<std::string>& mounts, const bool root_blocks);
+
+  static bool capture(const fs::path& root, const fs::path& image_dir, const ArchivePart& part, OutputHandler handler);
+  static bool extract(const fs::path& image_dir, const fs::path& root, const ArchivePart& part, OutputHandler handler);
+
+  // the parts, so deploy knows where each is extracted
+  static bool write_manifest(const fs::path& image_dir, const ArchiveParts& parts);
+  static bool read_manifest(const fs::path& image_dir, ArchiveParts& parts);
+
+  // removes what capture excludes, from a root captured as blocks
+  static void clean(const fs::path& dir);
+
+  // the files in /etc that clean() removes, so the captured machine's are restored after.
+  // Not the keyring, which is a directory and is initialised again.
+  static MachineFiles read_machine_files(const fs::path& root);
+  static bool restore_machine_files(const MachineFiles& files);
+
+  static bool is_image(const fs::path& image_dir) { return fs::exists(image_dir / ManifestName); }
+  static bool is_blocks(const ArchivePart& part) { return part.file.ends_with(BlocksExt); }
+
+private:
+  static std::vector<fs::path> find_excluded(const fs::path& dir);
+
+private:
+  static constexpr const char * ManifestName = "manifest";
+  static constexpr const char * BlocksExt = ".blocks";
+};
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef WALI_HEADLESS_H
+#define WALI_HEADLESS_H
+
+#include <wali/Common.hpp>
+
+
+// Installs from an answer file (see AnswerFile) without the web server:
+//
+//    wali --headless --answers config.json
+//
+// The answers are checked with the same rules as the UI (see Validation), then
+// progress is logged to stdout.
+class Headless
+{
+public:
+  // exit codes
+  static constexpr int Complete = 0;
+  static constexpr int Failed = 1;
+  static constexpr int Invalid = 2;   // answer file unreadable or invalid, nothing changed
+  static constexpr int Partial = 3;   // bootable, but an optional stage failed
+
+  static int run(const fs::path& answers);
+};
+
+#endif
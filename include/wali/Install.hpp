@@ -4,11 +4,17 @@
 #include <atomic>
 #include <condition_variable>
 #include <functional>
+#include <map>
+#include <mutex>
+#include <set>
 #include <string_view>
 #include <utility>
+#include <vector>
 #include <Wt/WSignal.h>
+#include <wali/Accounts.hpp>
 #include <wali/Common.hpp>
 #include <wali/DiskUtils.hpp>
+#include <wali/Luks.hpp>
 #include <wali/widgets/WidgetData.hpp>
 
 
@@ -49,12 +55,45 @@ struct InstallHandlers
   OnInstallComplete complete;
 };
 
+// Everything required to prepare one device. Each device is independent,
+// so jobs run concurrently (see Install::filesystems()).
+struct FilesystemJob
+{
+  std::string dev;
+  std::string fs;
+  std::string_view part_type;
+  std::vector<std::string_view> subvolumes; // btrfs only
+  StripeData stripe;                        // partitions on other disks
+  std::string md_dev;                       // if set, an md array is created from dev and stripe.devs
+  std::string luks_name;                    // if set, encrypted with LUKS2 then opened with this name
+  fs::path block_image;                     // if set, written from this rather than creating a filesystem
+};
+
+// Shared by every install in the process, so a bench imaging several disks at once
+// doesn't overload the mirrors or the host.
+struct InstallJobs
+{
+  std::size_t pacman{2};  // pacstrap and pacman in the chroot
+  std::size_t mkfs{4};    // filesystem jobs, each may also create an md array or LUKS
+  fs::path package_cache; // if set, packages are downloaded once to here for all installs
+};
+
 
+// Each install has its own mount root (RootMnt/wali-<id>), LUKS mappings and md arrays,
+// so several can run at once, each with its own WidgetData.
 class Install final
 {
 public:
 
   void install(InstallHandlers handlers, WidgetDataPtr data);
+
+  // set before the first install starts
+  static void set_jobs(const InstallJobs& jobs);
+
+  // installed by pacstrap
+  static PackageSet base_packages(const MountData& mounts, const CpuVendor cpu);
+  // every package the install stages request
+  static PackageSet planned_packages(const WidgetData& data, const CpuVendor cpu);
   void stop()
   {
     m_state = InstallState::Cancelled;
@@ -67,40 +106,75 @@ private:
   bool exec(std::function<bool(Install&)> f, const std::string_view name);
   void kill();
   void cleanup();
+  bool cancelled() const { return m_state == InstallState::Cancelled; }
+  bool succeeded() const { return m_state != InstallState::Fail && m_state != InstallState::Cancelled; }
 
   // filesystems
   bool filesystems();
   bool fstab ();
-  bool create_root_filesystem();
-  bool create_home_filesystem();
-  bool create_boot_filesystem();
-  bool create_ext4_filesystem(const std::string_view dev);
-  bool create_btrfs_filesystem(const std::string_view dev);
-  bool create_btrfs_subvolume(const fs::path mount_point, const std::string_view name);
+  bool initramfs();
+  bool raid_config();
+  bool crypttab();
+  bool add_initramfs_hooks(const std::vector<std::string_view>& hooks);
+  std::vector<std::string> read_initramfs_hooks() const;
+  bool is_systemd_initramfs() const;
+  std::vector<FilesystemJob> plan_filesystems() const;
+  bool create_filesystem(const FilesystemJob& job);
+  bool write_block_image(const fs::path& image, const std::string_view dev);
+  bool create_btrfs_subvolumes(const std::string_view dev, const std::vector<std::string_view>& names);
   void set_partition_type(const std::string_view dev, const std::string_view type);
+  bool encrypt(const std::string_view dev, const std::string_view part, const std::string_view name);
+  std::string root_base_dev() const;
+  std::string home_base_dev() const;
+  std::string root_block_dev() const;
+  std::string home_block_dev() const;
+  std::set<std::string> target_disks() const;
+  bool attach_image();
+  void trim_image();
+  void detach_image();
+  bool claim_disks();
+  void release_disks();
+  unsigned xfs_agcount(const std::string_view dev) const;
   bool wipe_fs(const std::string_view dev);
 
   // mounting
   bool mount();
   bool unmount();
   bool do_mount(const std::string_view dev, const std::string_view path, const std::string_view opts = "");
+  std::string mount_options(const std::string_view fs, const std::string_view dev) const;
 
   // pacman
   bool pacstrap();
   bool packages();
   bool install_packages(const PackageSet& packages);
+  bool fetch_packages(const PackageSet& packages);
+  bool share_package_cache();
+  bool unshare_package_cache();
+  void btrfs_nodatacow();
+
+  // golden image
+  bool deploy();
+  bool deployed();
+  bool init_keyring();
+  bool lock_deployed_users();
+  bool capture();
+  bool deploying() const { return !m_data->archive.deploy.empty(); }
+  fs::path root_block_image() const;
 
   // acounts
   bool root_account();
   bool user_account();
-  bool set_password(const std::string_view user, const std::string_view pass);
   bool add_to_sudoers (const std::string_view username);
-  void user_shell();
+  bool has_sudoers(const std::string_view username);
+  void remove_from_sudoers(const std::string_view username);
+  std::string user_shell(const Accounts& accounts);
 
   // bootloader
   bool boot_loader();
   bool boot_loader_grub();
   bool boot_loader_sysdboot();
+  std::string luks_kernel_params() const;
+  bool set_grub_cmdline(const std::string_view params);
 
   // locisation
   bool localise();
@@ -181,7 +255,18 @@ private:
   OnLog m_log;
   WidgetDataPtr m_data;
   Tree m_tree;
+  unsigned m_id{};
+  fs::path m_root_mnt;
+  std::string m_luks_root, m_luks_home; // install's mapper names, the installed system uses LuksRootName/LuksHomeName
+  std::string m_md_root, m_md_home;
+  std::set<std::string> m_claimed_disks;
+  std::string m_loop_dev; // if installing to an image
+  std::map<std::string, std::mutex> m_disk_locks; // serialise partition table edits per disk
+  LuksCipher m_luks_cipher;
+  std::map<std::string, std::string> m_mount_options; // mount path to options, for fstab
+  bool m_cache_shared{}; // package_cache bound onto the root's
   std::atomic<InstallState> m_state{InstallState::None};
+  std::atomic_bool m_stages_done{};
   std::condition_variable m_cv;
   std::string m_process;
 };
@@ -0,0 +1,33 @@
+#ifndef WALI_INSTALLESTIMATE_H
+#define WALI_INSTALLESTIMATE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <wali/widgets/WidgetData.hpp>
+
+
+// Space required on root for the planned packages, from the dependency closure
+// in the sync databases, compared with the size of the root device.
+struct InstallEstimate
+{
+  bool available{};             // false if there are no sync databases
+  std::size_t package_count{};
+  std::uint64_t download_size{};
+  std::uint64_t installed_size{};
+  std::uint64_t required{};     // installed, package cache and headroom
+  std::int64_t root_capacity{}; // 0 if root not selected
+  std::vector<std::string> missing;
+
+  bool fits() const
+  {
+    return !available || root_capacity <= 0 || required <= static_cast<std::uint64_t>(root_capacity);
+  }
+
+  static InstallEstimate estimate(const WidgetData& data);
+
+private:
+  static std::int64_t get_root_capacity(const MountData& mounts);
+};
+
+#endif
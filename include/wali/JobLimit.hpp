@@ -0,0 +1,91 @@
+#ifndef WALI_JOBLIMIT_H
+#define WALI_JOBLIMIT_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <wali/Common.hpp>
+
+
+// Limits how many of a kind of job (i.e. pacman, mkfs) run at once, across all installs
+// in the process. Unlike std::counting_semaphore, the limit can be changed at startup,
+// and a wait can be abandoned when the install is cancelled.
+class JobLimit
+{
+public:
+  explicit JobLimit(const std::size_t limit) : m_limit(std::max<std::size_t>(limit, 1))
+  {
+  }
+
+  void set_limit(const std::size_t limit)
+  {
+    {
+      std::scoped_lock lock{m_mux};
+      m_limit = std::max<std::size_t>(limit, 1);
+    }
+    m_cv.notify_all();
+  }
+
+  // blocks until a job can start, returns false if `stop` returned true first
+  bool acquire(const std::function<bool()>& stop)
+  {
+    static const auto PollPeriod = chrono::milliseconds{250};
+
+    std::unique_lock lock{m_mux};
+
+    while (m_running >= m_limit)
+    {
+      if (stop && stop())
+        return false;
+
+      m_cv.wait_for(lock, PollPeriod);
+    }
+
+    ++m_running;
+    return true;
+  }
+
+  void release()
+  {
+    {
+      std::scoped_lock lock{m_mux};
+      --m_running;
+    }
+    m_cv.notify_one();
+  }
+
+private:
+  std::mutex m_mux;
+  std::condition_variable m_cv;
+  std::size_t m_limit;
+  std::size_t m_running{};
+};
+
+
+// Holds a job slot until destroyed
+class JobSlot
+{
+public:
+  JobSlot(JobLimit& limit, const std::function<bool()>& stop) : m_limit(limit), m_acquired(limit.acquire(stop))
+  {
+  }
+
+  ~JobSlot()
+  {
+    if (m_acquired)
+      m_limit.release();
+  }
+
+  JobSlot(const JobSlot&) = delete;
+  JobSlot& operator=(const JobSlot&) = delete;
+
+  explicit operator bool() const { return m_acquired; }
+
+private:
+  JobLimit& m_limit;
+  bool m_acquired;
+};
+
+#endif
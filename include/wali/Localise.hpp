@@ -0,0 +1,43 @@
+#ifndef WALI_LOCALISE_H
+#define WALI_LOCALISE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <wali/Common.hpp>
+
+
+// Lists timezones, keymaps and locales available in the live system by reading the
+// files directly, rather than with timedatectl and localectl, which require their
+// systemd services. Each list is sorted without duplicates.
+class Localise
+{
+public:
+  // tzdata.zi zones and links, or zone1970.tab if tzdata.zi is not present
+  static std::vector<std::string> timezones();
+
+  // keymap file names, without extensions, below the kbd keymap directories
+  static std::vector<std::string> keymaps();
+
+  // UTF-8 locales from i18n/SUPPORTED
+  static std::vector<std::string> locales();
+
+private:
+  static bool read_file(const fs::path& path, std::string& content);
+  static void sort_unique(std::vector<std::string>& names);
+
+  // calls f for each line, without the newline
+  template<typename F>
+  static void for_each_line(const std::string_view content, F&& f)
+  {
+    for (std::size_t start = 0, end = 0 ; start < content.size() ; start = end+1)
+    {
+      if (end = content.find('\n', start); end == std::string_view::npos)
+        end = content.size();
+
+      f(content.substr(start, end-start));
+    }
+  }
+};
+
+#endif
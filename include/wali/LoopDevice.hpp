@@ -0,0 +1,31 @@
+#ifndef WALI_LOOPDEVICE_H
+#define WALI_LOOPDEVICE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <wali/Common.hpp>
+
+
+// A raw disk image in a sparse file, attached as a loop device so the install
+// can treat it as a disk (see ImageData).
+class LoopDevice
+{
+public:
+  // replaces an existing file, only blocks that are written are allocated
+  static bool create_image(const fs::path& path, const int64_t size);
+
+  // with partition scanning, returns the device (i.e. /dev/loop3), or empty on failure
+  static std::string attach(const fs::path& path);
+  static bool detach(const std::string_view dev);
+
+  // discards the unused blocks of a mounted filesystem, which the loop driver punches
+  // from the image. Returns bytes trimmed, or -1 on failure.
+  static int64_t trim(const fs::path& mount_path);
+
+  // punches holes where blocks are zero, for filesystems that can't trim. Returns the
+  // bytes allocated to the file afterwards, or -1 on failure.
+  static int64_t compact(const fs::path& path);
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef WALI_LUKS_H
+#define WALI_LUKS_H
+
+#include <format>
+#include <string>
+#include <string_view>
+#include <wali/Common.hpp>
+
+
+inline static const constexpr char LuksRootName[] = "cryptroot";
+inline static const constexpr char LuksHomeName[] = "crypthome";
+
+
+struct LuksCipher
+{
+  std::string cipher;       // as cryptsetup --cipher
+  unsigned key_bits{};      // as cryptsetup --key-size
+  double mib_per_sec{};     // encryption throughput, 0 if unavailable
+};
+
+
+class Luks
+{
+public:
+  // Similar to `cryptsetup benchmark`, but only the ciphers suitable for a disk, using the
+  // kernel crypto API directly, so it measures what dm-crypt will use (AES-NI/VAES).
+  static LuksCipher benchmark();
+
+  static bool format(const std::string_view dev, const std::string_view passphrase, const LuksCipher& cipher);
+  static bool open(const std::string_view dev, const std::string_view name, const std::string_view passphrase, const bool ssd, const bool discard);
+  static bool close(const std::string_view name);
+
+  static std::string mapper_dev(const std::string_view name) { return std::format("/dev/mapper/{}", name); }
+
+private:
+  static double measure(const std::string_view alg, const unsigned key_bits, const unsigned iv_size);
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef WALI_MOUNTUTILS_H
+#define WALI_MOUNTUTILS_H
+
+#include <string>
+#include <string_view>
+#include <wali/Common.hpp>
+
+
+// Mount and unmount with libmount, rather than spawning mount/umount.
+// On failure, `error` is set to libmount's description (i.e. "wrong fs type, bad option ...").
+class MountUtils
+{
+public:
+  // creates the mount point if it doesn't exist (as mount --mkdir)
+  static bool mount(const std::string_view dev, const std::string_view path, const std::string_view opts, std::string& error);
+
+  // lazy unmount if busy
+  static bool unmount(const std::string_view path, std::string& error);
+
+  // path and everything mounted below it, in reverse mount order so children are unmounted first
+  static bool unmount_recursive(const std::string_view path, std::string& error);
+
+private:
+  static bool do_unmount(const std::string_view path, const bool lazy, std::string& error);
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef WALI_NAMEINDEX_H
+#define WALI_NAMEINDEX_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Read-only, case insensitive search of a list of names, i.e. timezones. Built once
+// then shared by sessions, so each session only receives the names that match what
+// was typed, rather than every name.
+//
+// Matches are ranked:
+//  1. name starts with the query
+//  2. a word in the name starts with the query, i.e. "lon" matches "Europe/London"
+// and within each rank, names in `priority` are first, then alphabetical.
+class NameIndex
+{
+public:
+  NameIndex() = default;
+  NameIndex(std::vector<std::string> names);
+
+  // `more` is set if there are more than `limit` matches
+  std::vector<std::string_view> find(const std::string_view query, const std::size_t limit,
+                                     const std::vector<std::string>& priority, bool& more) const;
+
+  bool contains(const std::string_view name) const;
+
+  const std::vector<std::string>& names() const { return m_names; }
+  std::size_t size() const { return m_names.size(); }
+  bool empty() const { return m_names.empty(); }
+
+  // characters which start a word, must match the suggestion popup's word separators
+  static constexpr std::string_view WordSeparators {"-., \"@\n;/_"};
+
+private:
+  static std::string lower(const std::string_view s);
+
+private:
+  std::vector<std::string> m_names;   // sorted
+  std::vector<std::string> m_lower;   // m_names in lower case, same order
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef WALI_PACKAGEINDEX_H
+#define WALI_PACKAGEINDEX_H
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <wali/Common.hpp>
+
+
+inline static const fs::path PacmanSyncDir {"/var/lib/pacman/sync"};
+inline static const StringViewVec PacmanRepos {"core", "extra"};
+
+
+// Packages in the live system's pacman sync databases, so packages can be validated
+// without network requests to archlinux.org.
+//
+// Each string is stored once in an arena and referred to by id, and each package's
+// lists (depends, provides, groups) are ranges in one flat array of ids.
+class PackageIndex
+{
+public:
+  using StrId = std::uint32_t;
+
+  struct Range
+  {
+    std::uint32_t begin{}, end{};
+  };
+
+  struct Package
+  {
+    StrId name{}, version{}, desc{}, repo{};
+    std::uint64_t download_size{}, installed_size{};
+    Range depends, provides, groups;
+  };
+
+public:
+  PackageIndex();
+  PackageIndex(const PackageIndex&) = delete;
+  PackageIndex& operator=(const PackageIndex&) = delete;
+
+  // returns false if no database could be read
+  bool load(const fs::path& sync_dir = PacmanSyncDir, const StringViewVec& repos = PacmanRepos);
+
+  const Package * find(const std::string_view name) const;
+  bool contains(const std::string_view name) const { return find(name) != nullptr; }
+
+  // packages with `name` in their provides, i.e. "sh" is provided by bash
+  std::span<const std::uint32_t> providers(const std::string_view name) const;
+
+  // packages in group `name`, i.e. "base-devel"
+  std::span<const std::uint32_t> group(const std::string_view name) const;
+
+  std::uint32_t index_of(const Package& pkg) const { return static_cast<std::uint32_t>(&pkg - m_packages.data()); }
+
+  // name from a depends or provides entry, i.e. "glibc>=2.38" is "glibc"
+  static std::string_view dep_name(const std::string_view dep);
+
+  std::string_view str(const StrId id) const { return m_strings[id]; }
+  std::span<const StrId> list(const Range r) const { return {m_lists.data() + r.begin, r.end - r.begin}; }
+
+  const std::vector<Package>& packages() const { return m_packages; }
+  std::size_t size() const { return m_packages.size(); }
+  bool empty() const { return m_packages.empty(); }
+
+private:
+  bool read_db(const fs::path& path, const StrId repo);
+  void parse_desc(const std::string_view desc, const StrId repo);
+  StrId intern(const std::string_view s);
+
+private:
+  static constexpr std::size_t ArenaBlockSize = 256 * 1024;
+
+  // blocks never move, so the views in m_strings and the maps remain valid
+  std::vector<std::unique_ptr<char[]>> m_arena;
+  char * m_block{};
+  std::size_t m_block_free{};
+
+  std::vector<std::string_view> m_strings;
+  std::unordered_map<std::string_view, StrId> m_string_ids;
+
+  std::vector<Package> m_packages;
+  std::vector<StrId> m_lists;
+  std::unordered_map<std::string_view, std::uint32_t> m_by_name; // name to m_packages index
+  std::unordered_map<std::string_view, std::vector<std::uint32_t>> m_providers;
+  std::unordered_map<std::string_view, std::vector<std::uint32_t>> m_groups;
+};
+
+using PackageIndexPtr = std::shared_ptr<const PackageIndex>;
+
+#endif
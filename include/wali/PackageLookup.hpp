@@ -0,0 +1,44 @@
+#ifndef WALI_PACKAGELOOKUP_H
+#define WALI_PACKAGELOOKUP_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <wali/Common.hpp>
+
+
+enum class LookupResult
+{
+  Found,
+  NotFound,
+  Failed    // no usable response after retries
+};
+
+using OnLookup = std::function<void(const std::string&, const LookupResult)>;
+using OnLookupDone = std::function<void()>;
+
+
+// Checks packages exist with archlinux.org's search API. Only used when the local sync
+// databases are unavailable (see PackageIndex).
+//
+// The API accepts one package per request, and responds with 429 if requests are sent
+// too quickly, so this is shared by all sessions:
+//  - HTTP clients are pooled and reused, rather than one per request
+//  - responses are cached for CacheTtl, so repeated searches don't send requests
+//  - concurrent requests are limited with AIMD: the limit increases by one for each
+//    success and halves on 429, so it settles just below what the server permits
+//  - a failed request is retried, with a delay, up to MaxAttempts, without affecting
+//    the other packages
+class PackageLookup
+{
+public:
+  // on_result is called once per name and on_done after the last, both in the
+  // session's context (via WServer::post())
+  static void lookup(const std::vector<std::string>& names, const std::string& session_id, OnLookup on_result, OnLookupDone on_done);
+
+  // destroys the clients, which use the server's io service, so must be called after
+  // WServer::stop() but before the server is destroyed
+  static void shutdown();
+};
+
+#endif
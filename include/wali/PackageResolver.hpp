@@ -0,0 +1,46 @@
+#ifndef WALI_PACKAGERESOLVER_H
+#define WALI_PACKAGERESOLVER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <wali/Common.hpp>
+#include <wali/PackageIndex.hpp>
+
+
+struct Resolution
+{
+  std::vector<std::uint32_t> packages;  // indexes into PackageIndex::packages()
+  std::vector<std::string> missing;     // not a package, group or provided by a package
+  std::uint64_t download_size{};
+  std::uint64_t installed_size{};
+};
+
+
+struct Expansion
+{
+  PackageSet packages;  // every name is a package in the index
+  PackageSet missing;
+};
+
+
+// Finds every package pacman would install for a set of names: each name is a package,
+// a group or a virtual package (provided by another), then their dependencies recursively.
+//
+// Version constraints are ignored, the sync databases only have one version of each package.
+class PackageResolver
+{
+public:
+  static Resolution resolve(const PackageIndex& index, const PackageSet& names);
+
+  // Replaces groups with their packages and virtual packages with a provider, without
+  // dependencies. Names in `exclude`, and group members in `exclude`, are skipped.
+  static Expansion expand(const PackageIndex& index, const std::vector<std::string>& names, const PackageSet& exclude);
+
+  // Names separated by whitespace or commas. A '#' comments the rest of the line, so
+  // a manifest file can be annotated.
+  static std::vector<std::string> parse_list(const std::string_view text);
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef WALI_PACKAGESEARCH_H
+#define WALI_PACKAGESEARCH_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <wali/PackageIndex.hpp>
+
+
+// Type-ahead search of package names and descriptions. Built once from a PackageIndex
+// then shared by all sessions.
+//
+// Names and descriptions are stored lower case in one contiguous string. A trigram
+// index (every 3 character sequence to the packages containing it) limits the
+// candidates, which are then confirmed with a substring search.
+//
+// Results are ranked:
+//  1. name is the query
+//  2. name starts with the query
+//  3. a word in the name starts with the query
+//  4. name contains the query
+//  5. description contains the query
+// then shorter names first, then alphabetical.
+class PackageSearch
+{
+public:
+  PackageSearch(PackageIndexPtr index);
+
+  // returns indexes into index().packages()
+  std::vector<std::uint32_t> find(const std::string_view query, const std::size_t limit) const;
+
+  const PackageIndex& index() const { return *m_index; }
+
+private:
+  using Trigram = std::uint32_t;
+
+  struct Entry
+  {
+    std::uint32_t name_offset, name_size;
+    std::uint32_t desc_offset, desc_size;
+  };
+
+  std::string_view name(const std::uint32_t i) const { return {m_text.data() + m_entries[i].name_offset, m_entries[i].name_size}; }
+  std::string_view desc(const std::uint32_t i) const { return {m_text.data() + m_entries[i].desc_offset, m_entries[i].desc_size}; }
+
+  std::vector<std::uint32_t> candidates(const std::string_view query) const;
+  int rank(const std::uint32_t i, const std::string_view query) const;
+
+  static Trigram trigram(const std::string_view s, const std::size_t pos)
+  {
+    return (static_cast<unsigned char>(s[pos]) << 16) | (static_cast<unsigned char>(s[pos+1]) << 8) | static_cast<unsigned char>(s[pos+2]);
+  }
+
+private:
+  PackageIndexPtr m_index;
+  std::string m_text;              // lower case names and descriptions
+  std::vector<Entry> m_entries;    // same order as m_index->packages()
+
+  // compressed sparse rows: packages containing m_trigrams[i] are
+  // m_postings[m_offsets[i]] to m_postings[m_offsets[i+1]]
+  std::vector<Trigram> m_trigrams;
+  std::vector<std::uint32_t> m_offsets;
+  std::vector<std::uint32_t> m_postings;
+};
+
+using PackageSearchPtr = std::shared_ptr<const PackageSearch>;
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef WALI_SYSTEMFACTS_H
+#define WALI_SYSTEMFACTS_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <wali/Common.hpp>
+#include <wali/DiskUtils.hpp>
+#include <wali/NameIndex.hpp>
+#include <wali/PackageIndex.hpp>
+#include <wali/PackageSearch.hpp>
+
+
+// Profile file name and its JSON, unparsed
+using ProfileFile = std::pair<std::string, std::string>;
+
+// Information about the live system which doesn't change during a session.
+// Collected once, shared by all sessions.
+struct Facts
+{
+  std::string startup_error;  // empty if startup checks passed
+  NameIndex timezones;
+  NameIndex locales;
+  NameIndex keymaps;
+  GpuVendor gpu{GpuVendor::Unknown};
+  CpuVendor cpu{CpuVendor::None};
+  Tree tree;
+  PackageIndexPtr packages;   // empty if sync databases could not be read
+  PackageSearchPtr package_search;
+};
+
+using FactsPtr = std::shared_ptr<const Facts>;
+
+
+// Collects Facts concurrently, once per process. Sessions receive an immutable snapshot,
+// so a refresh never changes data a session is already using.
+class SystemFacts
+{
+public:
+  // Begin collecting without waiting. Called at process start so the first session doesn't wait.
+  static void warm();
+
+  // Returns the current snapshot, waiting if it is still being collected
+  static FactsPtr get();
+
+  // True if get() would not wait
+  static bool is_ready();
+
+  // Collect everything again, i.e. to retry failed startup checks
+  static FactsPtr refresh();
+
+  // Probe disks again, i.e. after partitioning. Other facts are copied from the current snapshot.
+  static FactsPtr refresh_disks();
+
+  // Profiles are in the docroot, which is only known when a session starts, so are read
+  // by the first session which asks then cached.
+  static const std::vector<ProfileFile>& profiles(const fs::path& docroot);
+
+private:
+  static FactsPtr collect();
+  static std::string startup_checks();
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef WALI_SYSTEMD_H
+#define WALI_SYSTEMD_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <wali/Common.hpp>
+
+
+// Enables units in an installed system, as `systemctl --root enable` does, but without
+// spawning a process per unit. Reads the [Install] section of the unit file then creates
+// the symlinks in etc/systemd/system.
+class Systemd
+{
+public:
+  // Returns units that could not be enabled (unit file not found or unreadable)
+  static std::vector<std::string> enable(const fs::path& root, const std::vector<std::string>& units);
+
+private:
+  struct UnitInstall
+  {
+    std::vector<std::string> wanted_by;
+    std::vector<std::string> required_by;
+    std::vector<std::string> upheld_by;
+    std::vector<std::string> alias;
+    std::vector<std::string> also;
+    std::string default_instance;
+  };
+
+  struct UnitName
+  {
+    std::string name;     // i.e. getty@tty1.service
+    std::string prefix;   // i.e. getty
+    std::string instance; // i.e. tty1
+    std::string suffix;   // i.e. .service
+  };
+
+  static bool enable_unit(const fs::path& root, const std::string_view unit, std::vector<std::string>& done);
+  static UnitName parse_name(const std::string_view unit);
+  static std::optional<fs::path> find_unit(const fs::path& root, const UnitName& name);
+  static bool parse_install(const fs::path& path, UnitInstall& install);
+  static std::string expand(const std::string_view value, const UnitName& name);
+  static bool link(const fs::path& link_path, const fs::path& target);
+};
+
+#endif
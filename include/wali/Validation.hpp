@@ -0,0 +1,42 @@
+#ifndef WALI_VALIDATION_H
+#define WALI_VALIDATION_H
+
+#include <string>
+#include <vector>
+#include <wali/Common.hpp>
+#include <wali/DiskUtils.hpp>
+#include <wali/SystemFacts.hpp>
+#include <wali/widgets/WidgetData.hpp>
+
+
+struct ValidationMessage
+{
+  enum class Level {Info, Warning, Error};
+
+  Level level;
+  std::string text;
+};
+
+using ValidationMessages = std::vector<ValidationMessage>;
+
+
+// Rules for WidgetData, shared by the widgets and the headless install so an answer
+// file is checked the same as the UI. Each returns false if a message is an error.
+class Validation
+{
+public:
+  static bool mounts(const MountData& data, const Tree& tree, ValidationMessages& messages);
+  static bool accounts(const AccountsData& data, ValidationMessages& messages);
+  static bool network(const netmanagerata& data, ValidationMessages& messages);
+  static bool localise(const LocaliseData& data, const Facts& facts, ValidationMessages& messages);
+  static bool archive(const WidgetData& data, ValidationMessages& messages);
+
+  // the above, and that the packages fit on root
+  static bool all(const WidgetData& data, const Facts& facts, ValidationMessages& messages);
+
+private:
+  static void image(const MountData& data, ValidationMessages& messages);
+  static bool no_errors(const ValidationMessages& messages);
+};
+
+#endif
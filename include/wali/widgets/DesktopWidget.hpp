@@ -11,6 +11,7 @@
 #include <Wt/WRadioButton.h>
 #include <Wt/WVBoxLayout.h>
 #include <wali/widgets/Common.hpp>
+#include <wali/widgets/EstimateWidget.hpp>
 #include <wali/widgets/VideoWidget.hpp>
 #include <wali/widgets/WaliWidget.hpp>
 
@@ -20,6 +21,8 @@ class DesktopWidget : public WaliWidget
 public:
   DesktopWidget(WidgetDataPtr data);
 
+  void on_show() override;
+
 private:
   void read_profiles();
   void on_desktop_change();
@@ -27,7 +30,7 @@ private:
 private:
   std::map<std::string, Wt::Json::Object> m_profiles;
   WText * m_info;
-  // WText * m_warning;
+  EstimateWidget * m_estimate;
   WComboBox * m_desktops,
             * m_dm;
   VideoWidget * m_video_widget;
@@ -0,0 +1,45 @@
+#ifndef WALI_ESTIMATEWIDGET_H
+#define WALI_ESTIMATEWIDGET_H
+
+#include <wali/Common.hpp>
+#include <wali/InstallEstimate.hpp>
+#include <wali/widgets/MessagesWidget.hpp>
+#include <wali/widgets/WidgetData.hpp>
+
+
+// Download and installed size of everything selected so far, with an error
+// if it won't fit on the root device.
+class EstimateWidget : public MessageWidget
+{
+public:
+  // returns false if the packages don't fit on root
+  bool refresh(const WidgetData& data)
+  {
+    const auto est = InstallEstimate::estimate(data);
+
+    clear_messages();
+
+    if (!est.available)
+    {
+      add("Package sizes unavailable, no pacman sync databases", Level::Warning);
+      return true;
+    }
+
+    add(std::format("{} packages: {} download, {} installed", est.package_count,
+                                                              format_size(static_cast<int64_t>(est.download_size)),
+                                                              format_size(static_cast<int64_t>(est.installed_size))), Level::Info);
+
+    if (!est.missing.empty())
+      add(std::format("Not found: {}", flatten(est.missing)), Level::Warning);
+
+    if (!est.fits())
+    {
+      add(std::format("Root requires at least {}, but is {}", format_size(static_cast<int64_t>(est.required)),
+                                                                format_size(est.root_capacity)), Level::Error);
+    }
+
+    return est.fits();
+  }
+};
+
+#endif
@@ -6,6 +6,7 @@
 #include <Wt/WComboBox.h>
 #include <Wt/WGlobal.h>
 #include <Wt/WHBoxLayout.h>
+#include <Wt/WMemoryResource.h>
 #include <Wt/WMenu.h>
 #include <Wt/WObject.h>
 #include <Wt/WPanel.h>
@@ -21,6 +22,7 @@
 #include <wali/Common.hpp>
 #include <wali/Install.hpp>
 #include <wali/widgets/Common.hpp>
+#include <wali/widgets/EstimateWidget.hpp>
 #include <wali/widgets/WaliWidget.hpp>
 #include <Wt/WStackedWidget.h>
 
@@ -34,7 +36,7 @@ struct StageLog : public WContainerWidget
   //   textArea.scrollTop = document.getElementById('stage_log').scrollHeight;
   // )";
 
-  StageLog(const std::string_view name, const bool collapsed, const std::size_t init_size)
+  StageLog(const std::string_view name, const bool collapsed, const std::size_t init_size) : m_init_size(init_size)
   {
     // layout?
     m_panel = addWidget(make_wt<WPanel>());
@@ -47,8 +49,6 @@ struct StageLog : public WContainerWidget
     m_text->setStyleClass("stage_log");
     // m_text->setId("stage_log");
     // WApplication::instance()->doJavaScript(AutoScroll);
-
-    m_log.reserve(init_size);
   }
 
   void add(const std::string_view msg, const InstallLogLevel level)
@@ -60,6 +60,8 @@ struct StageLog : public WContainerWidget
 
   void start()
   {
+    // only reserved when an install starts, rather than for every session
+    m_log.reserve(m_init_size);
     m_panel->setCollapsed(false);
   }
 
@@ -79,6 +81,7 @@ struct StageLog : public WContainerWidget
     WPanel * m_panel;
     WTextArea * m_text;
     std::string m_log;
+    std::size_t m_init_size;
 };
 
 
@@ -91,6 +94,8 @@ public:
 
   void update_data();
 
+  void on_show() override;
+
   Signal<InstallState>& install_state() { return m_on_install_state; }
 
 private:
@@ -114,9 +119,12 @@ private:
   Widgets * m_widgets;
   WPushButton * m_install_btn,
               * m_reboot_btn,
-              * m_cancel_btn;
+              * m_cancel_btn,
+              * m_export_btn;
   // WSplitButton * m_savelog_btn;
   WText * m_install_status;
+  EstimateWidget * m_estimate;
+  std::shared_ptr<WMemoryResource> m_answers;
   // WComboBox * m_log_cb;
   std::future<void> m_install_future;
   Signal<InstallState> m_on_install_state;
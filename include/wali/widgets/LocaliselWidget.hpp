@@ -1,9 +1,10 @@
 #ifndef WALI_LOCALISEWIDGET_H
 #define WALI_LOCALISEWIDGET_H
 
-#include <Wt/WComboBox.h>
+#include <Wt/WLineEdit.h>
 #include <wali/Common.hpp>
-#include <wali/Commands.hpp>
+#include <wali/NameIndex.hpp>
+#include <wali/SystemFacts.hpp>
 #include <wali/widgets/Common.hpp>
 #include <wali/widgets/WaliWidget.hpp>
 #include <wali/widgets/WidgetData.hpp>
@@ -15,9 +16,15 @@ public:
   LocaliseWidget(WidgetDataPtr data);
 
 private:
-  WComboBox * m_timezones;
-  WComboBox * m_locales;
-  WComboBox * m_keymap;
+  WLineEdit * add_search(WVBoxLayout * layout, const std::string_view label, const NameIndex& index,
+                         const std::vector<std::string>& priority, std::string& value);
+  void validate();
+
+private:
+  FactsPtr m_facts; // keeps the indexes alive
+  WLineEdit * m_timezones;
+  WLineEdit * m_locales;
+  WLineEdit * m_keymap;
 };
 
 #endif
@@ -3,6 +3,7 @@
 
 #include <wali/widgets/Common.hpp>
 #include <wali/Common.hpp>
+#include <wali/Validation.hpp>
 
 class MessageWidget : public WContainerWidget
 {
@@ -36,6 +37,19 @@ public:
       ++m_error_count;
   }
 
+  void add(const ValidationMessages& messages)
+  {
+    for (const auto& msg : messages)
+    {
+      switch (msg.level)
+      {
+        case ValidationMessage::Level::Error:   add(msg.text, Level::Error);    break;
+        case ValidationMessage::Level::Warning: add(msg.text, Level::Warning);  break;
+        case ValidationMessage::Level::Info:    add(msg.text, Level::Info);     break;
+      }
+    }
+  }
+
   bool has_errors() const { return m_error_count > 0; }
 
 private:
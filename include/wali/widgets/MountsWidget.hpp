@@ -8,7 +8,9 @@
 
 #include <Wt/WComboBox.h>
 #include <Wt/WGlobal.h>
+#include <Wt/WLineEdit.h>
 #include <Wt/WRadioButton.h>
+#include <Wt/WSelectionBox.h>
 #include <Wt/WButtonGroup.h>
 #include <Wt/WTable.h>
 #include <Wt/WVBoxLayout.h>
@@ -16,6 +18,7 @@
 #include <wali/widgets/MessagesWidget.hpp>
 #include <wali/widgets/WidgetData.hpp>
 #include <wali/widgets/WaliWidget.hpp>
+#include <wali/widgets/Common.hpp>
 #include <wali/Common.hpp>
 #include <wali/DiskUtils.hpp>
 
@@ -68,6 +71,12 @@ struct DeviceFilesytemWidget : public WContainerWidget
     return m_fs->currentText().toUTF8();
   }
 
+  void set_fs(const std::string_view fs)
+  {
+    if (const int i = m_fs ? m_fs->findText(fs.data()) : -1; i >= 0)
+      m_fs->setCurrentIndex(i);
+  }
+
   void refresh_partitions()
   {
     m_device->clear();
@@ -81,6 +90,68 @@ private:
 };
 
 
+// Draws a RAID level dropdown and a list of partitions on other disks to stripe/mirror with
+struct StripeWidget : public WContainerWidget
+{
+  StripeWidget(const std::shared_ptr<Partitions> parts, Validate validate) : m_parts(parts)
+  {
+    auto layout = setLayout(make_wt<Wt::WHBoxLayout>());
+    layout->setContentsMargins(0,0,0,0);
+
+    layout->addWidget(make_wt<WText>("Across disks"));
+    m_level = layout->addWidget(make_wt<WComboBox>());
+    m_level->setWidth(150);
+    m_level->addItem("None");
+    m_level->addItem("RAID0 (stripe)");
+    m_level->addItem("RAID1 (mirror)");
+    m_level->addItem("RAID10");
+    m_level->changed().connect([this, validate]
+    {
+      m_devices->setDisabled(get_level() == RaidLevel::None);
+      validate();
+    });
+
+    m_devices = layout->addWidget(make_wt<WSelectionBox>());
+    m_devices->setSelectionMode(Wt::SelectionMode::Extended);
+    m_devices->setVerticalSize(3);
+    m_devices->setWidth(150);
+    m_devices->setDisabled(true);
+    m_devices->changed().connect(validate);
+
+    layout->addStretch(1);
+  }
+
+  RaidLevel get_level() const
+  {
+    return static_cast<RaidLevel>(m_level->currentIndex());
+  }
+
+  StripeData get_data() const
+  {
+    StripeData data {.level = get_level()};
+
+    if (data.level != RaidLevel::None)
+    {
+      for (const int i : m_devices->selectedIndexes())
+        data.devs.push_back(m_devices->itemText(i).toUTF8());
+    }
+
+    return data;
+  }
+
+  void refresh_partitions()
+  {
+    m_devices->clear();
+    rng::for_each(*m_parts, [this](const Partition& part) { m_devices->addItem(part.dev); });
+  }
+
+private:
+  WComboBox * m_level;
+  WSelectionBox * m_devices;
+  std::shared_ptr<Partitions> m_parts;
+};
+
+
 class MountsWidget : public WaliWidget
 {
   struct BootPartitionWidget : public WContainerWidget
@@ -109,27 +180,35 @@ class MountsWidget : public WaliWidget
 
   struct RootPartitionWidget : public WContainerWidget
   {
-    RootPartitionWidget(const std::shared_ptr<Partitions> parts, Validate validate)
+    RootPartitionWidget(const std::shared_ptr<Partitions> parts, const std::shared_ptr<Partitions> other_parts, Validate validate)
     {
       auto layout = setLayout(make_wt<WVBoxLayout>());
       layout->setContentsMargins(0,0,0,0);
 
       layout->addWidget(make_wt<Wt::WText>("<h3>Root</h3>"));
 
-      m_dev_fs = layout->addWidget(make_wt<DeviceFilesytemWidget>(parts, std::move(validate), StringViewVec{"ext4", "btrfs"}));
+      m_dev_fs = layout->addWidget(make_wt<DeviceFilesytemWidget>(parts, validate, Filesystems));
+      m_stripe = layout->addWidget(make_wt<StripeWidget>(other_parts, validate));
     }
 
     std::string get_device() const { return m_dev_fs->get_device(); }
     std::string get_fs() const { return m_dev_fs->get_fs(); }
-    void refresh_partitions() { m_dev_fs->refresh_partitions(); }
+    StripeData get_stripe() const { return m_stripe->get_data(); }
+    void set_fs(const std::string_view fs) { m_dev_fs->set_fs(fs); }
+    void refresh_partitions()
+    {
+      m_dev_fs->refresh_partitions();
+      m_stripe->refresh_partitions();
+    }
 
   private:
       DeviceFilesytemWidget * m_dev_fs;
+      StripeWidget * m_stripe;
   };
 
   struct HomePartitionWidget : public WContainerWidget
   {
-    HomePartitionWidget(const std::shared_ptr<Partitions> parts, Validate validate)
+    HomePartitionWidget(const std::shared_ptr<Partitions> parts, const std::shared_ptr<Partitions> other_parts, Validate validate)
     {
       auto layout = setLayout(make_wt<WVBoxLayout>());
       layout->setContentsMargins(0,0,0,0);
@@ -139,7 +218,8 @@ class MountsWidget : public WaliWidget
       m_btn_to_root = layout->addWidget(make_wt<Wt::WRadioButton>("Mount /home to root partition"));
 
       m_btn_to_new = layout->addWidget(make_wt<Wt::WRadioButton>("Mount /home to new partition"));
-      m_devfs_to_new = layout->addWidget(make_wt<DeviceFilesytemWidget>(parts, validate, StringViewVec{"ext4", "btrfs"}));
+      m_devfs_to_new = layout->addWidget(make_wt<DeviceFilesytemWidget>(parts, validate, Filesystems));
+      m_stripe_to_new = layout->addWidget(make_wt<StripeWidget>(other_parts, validate));
 
       m_btn_to_existing = layout->addWidget(make_wt<Wt::WRadioButton>("Mount /home to existing partition"));
       m_devfs_to_existing = layout->addWidget(make_wt<DeviceFilesytemWidget>(parts, validate));
@@ -153,6 +233,7 @@ class MountsWidget : public WaliWidget
       {
         m_target = HomeMountTarget::Root;
         m_devfs_to_new->setDisabled(true);
+        m_stripe_to_new->setDisabled(true);
         m_devfs_to_existing->setDisabled(true);
         validate();
       });
@@ -161,6 +242,7 @@ class MountsWidget : public WaliWidget
       {
         m_target = HomeMountTarget::New;
         m_devfs_to_new->setDisabled(false);
+        m_stripe_to_new->setDisabled(false);
         m_devfs_to_existing->setDisabled(true);
         validate();
       });
@@ -170,11 +252,13 @@ class MountsWidget : public WaliWidget
         m_target = HomeMountTarget::Existing;
         m_devfs_to_existing->setDisabled(false);
         m_devfs_to_new->setDisabled(true);
+        m_stripe_to_new->setDisabled(true);
         validate();
       });
 
       m_target = HomeMountTarget::Root;
       m_devfs_to_new->setDisabled(true);
+      m_stripe_to_new->setDisabled(true);
       m_devfs_to_existing->setDisabled(true);
 
       m_btn_group->setSelectedButtonIndex(0);
@@ -200,9 +284,15 @@ class MountsWidget : public WaliWidget
         return m_btn_to_existing->isChecked() ? "" : m_devfs_to_new->get_fs();
     }
 
+    StripeData get_stripe() const
+    {
+      return m_target == HomeMountTarget::New ? m_stripe_to_new->get_data() : StripeData{};
+    }
+
     void refresh_partitions()
     {
       m_devfs_to_new->refresh_partitions();
+      m_stripe_to_new->refresh_partitions();
       m_devfs_to_existing->refresh_partitions();
     }
 
@@ -213,9 +303,106 @@ class MountsWidget : public WaliWidget
     std::shared_ptr<WButtonGroup> m_btn_group;
     DeviceFilesytemWidget * m_devfs_to_existing;
     DeviceFilesytemWidget * m_devfs_to_new;
+    StripeWidget * m_stripe_to_new;
     HomeMountTarget m_target;
   };
 
+  struct BtrfsWidget : public WContainerWidget
+  {
+    BtrfsWidget(Validate validate)
+    {
+      static const BtrfsData Defaults;
+
+      auto layout = setLayout(make_wt<WVBoxLayout>());
+      layout->setContentsMargins(0,0,0,0);
+
+      layout->addWidget(make_wt<Wt::WText>("<h3>Btrfs</h3>"));
+
+      auto compress_layout = layout->addLayout(make_wt<WHBoxLayout>());
+      compress_layout->addWidget(make_wt<WText>("Compression"));
+      m_compress = compress_layout->addWidget(make_wt<WComboBox>());
+      m_compress->setWidth(150);
+      m_compress->changed().connect(validate);
+      compress_layout->addStretch(1);
+
+      for (const auto level : CompressLevels)
+        m_compress->addItem(level ? std::format("zstd:{}", level) : "None");
+
+      m_compress->setCurrentIndex(rng::distance(rng::begin(CompressLevels), rng::find(CompressLevels, Defaults.compress_level)));
+
+      for (const auto& subvol : Defaults.subvolumes)
+      {
+        auto box = layout->addWidget(make_wt<WCheckBox>(std::format("{} on /{}", subvol.name, subvol.path)));
+        box->setChecked(true);
+        box->changed().connect(validate);
+
+        m_subvolumes.emplace_back(box, subvol);
+      }
+    }
+
+    BtrfsData get_data() const
+    {
+      BtrfsData data;
+      data.compress_level = CompressLevels[m_compress->currentIndex()];
+      data.subvolumes.clear();
+
+      for (const auto& [box, subvol] : m_subvolumes)
+      {
+        if (box->isChecked())
+          data.subvolumes.push_back(subvol);
+      }
+
+      return data;
+    }
+
+  private:
+    static constexpr int CompressLevels[] = {0, 1, 3, 6, 9};
+
+    WComboBox * m_compress;
+    std::vector<std::pair<WCheckBox *, BtrfsSubvolume>> m_subvolumes;
+  };
+
+  struct LuksWidget : public WContainerWidget
+  {
+    LuksWidget(Validate validate)
+    {
+      auto layout = setLayout(make_wt<WVBoxLayout>());
+      layout->setContentsMargins(0,0,0,0);
+
+      layout->addWidget(make_wt<Wt::WText>("<h3>Encryption</h3>"));
+
+      m_root = layout->addWidget(make_wt<WCheckBox>("Encrypt root"));
+      m_root->changed().connect(validate);
+
+      m_home = layout->addWidget(make_wt<WCheckBox>("Encrypt new /home"));
+      m_home->changed().connect(validate);
+
+      m_pass = add_form_pair<WLineEdit>(layout, "Passphrase", 100);
+      m_pass->setEchoMode(Wt::EchoMode::Password);
+      m_pass->changed().connect(validate);
+
+      m_pass_confirm = add_form_pair<WLineEdit>(layout, "Confirm", 100);
+      m_pass_confirm->setEchoMode(Wt::EchoMode::Password);
+      m_pass_confirm->changed().connect(validate);
+    }
+
+    bool is_enabled() const { return m_root->isChecked() || m_home->isChecked(); }
+    bool is_confirmed() const { return m_pass->text() == m_pass_confirm->text(); }
+
+    LuksData get_data() const
+    {
+      return LuksData { .root = m_root->isChecked(),
+                        .home = m_home->isChecked(),
+                        .passphrase = is_enabled() ? m_pass->text().toUTF8() : ""};
+    }
+
+  private:
+    WCheckBox * m_root;
+    WCheckBox * m_home;
+    WLineEdit * m_pass;
+    WLineEdit * m_pass_confirm;
+  };
+
 public:
   MountsWidget(WidgetDataPtr data);
 
@@ -230,11 +417,14 @@ private:
   BootPartitionWidget * m_boot;
   RootPartitionWidget * m_root;
   HomePartitionWidget * m_home;
+  BtrfsWidget * m_btrfs;
+  LuksWidget * m_luks;
   WComboBox * m_boot_loader;
   WCheckBox * m_zram;
   MessageWidget * m_messages;
   Tree m_tree;
   std::shared_ptr<Partitions> m_partitions;
+  std::shared_ptr<Partitions> m_other_partitions; // on other disks, for stripes
   WTable * m_table;
   WComboBox * m_disk;
 };
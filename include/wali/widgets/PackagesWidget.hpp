@@ -2,77 +2,56 @@
 #define WALI_PACKAGESSWIDGET_H
 
 
-#include <Wt/Json/Value.h>
 #include <Wt/WApplication.h>
 #include <Wt/WGlobal.h>
 #include <Wt/WPushButton.h>
 #include <Wt/WSelectionBox.h>
+#include <Wt/WTextArea.h>
 #include <Wt/WTextEdit.h>
-#include <Wt/Http/Client.h>
-#include <Wt/Json/Array.h>
-#include <Wt/Json/Object.h>
-#include <Wt/Json/Parser.h>
 #include <Wt/WVBoxLayout.h>
-#include <queue>
 #include <sys/mount.h>
 #include <wali/Common.hpp>
+#include <wali/PackageIndex.hpp>
+#include <wali/PackageSearch.hpp>
 #include <wali/widgets/Common.hpp>
+#include <wali/widgets/EstimateWidget.hpp>
+#include <wali/widgets/MessagesWidget.hpp>
 #include <wali/widgets/WidgetData.hpp>
 
 
-class PackageQueue
-{
-public:
-
-  void add(const std::string& name)
-  {
-    m_q.push(name);
-  }
-
-  std::string next()
-  {
-    const auto name = m_q.front();
-    m_q.pop();
-    return name;
-  }
-
-  void clear()
-  {
-    m_q = std::queue<std::string>{};
-  }
-
-  std::size_t size() const { return m_q.size();  }
-
-  bool empty() const { return m_q.empty(); }
-
-private:
-  std::queue<std::string> m_q;
-};
-
-
 class PackagesWidget : public WaliWidget
 {
 public:
   PackagesWidget(WidgetDataPtr data);
 
+  void on_show() override;
+
 private:
   void search ();
-  void on_response(std::error_code rsp_err, const Http::Message& rsp);
-  void send_next();
+  void import_list(const std::string& list);
+  PackageSet add_local(const PackageIndex& index, const std::vector<std::string>& names);
+  void create_finder(WVBoxLayout * layout);
+  void create_import(WVBoxLayout * layout);
+  void add_package(const std::string& name);
+  void refresh_estimate();
+  void search_remote(const std::vector<std::string>& names);
   void enable_search(const bool enable);
-  Json::Array parse_response(const std::string body);
 
 private:
   WLineEdit * m_line_packages;
+  WLineEdit * m_finder{};
+  WTextArea * m_import;
   WPushButton * m_btn_search,
               * m_btn_clear,
-              * m_btn_rmv;
+              * m_btn_rmv,
+              * m_btn_import;
   WSelectionBox * m_list_confirmed;
-  PackageSet m_packages_pending;   // waiting on http response OR package does not exist
-  PackageSet m_packages_confirmed; // have http response and package exists
-  PackagesData data;
-  std::size_t m_sent{}, m_rcvd{};
-  PackageQueue m_queue; // used to limit the rate of requests to Arch package server
+  MessageWidget * m_import_msg;
+  MessageWidget * m_search_msg;
+  EstimateWidget * m_estimate;
+  PackageSet m_packages_missing;   // not found
+  PackageSet m_packages_failed;    // lookup failed after retries, so may exist
+  PackageSearchPtr m_package_search;
 };
 
 #endif
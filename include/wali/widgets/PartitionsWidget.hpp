@@ -26,6 +26,8 @@ private:
 
   void calculate_sizes();
   void create();
+  void create_stripe_disk(const std::string& disk, const int64_t root_size);
+  std::vector<std::string> get_stripe_disks() const;
 
 private:
   Tree m_tree;
@@ -35,6 +37,7 @@ private:
             * m_boot,
             * m_home;
   WSpinBox  * m_root;
+  WSelectionBox * m_stripe;
   WText * m_remaining;
   WPushButton * m_create;
   WText * m_total;
@@ -24,16 +24,27 @@ public:
 
   bool is_data_valid() const { return m_valid; }
 
+  // called each time the page is shown, for data which depends on other pages
+  virtual void on_show() { }
+
 protected:
   bool set_valid (const bool valid = true)
   {
     m_valid = valid;
+    m_data->valid.set(objectName(), valid);
     data_valid()(valid);
     return is_data_valid();
   }
 
   void set_invalid () { set_valid(false); }
 
+  // whether the packages fit on root, so both Install buttons are disabled if not
+  void set_fits (const bool fits)
+  {
+    m_data->valid.set(Validity::Fits, fits);
+    data_valid()(is_data_valid());
+  }
+
 protected:
   WidgetDataPtr m_data;
   Wt::Signal<bool> m_evt_valid;
@@ -1,8 +1,13 @@
 #ifndef WALI_WIDGETDATA_H
 #define WALI_WIDGETDATA_H
 
+#include <algorithm>
 #include <chrono>
+#include <functional>
+#include <map>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <wali/Common.hpp>
 
 enum class HomeMountTarget
@@ -18,6 +23,26 @@ enum class Bootloader
   Grub
 };
 
+enum class RaidLevel
+{
+  None,
+  Raid0,
+  Raid1,
+  Raid10
+};
+
+// mdadm --level and btrfs profile names are the same
+inline std::string_view raid_level_name(const RaidLevel level)
+{
+  switch (level)
+  {
+    case RaidLevel::Raid0:  return "raid0";
+    case RaidLevel::Raid1:  return "raid1";
+    case RaidLevel::Raid10: return "raid10";
+    default:                return "";
+  }
+}
+
 struct AccountsData
 {
   std::string root_pass;
@@ -27,6 +52,59 @@ struct AccountsData
   bool user_sudo{true};
 };
 
+inline const StringViewVec UserShells {"zsh", "fish", "sh"};
+
+struct BtrfsSubvolume
+{
+  std::string name; // i.e. @log
+  std::string path; // mount point, relative to root
+};
+
+struct BtrfsData
+{
+  // in addition to @ and @home
+  std::vector<BtrfsSubvolume> subvolumes
+  {
+    {"@log",        "var/log"},
+    {"@cache",      "var/cache"},
+    {"@pkg",        "var/cache/pacman/pkg"},
+    {"@tmp",        "var/tmp"},
+    {"@snapshots",  ".snapshots"}
+  };
+
+  // VM images and databases rewrite in place, so copy-on-write only causes fragmentation
+  std::vector<std::string> nodatacow {"var/lib/libvirt/images", "var/lib/mysql", "var/lib/postgres"};
+
+  int compress_level{3}; // zstd, 0 to disable
+};
+
+// A filesystem striped/mirrored across partitions on multiple disks. This is native
+// for btrfs, otherwise an md array.
+struct StripeData
+{
+  RaidLevel level{RaidLevel::None};
+  std::vector<std::string> devs; // in addition to the root or home partition
+};
+
+// LUKS2 on root and/or a new home, with the same passphrase
+struct LuksData
+{
+  bool root{};
+  bool home{};
+  std::string passphrase;
+};
+
+// Install into a sparse raw image file rather than to disks. The image is attached as a
+// loop device and partitioned with boot then root, which are assigned to MountData.
+struct ImageData
+{
+  std::string path;       // empty to install to disks
+  int64_t size{};         // bytes
+  bool compact{true};     // trim then punch zero blocks, so the file only holds data
+};
+
+inline const int64_t ImageBootSize = mb_to_b(1024);
+
 struct MountData
 {
   std::string boot_dev;
@@ -37,7 +115,19 @@ struct MountData
   std::string home_fs;
   HomeMountTarget home_target;
   Bootloader boot_loader;
+  BtrfsData btrfs;
+  StripeData root_stripe;
+  StripeData home_stripe;
+  LuksData luks;
+  ImageData image;
   bool zram{true};
+
+  // an md array for root or a new home, a multi-device btrfs uses its own profiles.
+  // Shared by Install and the package estimate, so they agree.
+  bool root_md() const { return root_stripe.level != RaidLevel::None && root_fs != "btrfs"; }
+  bool home_md() const { return home_target == HomeMountTarget::New && home_stripe.level != RaidLevel::None && home_fs != "btrfs"; }
+  bool uses_md() const { return root_md() || home_md(); }
+  bool uses_luks() const { return luks.root || (luks.home && home_target == HomeMountTarget::New); }
 };
 
 struct PackagesData
@@ -73,6 +163,15 @@ struct VideoData
   PackageSet drivers;
 };
 
+// Golden images (see GoldenImage): capture an install for a fleet of identical machines,
+// or deploy a captured install rather than run pacstrap and pacman
+struct ArchiveData
+{
+  std::string capture;  // if set, a complete install is captured to this directory
+  std::string deploy;   // if set, extracted from this directory
+  bool blocks{};        // capture an ext4 root's used blocks rather than its files (see BlockImage)
+};
+
 struct Summary
 {
   std::size_t package_count{};
@@ -81,6 +180,36 @@ struct Summary
   std::string root_used;
 };
 
+// Validity of each widget's data, by widget name. Pages are created when first shown,
+// so until then a page's entry says whether its defaults are valid.
+struct Validity
+{
+  // not a widget, set by the pages with an EstimateWidget
+  static constexpr const char * Fits = "Fits";
+
+  std::map<std::string, bool, std::less<>> widgets { {"Mounts", false}, {"Accounts", false} };
+
+  void set(const std::string_view name, const bool valid)
+  {
+    if (auto it = widgets.find(name); it != widgets.end())
+      it->second = valid;
+    else
+      widgets.emplace(name, valid);
+  }
+
+  bool all() const
+  {
+    return std::ranges::all_of(widgets, [](const auto& pair){ return pair.second; });
+  }
+
+  // the packages fit on root, true until estimated
+  bool fits() const
+  {
+    const auto it = widgets.find(Fits);
+    return it == widgets.end() || it->second;
+  }
+};
+
 struct WidgetData
 {
   MountData mounts;
@@ -90,7 +219,9 @@ struct WidgetData
   DesktopData desktop;
   netmanagerata network;
   VideoData video;
+  ArchiveData archive;
   Summary summary;
+  Validity valid;
 };
 
 using WidgetDataPtr = std::shared_ptr<WidgetData>;
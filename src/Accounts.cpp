@@ -0,0 +1,411 @@
+#include <charconv>
+#include <chrono>
+#include <crypt.h>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+#include <plog/Log.h>
+#include <wali/Accounts.hpp>
+#include <wali/FileOps.hpp>
+
+
+static const fs::path PasswdPath {"etc/passwd"};
+static const fs::path ShadowPath {"etc/shadow"};
+static const fs::path GroupPath {"etc/group"};
+static const fs::path GShadowPath {"etc/gshadow"};
+static const fs::path LoginDefsPath {"etc/login.defs"};
+static const fs::path ShellsPath {"etc/shells"};
+static const fs::path SkelPath {"etc/skel"};
+
+
+Accounts::Accounts(const fs::path& root) : m_root(root)
+{
+}
+
+
+bool Accounts::load()
+{
+  read_login_defs();
+
+  return  read(m_root / PasswdPath, m_passwd) &&
+          read(m_root / ShadowPath, m_shadow) &&
+          read(m_root / GroupPath, m_group) &&
+          read(m_root / GShadowPath, m_gshadow);
+}
+
+
+bool Accounts::save()
+{
+  // same modes as shadow-utils
+  return  write(m_root / PasswdPath, m_passwd, 0644) &&
+          write(m_root / ShadowPath, m_shadow, 0600) &&
+          write(m_root / GroupPath, m_group, 0644) &&
+          write(m_root / GShadowPath, m_gshadow, 0600);
+}
+
+
+bool Accounts::add_user(const std::string_view user, const std::string_view shell, const std::vector<std::string_view>& groups)
+{
+  if (find(m_passwd, user))
+  {
+    PLOGE << "User already exists: " << user;
+    return false;
+  }
+
+  const auto uid = next_id(m_passwd, 2, m_uid_min, m_uid_max);
+
+  // prefer the same gid as uid, as useradd does
+  const bool gid_free = rng::none_of(m_group, [uid](const Record& r){ return r.size() > 2 && r[2] == std::to_string(uid); });
+  const auto gid = gid_free ? uid : next_id(m_group, 2, m_gid_min, m_gid_max);
+
+  if (uid == 0 || gid == 0)
+  {
+    PLOGE << "No free uid or gid for " << user;
+    return false;
+  }
+
+  const auto home = fs::path{"/home"} / user;
+  const auto days = std::chrono::duration_cast<std::chrono::days>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+  m_passwd.push_back({std::string{user}, "x", std::to_string(uid), std::to_string(gid), "", home.string(), std::string{shell}});
+  m_shadow.push_back({std::string{user}, "!", std::to_string(days), "0", "99999", "7", "", "", ""});
+  m_group.push_back({std::string{user}, "x", std::to_string(gid), ""});
+  m_gshadow.push_back({std::string{user}, "!", "", ""});
+
+  bool added{true};
+  for (const auto group : groups)
+    added &= add_group_member(group, user);
+
+  return added && create_home(m_root / home.relative_path(), uid, gid);
+}
+
+
+bool Accounts::set_password(const std::string_view user, const std::string_view password)
+{
+  Record * record = find(m_shadow, user);
+
+  if (!record || record->size() < 3)
+  {
+    PLOGE << "User not in shadow: " << user;
+    return false;
+  }
+
+  auto hashed = hash(password);
+  if (hashed.empty())
+    return false;
+
+  const auto days = std::chrono::duration_cast<std::chrono::days>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+  (*record)[1] = std::move(hashed);
+  (*record)[2] = std::to_string(days);
+
+  return true;
+}
+
+
+bool Accounts::set_shell(const std::string_view user, const std::string_view shell)
+{
+  Record * record = find(m_passwd, user);
+
+  if (!record || record->size() < 7)
+  {
+    PLOGE << "User not in passwd: " << user;
+    return false;
+  }
+
+  (*record)[6] = shell;
+  return true;
+}
+
+
+bool Accounts::has_user(const std::string_view user)
+{
+  return find(m_passwd, user) != nullptr;
+}
+
+
+bool Accounts::set_group_member(const std::string_view group, const std::string_view user, const bool member)
+{
+  Record * record = find(m_group, group);
+
+  if (!record || record->size() < 4)
+  {
+    PLOGE << "Group not found: " << group;
+    return false;
+  }
+
+  if (is_member(*record, user) == member)
+    return true;
+
+  return member ? add_group_member(group, user) : remove_group_member(group, user);
+}
+
+
+std::vector<std::string> Accounts::lock_users_except(const std::string_view keep)
+{
+  std::vector<std::string> locked;
+
+  for (const auto& record : m_passwd)
+  {
+    unsigned uid{};
+    if (record.size() < 7 || record[0] == keep ||
+        std::from_chars(record[2].data(), record[2].data() + record[2].size(), uid).ec != std::errc{} ||
+        uid < m_uid_min || uid > m_uid_max)
+    {
+      continue;
+    }
+
+    // as usermod --lock --expiredate 1, but the hash is dropped rather than prefixed
+    // with '!', so the golden image's password can't be restored
+    if (Record * shadow = find(m_shadow, record[0]); shadow && shadow->size() >= 8)
+    {
+      (*shadow)[1] = "!";
+      (*shadow)[7] = "1";
+    }
+
+    locked.push_back(record[0]);
+  }
+
+  for (const auto& user : locked)
+    set_shell(user, "/usr/bin/nologin");
+
+  return locked;
+}
+
+
+std::string Accounts::find_shell(const std::string_view name) const
+{
+  std::string found;
+
+  std::ifstream stream{m_root / ShellsPath};
+
+  for (std::string line; std::getline(stream, line); )
+  {
+    const fs::path path{line};
+
+    if (line.starts_with('/') && path.filename() == name && fs::exists(m_root / path.relative_path()))
+    {
+      found = line;
+
+      // /bin is a link to /usr/bin, prefer the canonical path
+      if (line.starts_with("/usr/bin/"))
+        break;
+    }
+  }
+
+  return found;
+}
+
+
+bool Accounts::read(const fs::path& path, Database& db)
+{
+  std::ifstream stream{path};
+
+  if (!stream)
+  {
+    PLOGE << "Failed to open " << path.string();
+    return false;
+  }
+
+  db.clear();
+
+  for (std::string line; std::getline(stream, line); )
+  {
+    if (line.empty())
+      continue;
+
+    Record record;
+    for (const auto field : line | view::split(':'))
+      record.emplace_back(std::string_view{field});
+
+    db.push_back(std::move(record));
+  }
+
+  return true;
+}
+
+
+bool Accounts::write(const fs::path& path, const Database& db, const mode_t mode) const
+{
+  std::string content;
+
+  for (const auto& record : db)
+  {
+    content += flatten(record, ':');
+    content.back() = '\n'; // replace trailing separator
+  }
+
+  return FileOps::write(path, content, mode);
+}
+
+
+void Accounts::read_login_defs()
+{
+  std::ifstream stream{m_root / LoginDefsPath};
+
+  auto parse = [](const std::string_view value, auto& out)
+  {
+    std::from_chars(value.data(), value.data() + value.size(), out);
+  };
+
+  for (std::string line; std::getline(stream, line); )
+  {
+    if (line.empty() || line.starts_with('#'))
+      continue;
+
+    const auto sep = line.find_first_of(" \t");
+    if (sep == std::string::npos)
+      continue;
+
+    const auto value_start = line.find_first_not_of(" \t", sep);
+    if (value_start == std::string::npos)
+      continue;
+
+    const std::string_view key {line.data(), sep};
+    const std::string_view value {std::string_view{line}.substr(value_start)};
+
+    if (key == "UID_MIN")
+      parse(value, m_uid_min);
+    else if (key == "UID_MAX")
+      parse(value, m_uid_max);
+    else if (key == "GID_MIN")
+      parse(value, m_gid_min);
+    else if (key == "GID_MAX")
+      parse(value, m_gid_max);
+    else if (key == "YESCRYPT_COST_FACTOR")
+      parse(value, m_yescrypt_cost);
+  }
+}
+
+
+Accounts::Record * Accounts::find(Database& db, const std::string_view name)
+{
+  const auto it = rng::find_if(db, [name](const Record& r){ return !r.empty() && r[0] == name; });
+  return it == db.end() ? nullptr : &(*it);
+}
+
+
+bool Accounts::add_group_member(const std::string_view group, const std::string_view user)
+{
+  // members are the last field in both group and gshadow
+  for (Database * db : {&m_group, &m_gshadow})
+  {
+    Record * record = find(*db, group);
+
+    if (!record || record->size() < 4)
+    {
+      PLOGE << "Group not found: " << group;
+      return false;
+    }
+
+    auto& members = record->back();
+    members += members.empty() ? "" : ",";
+    members += user;
+  }
+
+  return true;
+}
+
+
+bool Accounts::remove_group_member(const std::string_view group, const std::string_view user)
+{
+  for (Database * db : {&m_group, &m_gshadow})
+  {
+    Record * record = find(*db, group);
+
+    if (!record || record->size() < 4)
+    {
+      PLOGE << "Group not found: " << group;
+      return false;
+    }
+
+    std::vector<std::string> members;
+    for (const auto member : record->back() | view::split(','))
+    {
+      if (std::string_view{member} != user)
+        members.emplace_back(std::string_view{member});
+    }
+
+    record->back() = flatten(members, ',');
+
+    if (!record->back().empty())
+      record->back().pop_back(); // trailing separator
+  }
+
+  return true;
+}
+
+
+bool Accounts::is_member(const Record& record, const std::string_view user)
+{
+  return rng::any_of(record.back() | view::split(','), [user](const auto member){ return std::string_view{member} == user; });
+}
+
+
+unsigned Accounts::next_id(const Database& db, const std::size_t field, const unsigned min, const unsigned max) const
+{
+  unsigned next{min};
+
+  for (const auto& record : db)
+  {
+    unsigned id{};
+    if (record.size() > field && std::from_chars(record[field].data(), record[field].data() + record[field].size(), id).ec == std::errc{})
+    {
+      if (id >= min && id <= max && id >= next)
+        next = id + 1;
+    }
+  }
+
+  return next <= max ? next : 0;
+}
+
+
+std::string Accounts::hash(const std::string_view password) const
+{
+  // as passwd with ENCRYPT_METHOD YESCRYPT, the salt is random from the kernel (rbytes null)
+  char setting[CRYPT_GENSALT_OUTPUT_SIZE];
+
+  if (!crypt_gensalt_rn("$y$", m_yescrypt_cost, nullptr, 0, setting, sizeof(setting)))
+  {
+    PLOGE << "Failed to generate salt: " << strerror(errno);
+    return {};
+  }
+
+  crypt_data data{};
+  const std::string password_str {password};
+
+  // on failure, returns an invalid hash starting with '*'
+  if (const char * hashed = crypt_r(password_str.c_str(), setting, &data); !hashed || hashed[0] == '*')
+  {
+    PLOGE << "Failed to hash password";
+    return {};
+  }
+  else
+    return hashed;
+}
+
+
+bool Accounts::create_home(const fs::path& home, const uid_t uid, const gid_t gid) const
+{
+  std::error_code ec;
+
+  if (fs::create_directories(home, ec); ec)
+  {
+    PLOGE << "Failed to create " << home.string() << ": " << ec.message();
+    return false;
+  }
+
+  if (fs::exists(m_root / SkelPath) && !FileOps::copy_tree(m_root / SkelPath, home))
+    return false;
+
+  bool owned = ::lchown(home.c_str(), uid, gid) == 0;
+
+  for (const auto& entry : fs::recursive_directory_iterator{home, ec})
+    owned &= ::lchown(entry.path().c_str(), uid, gid) == 0;
+
+  fs::permissions(home, fs::perms::owner_all, ec);
+
+  PLOGE_IF(!owned) << "Failed to set owner of " << home.string() << ": " << strerror(errno);
+
+  return owned;
+}
@@ -0,0 +1,327 @@
+#include <Wt/Json/Array.h>
+#include <Wt/Json/Object.h>
+#include <Wt/Json/Parser.h>
+#include <Wt/Json/Serializer.h>
+#include <Wt/Json/Value.h>
+#include <Wt/WString.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <wali/AnswerFile.hpp>
+
+
+using namespace Wt;
+
+static const std::map<std::string_view, HomeMountTarget> HomeTargets
+{
+  {"root",      HomeMountTarget::Root},
+  {"new",       HomeMountTarget::New},
+  {"existing",  HomeMountTarget::Existing}
+};
+
+static const std::map<std::string_view, Bootloader> Bootloaders
+{
+  {"systemd-boot",  Bootloader::SystemdBoot},
+  {"grub",          Bootloader::Grub}
+};
+
+static const std::map<std::string_view, RaidLevel> RaidLevels
+{
+  {"none",    RaidLevel::None},
+  {"raid0",   RaidLevel::Raid0},
+  {"raid1",   RaidLevel::Raid1},
+  {"raid10",  RaidLevel::Raid10}
+};
+
+
+// reading: Json::Value conversions throw Json::TypeException if the type is wrong,
+// which parse() catches, so these only check for absent keys
+
+static const Json::Object& get_object(const Json::Object& obj, const std::string& key)
+{
+  static const Json::Object Empty;
+
+  const auto& value = obj.get(key);
+  return value.isNull() ? Empty : static_cast<const Json::Object&>(value);
+}
+
+template<typename T>
+static void get(const Json::Object& obj, const std::string& key, T& value)
+{
+  if (const auto& v = obj.get(key); !v.isNull())
+    value = static_cast<T>(v);
+}
+
+static void get(const Json::Object& obj, const std::string& key, std::string& value)
+{
+  if (const auto& v = obj.get(key); !v.isNull())
+    value = static_cast<std::string>(v);
+}
+
+template<typename C>
+static void get_list(const Json::Object& obj, const std::string& key, C& values)
+{
+  if (const auto& v = obj.get(key); !v.isNull())
+  {
+    values.clear();
+    for (const auto& item : static_cast<const Json::Array&>(v))
+      values.insert(values.end(), static_cast<std::string>(item));
+  }
+}
+
+template<typename E>
+static bool get_enum(const Json::Object& obj, const std::string& key, const std::map<std::string_view, E>& names, E& value)
+{
+  std::string name;
+  get(obj, key, name);
+
+  if (name.empty())
+    return true;
+  else if (const auto it = names.find(name); it != names.end())
+  {
+    value = it->second;
+    return true;
+  }
+
+  PLOGE << "Answer file: invalid value for " << key << ": " << name;
+  return false;
+}
+
+static bool get_stripe(const Json::Object& obj, const std::string& key, StripeData& stripe)
+{
+  const auto& stripe_obj = get_object(obj, key);
+  get_list(stripe_obj, "devs", stripe.devs);
+  return get_enum(stripe_obj, "level", RaidLevels, stripe.level);
+}
+
+
+// writing
+
+template<typename E>
+static std::string enum_name(const std::map<std::string_view, E>& names, const E value)
+{
+  const auto it = std::find_if(names.cbegin(), names.cend(), [value](const auto& pair){ return pair.second == value; });
+  return it == names.cend() ? "" : std::string{it->first};
+}
+
+static Json::Value str(const std::string& s)
+{
+  return Json::Value{WString::fromUTF8(s)};
+}
+
+template<typename C>
+static Json::Value list(const C& values)
+{
+  Json::Array array;
+  for (const auto& value : values)
+    array.push_back(str(value));
+  return Json::Value{std::move(array)};
+}
+
+static Json::Value stripe(const StripeData& stripe)
+{
+  Json::Object obj;
+  obj["level"] = str(enum_name(RaidLevels, stripe.level));
+  obj["devs"] = list(stripe.devs);
+  return Json::Value{std::move(obj)};
+}
+
+
+bool AnswerFile::read(const fs::path& path, WidgetData& data)
+{
+  std::ifstream file {path};
+
+  if (!file)
+  {
+    PLOGE << "Answer file: failed to open " << path;
+    return false;
+  }
+
+  std::stringstream json;
+  json << file.rdbuf();
+  return parse(json.str(), data);
+}
+
+
+bool AnswerFile::parse(const std::string& json, WidgetData& data)
+{
+  Json::Object root;
+
+  if (Json::ParseError error; !Json::parse(json, root, error))
+  {
+    PLOGE << "Answer file: " << error.what();
+    return false;
+  }
+
+  try
+  {
+    bool valid{true};
+
+    const auto& mounts = get_object(root, "mounts");
+    get(mounts, "boot_dev", data.mounts.boot_dev);
+    get(mounts, "boot_fs", data.mounts.boot_fs);
+    get(mounts, "root_dev", data.mounts.root_dev);
+    get(mounts, "root_fs", data.mounts.root_fs);
+    get(mounts, "home_dev", data.mounts.home_dev);
+    get(mounts, "home_fs", data.mounts.home_fs);
+    get(mounts, "zram", data.mounts.zram);
+    valid &= get_enum(mounts, "home_target", HomeTargets, data.mounts.home_target);
+    valid &= get_enum(mounts, "boot_loader", Bootloaders, data.mounts.boot_loader);
+    valid &= get_stripe(mounts, "root_stripe", data.mounts.root_stripe);
+    valid &= get_stripe(mounts, "home_stripe", data.mounts.home_stripe);
+
+    // as MountsWidget::set_data()
+    if (data.mounts.home_target == HomeMountTarget::Root)
+    {
+      data.mounts.home_dev = data.mounts.root_dev;
+      data.mounts.home_fs = data.mounts.root_fs;
+    }
+
+    const auto& luks = get_object(mounts, "luks");
+    get(luks, "root", data.mounts.luks.root);
+    get(luks, "home", data.mounts.luks.home);
+    get(luks, "passphrase", data.mounts.luks.passphrase);
+
+    // devices are the image's partitions, so boot_dev and root_dev are ignored
+    const auto& image = get_object(mounts, "image");
+    get(image, "path", data.mounts.image.path);
+    get(image, "compact", data.mounts.image.compact);
+
+    int size_gib{};
+    get(image, "size_gib", size_gib);
+    data.mounts.image.size = gb_to_b(size_gib);
+
+    const auto& btrfs = get_object(mounts, "btrfs");
+    get(btrfs, "compress_level", data.mounts.btrfs.compress_level);
+    get_list(btrfs, "nodatacow", data.mounts.btrfs.nodatacow);
+
+    if (const auto& subvols = btrfs.get("subvolumes"); !subvols.isNull())
+    {
+      data.mounts.btrfs.subvolumes.clear();
+
+      for (const Json::Object& subvol : static_cast<const Json::Array&>(subvols))
+        data.mounts.btrfs.subvolumes.emplace_back(static_cast<std::string>(subvol.get("name")), static_cast<std::string>(subvol.get("path")));
+    }
+
+    const auto& accounts = get_object(root, "accounts");
+    get(accounts, "root_pass", data.accounts.root_pass);
+    get(accounts, "user_username", data.accounts.user_username);
+    get(accounts, "user_pass", data.accounts.user_pass);
+    get(accounts, "user_shell", data.accounts.user_shell);
+    get(accounts, "user_sudo", data.accounts.user_sudo);
+
+    const auto& localise = get_object(root, "localise");
+    get(localise, "timezone", data.localise.timezone);
+    get(localise, "locale", data.localise.locale);
+    get(localise, "keymap", data.localise.keymap);
+
+    const auto& network = get_object(root, "network");
+    get(network, "hostname", data.network.hostname);
+    get(network, "ntp", data.network.ntp);
+    get(network, "copy_config", data.network.copy_config);
+
+    const auto& desktop = get_object(root, "desktop");
+    get_list(desktop, "packages", data.desktop.desktop);
+    get_list(desktop, "dm", data.desktop.dm);
+    get_list(desktop, "services", data.desktop.services);
+    get(desktop, "iwd", data.desktop.iwd);
+    get(desktop, "netmanager", data.desktop.netmanager);
+
+    get_list(get_object(root, "video"), "drivers", data.video.drivers);
+    get_list(get_object(root, "packages"), "additional", data.packages.additional);
+
+    const auto& archive = get_object(root, "archive");
+    get(archive, "capture", data.archive.capture);
+    get(archive, "deploy", data.archive.deploy);
+    get(archive, "blocks", data.archive.blocks);
+
+    return valid;
+  }
+  catch (const std::exception& ex)
+  {
+    PLOGE << "Answer file: value has the wrong type: " << ex.what();
+    return false;
+  }
+}
+
+
+std::string AnswerFile::write(const WidgetData& data)
+{
+  Json::Object mounts, luks, image, btrfs, accounts, localise, network, desktop, video, packages, archive;
+
+  mounts["boot_dev"] = str(data.mounts.boot_dev);
+  mounts["boot_fs"] = str(data.mounts.boot_fs);
+  mounts["root_dev"] = str(data.mounts.root_dev);
+  mounts["root_fs"] = str(data.mounts.root_fs);
+  mounts["home_dev"] = str(data.mounts.home_dev);
+  mounts["home_fs"] = str(data.mounts.home_fs);
+  mounts["home_target"] = str(enum_name(HomeTargets, data.mounts.home_target));
+  mounts["boot_loader"] = str(enum_name(Bootloaders, data.mounts.boot_loader));
+  mounts["zram"] = Json::Value{data.mounts.zram};
+  mounts["root_stripe"] = stripe(data.mounts.root_stripe);
+  mounts["home_stripe"] = stripe(data.mounts.home_stripe);
+
+  luks["root"] = Json::Value{data.mounts.luks.root};
+  luks["home"] = Json::Value{data.mounts.luks.home};
+  luks["passphrase"] = str(data.mounts.luks.passphrase);
+  mounts["luks"] = Json::Value{std::move(luks)};
+
+  image["path"] = str(data.mounts.image.path);
+  image["size_gib"] = Json::Value{static_cast<int>(b_to_gb(data.mounts.image.size))};
+  image["compact"] = Json::Value{data.mounts.image.compact};
+  mounts["image"] = Json::Value{std::move(image)};
+
+  Json::Array subvols;
+  for (const auto& subvol : data.mounts.btrfs.subvolumes)
+  {
+    Json::Object obj;
+    obj["name"] = str(subvol.name);
+    obj["path"] = str(subvol.path);
+    subvols.push_back(Json::Value{std::move(obj)});
+  }
+
+  btrfs["subvolumes"] = Json::Value{std::move(subvols)};
+  btrfs["nodatacow"] = list(data.mounts.btrfs.nodatacow);
+  btrfs["compress_level"] = Json::Value{data.mounts.btrfs.compress_level};
+  mounts["btrfs"] = Json::Value{std::move(btrfs)};
+
+  accounts["root_pass"] = str(data.accounts.root_pass);
+  accounts["user_username"] = str(data.accounts.user_username);
+  accounts["user_pass"] = str(data.accounts.user_pass);
+  accounts["user_shell"] = str(data.accounts.user_shell);
+  accounts["user_sudo"] = Json::Value{data.accounts.user_sudo};
+
+  localise["timezone"] = str(data.localise.timezone);
+  localise["locale"] = str(data.localise.locale);
+  localise["keymap"] = str(data.localise.keymap);
+
+  network["hostname"] = str(data.network.hostname);
+  network["ntp"] = Json::Value{data.network.ntp};
+  network["copy_config"] = Json::Value{data.network.copy_config};
+
+  desktop["packages"] = list(data.desktop.desktop);
+  desktop["dm"] = list(data.desktop.dm);
+  desktop["services"] = list(data.desktop.services);
+  desktop["iwd"] = Json::Value{data.desktop.iwd};
+  desktop["netmanager"] = Json::Value{data.desktop.netmanager};
+
+  video["drivers"] = list(data.video.drivers);
+  packages["additional"] = list(data.packages.additional);
+
+  archive["capture"] = str(data.archive.capture);
+  archive["deploy"] = str(data.archive.deploy);
+  archive["blocks"] = Json::Value{data.archive.blocks};
+
+  Json::Object root;
+  root["mounts"] = Json::Value{std::move(mounts)};
+  root["accounts"] = Json::Value{std::move(accounts)};
+  root["localise"] = Json::Value{std::move(localise)};
+  root["network"] = Json::Value{std::move(network)};
+  root["desktop"] = Json::Value{std::move(desktop)};
+  root["video"] = Json::Value{std::move(video)};
+  root["packages"] = Json::Value{std::move(packages)};
+  root["archive"] = Json::Value{std::move(archive)};
+
+  return Json::serialize(root, 2);
+}
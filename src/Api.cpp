@@ -0,0 +1,507 @@
+#include <Wt/Http/Request.h>
+#include <Wt/Http/Response.h>
+#include <Wt/Http/ResponseContinuation.h>
+#include <Wt/Json/Array.h>
+#include <Wt/Json/Object.h>
+#include <Wt/Json/Serializer.h>
+#include <Wt/WResource.h>
+#include <cstdlib>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <wali/AnswerFile.hpp>
+#include <wali/Api.hpp>
+#include <wali/DiskUtils.hpp>
+#include <wali/Install.hpp>
+#include <wali/SystemFacts.hpp>
+#include <wali/Validation.hpp>
+
+
+using namespace Wt;
+
+static constexpr std::size_t MaxConfigSize = 64 * 1024;
+
+
+static std::string_view state_name(const InstallState state)
+{
+  switch (state)
+  {
+    case InstallState::Fail:      return "fail";
+    case InstallState::Cancelled: return "cancelled";
+    case InstallState::Running:   return "running";
+    case InstallState::Bootable:  return "bootable";
+    case InstallState::Partial:   return "partial";
+    case InstallState::Complete:  return "complete";
+    default:                      return "none";
+  }
+}
+
+static std::string_view gpu_name(const GpuVendor gpu)
+{
+  switch (gpu)
+  {
+    case GpuVendor::Amd:    return "amd";
+    case GpuVendor::Nvidia: return "nvidia";
+    case GpuVendor::Vm:     return "vm";
+    case GpuVendor::Intel:  return "intel";
+    default:                return "unknown";
+  }
+}
+
+static std::string_view cpu_name(const CpuVendor cpu)
+{
+  switch (cpu)
+  {
+    case CpuVendor::Amd:    return "amd";
+    case CpuVendor::Intel:  return "intel";
+    default:                return "none";
+  }
+}
+
+static std::string_view status_name(const StageStatus status)
+{
+  switch (status)
+  {
+    case StageStatus::Start:    return "start";
+    case StageStatus::Complete: return "complete";
+    default:                    return "fail";
+  }
+}
+
+static std::string_view level_name(const InstallLogLevel level)
+{
+  switch (level)
+  {
+    case InstallLogLevel::Warning:  return "warning";
+    case InstallLogLevel::Error:    return "error";
+    default:                        return "info";
+  }
+}
+
+static std::string_view level_name(const ValidationMessage::Level level)
+{
+  switch (level)
+  {
+    case ValidationMessage::Level::Warning: return "warning";
+    case ValidationMessage::Level::Error:   return "error";
+    default:                                return "info";
+  }
+}
+
+
+// JSON string, with quotes. Events are built with this rather than Json::serialize()
+// because each must be one line.
+static std::string quote(const std::string_view s)
+{
+  std::string out;
+  out.reserve(s.size() + 2);
+  out += '"';
+
+  for (const unsigned char c : s)
+  {
+    switch (c)
+    {
+      case '"':   out += "\\\""; break;
+      case '\\':  out += "\\\\"; break;
+      case '\n':  out += "\\n"; break;
+      case '\r':  out += "\\r"; break;
+      case '\t':  out += "\\t"; break;
+      default:
+        if (c < 0x20)
+          out += std::format("\\u{:04x}", c);
+        else
+          out += static_cast<char>(c);
+      break;
+    }
+  }
+
+  out += '"';
+  return out;
+}
+
+
+static void reply(Http::Response& response, const int status, const std::string_view json)
+{
+  response.setStatus(status);
+  response.setMimeType("application/json");
+  response.out() << json;
+}
+
+static void reply_error(Http::Response& response, const int status, const std::string_view msg)
+{
+  reply(response, status, std::format(R"({{"error":{}}})", quote(msg)));
+}
+
+
+class EventsResource;
+
+// the API's configuration and install, shared by all requests
+static std::mutex api_mutex;
+static WidgetDataPtr config;              // null until a valid configuration is PUT
+static Install install;
+static std::future<void> install_future;
+static bool running{};
+static InstallState state{InstallState::None};
+static std::string stage;
+static std::vector<std::string> events;   // one JSON object per event, for the current install
+static std::shared_ptr<EventsResource> events_resource;
+
+
+static void add_event(std::string event);
+
+
+class EventsResource : public WResource
+{
+  struct Cursor
+  {
+    std::size_t next{};
+    bool sse{};
+    bool stream{true};
+  };
+
+public:
+  ~EventsResource()
+  {
+    beingDeleted();
+  }
+
+  void handleRequest(const Http::Request& request, Http::Response& response) override
+  {
+    Cursor cursor;
+
+    if (const auto continuation = request.continuation(); continuation)
+      cursor = cpp17::any_cast<Cursor>(continuation->data());
+    else
+    {
+      cursor.sse = request.headerValue("Accept").find("text/event-stream") != std::string::npos;
+
+      if (const auto stream = request.getParameter("stream"); stream)
+        cursor.stream = *stream != "0";
+
+      if (const auto since = request.getParameter("since"); since)
+        cursor.next = std::strtoull(since->c_str(), nullptr, 10);
+
+      response.setMimeType(cursor.sse ? "text/event-stream" : "application/x-ndjson");
+      response.addHeader("Cache-Control", "no-cache");
+    }
+
+    std::vector<std::string> pending;
+    bool is_running{};
+    {
+      std::scoped_lock lock{api_mutex};
+
+      if (cursor.next < events.size())
+        pending.assign(std::next(events.cbegin(), cursor.next), events.cend());
+
+      is_running = running;
+    }
+
+    for (const auto& event : pending)
+    {
+      if (cursor.sse)
+        response.out() << "id: " << cursor.next << "\ndata: " << event << "\n\n";
+      else
+        response.out() << event << '\n';
+
+      ++cursor.next;
+    }
+
+    // resumed by haveMoreData() in add_event() and when the install ends
+    if (cursor.stream && is_running)
+    {
+      auto continuation = response.createContinuation();
+      continuation->setData(cursor);
+      continuation->waitForMoreData();
+
+      // an event or the end between reading the events and waiting was signalled before
+      // the continuation existed, so resume now rather than wait forever
+      bool missed{};
+      {
+        std::scoped_lock lock{api_mutex};
+        missed = !running || cursor.next < events.size();
+      }
+
+      if (missed)
+        continuation->haveMoreData();
+    }
+  }
+};
+
+
+class FactsResource : public WResource
+{
+public:
+  ~FactsResource()
+  {
+    beingDeleted();
+  }
+
+  void handleRequest(const Http::Request&, Http::Response& response) override
+  {
+    // don't wait for the facts, the client can poll
+    if (!SystemFacts::is_ready())
+      reply(response, 503, R"({"ready":false})");
+    else
+      reply(response, 200, to_json(SystemFacts::get()));
+  }
+
+private:
+  // a snapshot never changes, so is serialised once
+  std::string to_json(const FactsPtr& facts)
+  {
+    std::scoped_lock lock{m_mutex};
+
+    if (facts == m_facts)
+      return m_json;
+
+    Json::Array disks;
+
+    for (const auto& [disk, parts] : facts->tree)
+    {
+      Json::Array partitions;
+
+      for (const auto& part : parts)
+      {
+        Json::Object p;
+        p["dev"] = Json::Value{WString::fromUTF8(part.dev)};
+        p["fs"] = Json::Value{WString::fromUTF8(part.fs_type)};
+        p["part_uuid"] = Json::Value{WString::fromUTF8(part.part_uuid)};
+        p["size"] = Json::Value{static_cast<long long>(part.size)};
+        p["number"] = Json::Value{part.part_number};
+        p["efi"] = Json::Value{part.is_efi};
+        p["mounted"] = Json::Value{part.is_mounted};
+        partitions.push_back(Json::Value{std::move(p)});
+      }
+
+      Json::Object d;
+      d["dev"] = Json::Value{WString::fromUTF8(disk.dev)};
+      d["size"] = Json::Value{static_cast<long long>(disk.size)};
+      d["gpt"] = Json::Value{disk.is_gpt};
+      d["class"] = Json::Value{WString::fromUTF8(std::string{DiskUtils::get_device_class_name(disk.device_class)})};
+      d["rotational"] = Json::Value{disk.is_rotational};
+      d["discard"] = Json::Value{disk.is_discard};
+      d["partitions"] = Json::Value{std::move(partitions)};
+      disks.push_back(Json::Value{std::move(d)});
+    }
+
+    Json::Object root;
+    root["ready"] = Json::Value{true};
+    root["startup_error"] = Json::Value{WString::fromUTF8(facts->startup_error)};
+    root["cpu"] = Json::Value{WString::fromUTF8(std::string{cpu_name(facts->cpu)})};
+    root["gpu"] = Json::Value{WString::fromUTF8(std::string{gpu_name(facts->gpu)})};
+    root["packages"] = Json::Value{static_cast<long long>(facts->packages->size())};
+    root["disks"] = Json::Value{std::move(disks)};
+
+    m_facts = facts;
+    m_json = Json::serialize(root, 0);
+    return m_json;
+  }
+
+private:
+  std::mutex m_mutex;
+  FactsPtr m_facts;
+  std::string m_json;
+};
+
+
+class ConfigResource : public WResource
+{
+public:
+  ~ConfigResource()
+  {
+    beingDeleted();
+  }
+
+  void handleRequest(const Http::Request& request, Http::Response& response) override
+  {
+    if (request.method() == "GET")
+      get(response);
+    else if (request.method() == "PUT")
+      put(request, response);
+    else
+      reply_error(response, 405, "GET or PUT");
+  }
+
+private:
+  void get(Http::Response& response)
+  {
+    std::scoped_lock lock{api_mutex};
+
+    if (config)
+      reply(response, 200, AnswerFile::write(*config));
+    else
+      reply_error(response, 404, "Configuration not set");
+  }
+
+  void put(const Http::Request& request, Http::Response& response)
+  {
+    if (request.contentLength() > static_cast<std::int64_t>(MaxConfigSize))
+    {
+      reply_error(response, 413, "Configuration too large");
+      return;
+    }
+    else if (!SystemFacts::is_ready())
+    {
+      reply_error(response, 503, "Reading system information");
+      return;
+    }
+
+    const std::string body {std::istreambuf_iterator<char>{request.in()}, std::istreambuf_iterator<char>{}};
+
+    auto data = std::make_shared<WidgetData>();
+
+    if (!AnswerFile::parse(body, *data))
+    {
+      reply_error(response, 400, "Invalid answer file");
+      return;
+    }
+
+    ValidationMessages messages;
+    const auto valid = Validation::all(*data, *SystemFacts::get(), messages);
+
+    std::string messages_json;
+    for (const auto& msg : messages)
+      messages_json += std::format(R"({}{{"level":"{}","text":{}}})", messages_json.empty() ? "" : ",", level_name(msg.level), quote(msg.text));
+
+    std::scoped_lock lock{api_mutex};
+
+    if (running)
+      reply_error(response, 409, "Install is running");
+    else
+    {
+      if (valid)
+        config = std::move(data);
+
+      reply(response, valid ? 200 : 422, std::format(R"({{"valid":{},"messages":[{}]}})", valid, messages_json));
+    }
+  }
+};
+
+
+class InstallResource : public WResource
+{
+public:
+  ~InstallResource()
+  {
+    beingDeleted();
+  }
+
+  void handleRequest(const Http::Request& request, Http::Response& response) override
+  {
+    std::scoped_lock lock{api_mutex};
+
+    if (request.method() == "GET")
+      reply(response, 200, status());
+    else if (request.method() == "POST")
+      start(response);
+    else if (request.method() == "DELETE")
+      cancel(response);
+    else
+      reply_error(response, 405, "GET, POST or DELETE");
+  }
+
+private:
+  // caller must hold api_mutex
+  static std::string status()
+  {
+    return std::format(R"({{"state":"{}","stage":{},"running":{},"events":{}}})", state_name(state), quote(stage), running, events.size());
+  }
+
+  // caller must hold api_mutex
+  static void start(Http::Response& response)
+  {
+    if (running)
+    {
+      reply_error(response, 409, "Install is running");
+      return;
+    }
+    else if (!config)
+    {
+      reply_error(response, 409, "Configuration not set");
+      return;
+    }
+
+    running = true;
+    state = InstallState::None;
+    stage.clear();
+    events.clear();
+
+    auto stage_change = [](const std::string name, const StageStatus status)
+    {
+      if (status == StageStatus::Start)
+      {
+        std::scoped_lock lock{api_mutex};
+        stage = name;
+      }
+
+      add_event(std::format(R"({{"type":"stage","name":{},"status":"{}"}})", quote(name), status_name(status)));
+    };
+
+    auto log = [](const std::string msg, const InstallLogLevel level)
+    {
+      add_event(std::format(R"({{"type":"log","level":"{}","msg":{}}})", level_name(level), quote(msg)));
+    };
+
+    auto complete = [](const InstallState s)
+    {
+      {
+        std::scoped_lock lock{api_mutex};
+        state = s;
+      }
+
+      add_event(std::format(R"({{"type":"state","state":"{}"}})", state_name(s)));
+    };
+
+    // a copy, so the configuration can be replaced once this install ends
+    install_future = std::async(std::launch::async, [=, data = std::make_shared<WidgetData>(*config)]
+    {
+      install.install({.stage_change = stage_change, .log = log, .complete = complete}, data);
+
+      {
+        std::scoped_lock lock{api_mutex};
+        running = false;
+      }
+
+      // streams end when the install isn't running
+      events_resource->haveMoreData();
+    });
+
+    reply(response, 202, status());
+  }
+
+  // caller must hold api_mutex
+  static void cancel(Http::Response& response)
+  {
+    if (!running)
+      reply_error(response, 409, "Install is not running");
+    else
+    {
+      install.stop();
+      reply(response, 202, status());
+    }
+  }
+};
+
+
+static void add_event(std::string event)
+{
+  {
+    std::scoped_lock lock{api_mutex};
+    events.push_back(std::move(event));
+  }
+
+  events_resource->haveMoreData();
+}
+
+
+void Api::add_resources(WServer& server)
+{
+  events_resource = std::make_shared<EventsResource>();
+
+  server.addResource(std::make_shared<FactsResource>(), "/api/facts");
+  server.addResource(std::make_shared<ConfigResource>(), "/api/config");
+  server.addResource(std::make_shared<InstallResource>(), "/api/install");
+  server.addResource(events_resource, "/api/events");
+
+  PLOGI << "API enabled at /api";
+}
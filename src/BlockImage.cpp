@@ -0,0 +1,720 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <plog/Log.h>
+#include <wali/BlockImage.hpp>
+#include <wali/FileDescriptor.hpp>
+
+
+static_assert(std::endian::native == std::endian::little, "ext4 and the image records are little endian");
+
+// O_DIRECT requires offsets, lengths and buffers aligned to the device's logical block size
+static const int64_t Align = 4096;
+// the most in one record, which is the size of each buffer
+static const int64_t ChunkSize = 4 * 1024 * 1024;
+static const unsigned MaxStreams = 8;
+
+
+struct Extent
+{
+  int64_t offset;
+  int64_t length;
+};
+
+using Extents = std::vector<Extent>;
+
+// precedes a record's blocks in a stream, a zero length ends the stream
+struct BlockRecord
+{
+  uint64_t offset;
+  uint32_t length;
+  uint32_t crc;
+};
+
+static_assert(sizeof(BlockRecord) == 16);
+
+using AlignedBuffer = std::unique_ptr<char, decltype(&std::free)>;
+
+
+static AlignedBuffer make_buffer(const int64_t size)
+{
+  return AlignedBuffer{static_cast<char *>(std::aligned_alloc(Align, std::max(size, Align))), &std::free};
+}
+
+
+static uint32_t crc32c(const char * data, const std::size_t size)
+{
+  static const auto Table = []
+  {
+    std::array<uint32_t, 256> table{};
+
+    for (uint32_t i = 0 ; i < table.size() ; ++i)
+    {
+      uint32_t crc = i;
+      for (int bit = 0 ; bit < 8 ; ++bit)
+        crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78 : 0);
+
+      table[i] = crc;
+    }
+
+    return table;
+  }();
+
+  uint32_t crc = ~0U;
+  for (std::size_t i = 0 ; i < size ; ++i)
+    crc = Table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+
+  return ~crc;
+}
+
+
+static bool read_at(const int fd, char * buff, const int64_t size, const int64_t offset)
+{
+  for (int64_t done = 0 ; done < size ; )
+  {
+    const auto n = ::pread(fd, buff + done, size - done, offset + done);
+
+    if (n <= 0)
+    {
+      PLOGE << "Failed to read at " << offset + done << ": " << (n == 0 ? "end of device" : strerror(errno));
+      return false;
+    }
+
+    done += n;
+  }
+
+  return true;
+}
+
+
+// O_DIRECT reads are aligned, but with blocks smaller than Align the metadata isn't,
+// so the aligned window around it is read. buff is at least window_size(size), and
+// returns where the data starts in it.
+static int64_t window_size(const int64_t size)
+{
+  return (size + Align - 1) / Align * Align + Align;
+}
+
+
+static const char * read_window(const int fd, char * buff, const int64_t size, const int64_t offset)
+{
+  const int64_t start = offset / Align * Align;
+  const int64_t end = (offset + size + Align - 1) / Align * Align;
+
+  return read_at(fd, buff, end - start, start) ? buff + (offset - start) : nullptr;
+}
+
+
+static bool write_at(const int fd, const char * buff, const int64_t size, const int64_t offset)
+{
+  for (int64_t done = 0 ; done < size ; )
+  {
+    const auto n = ::pwrite(fd, buff + done, size - done, offset + done);
+
+    if (n <= 0)
+    {
+      PLOGE << "Failed to write at " << offset + done << ": " << (n == 0 ? "end of device" : strerror(errno));
+      return false;
+    }
+
+    done += n;
+  }
+
+  return true;
+}
+
+
+template<typename T>
+static T get(const char * buff, const std::size_t offset)
+{
+  T value;
+  std::memcpy(&value, buff + offset, sizeof(T));
+  return value;
+}
+
+
+// Sorted, aligned for O_DIRECT and merged. Rounding includes some unused blocks, which is harmless.
+static Extents align_extents(Extents blocks, const int64_t block_size, const int64_t end)
+{
+  rng::sort(blocks, std::less{}, &Extent::offset);
+
+  Extents extents;
+
+  for (const auto& [block, count] : blocks)
+  {
+    const int64_t start = block * block_size / Align * Align;
+    const int64_t stop = std::min((block + count) * block_size + Align - 1, end) / Align * Align;
+
+    if (!extents.empty() && start <= extents.back().offset + extents.back().length)
+      extents.back().length = std::max(extents.back().length, stop - extents.back().offset);
+    else if (stop > start)
+      extents.push_back({start, stop - start});
+  }
+
+  return extents;
+}
+
+
+// Used blocks from the block bitmaps. A group with BLOCK_UNINIT has no bitmap: its only
+// used blocks are a superblock backup, and any group's bitmaps and inode table (flex_bg
+// places these in another group), which are added for every group.
+static std::optional<Extents> ext4_used(const int fd, int64_t& fs_size)
+{
+  static const uint16_t Magic = 0xEF53;
+  static const uint32_t IncompatRecover = 0x4, IncompatMetaBg = 0x10, Incompat64Bit = 0x80;
+  static const uint32_t RoCompatSparseSuper = 0x1, RoCompatBigAlloc = 0x200;
+  static const uint16_t BlockUninit = 0x2;
+
+  // the superblock is at 1024, but O_DIRECT reads are aligned
+  const auto sb_buff = make_buffer(Align);
+  if (!sb_buff || !read_at(fd, sb_buff.get(), Align, 0))
+    return {};
+
+  const char * sb = sb_buff.get() + 1024;
+
+  const auto incompat = get<uint32_t>(sb, 0x60);
+  const auto ro_compat = get<uint32_t>(sb, 0x64);
+
+  if (get<uint16_t>(sb, 0x38) != Magic)
+  {
+    PLOGE << "Not an ext4 filesystem";
+    return {};
+  }
+  else if (incompat & IncompatRecover)
+  {
+    // if mounted, it wasn't frozen
+    PLOGE << "ext4 journal requires recovery";
+    return {};
+  }
+  else if (incompat & IncompatMetaBg || ro_compat & RoCompatBigAlloc)
+  {
+    PLOGE << "ext4 with meta_bg or bigalloc is not supported";
+    return {};
+  }
+
+  const bool is_64bit = incompat & Incompat64Bit;
+
+  const int64_t block_size = int64_t{1024} << get<uint32_t>(sb, 0x18);
+  const int64_t blocks = int64_t{get<uint32_t>(sb, 0x04)} | (is_64bit ? int64_t{get<uint32_t>(sb, 0x150)} << 32 : 0);
+  const int64_t first_data = get<uint32_t>(sb, 0x14);
+  const int64_t per_group = get<uint32_t>(sb, 0x20);
+  const int64_t inodes_per_group = get<uint32_t>(sb, 0x28);
+  const int64_t inode_size = get<uint16_t>(sb, 0x58);
+  const int64_t reserved_gdt = get<uint16_t>(sb, 0xCE);
+  const int64_t desc_size = is_64bit ? get<uint16_t>(sb, 0xFE) : 32;
+
+  if (block_size > 65536 || per_group == 0 || desc_size < 32)
+  {
+    PLOGE << "ext4 superblock is invalid";
+    return {};
+  }
+
+  const int64_t groups = (blocks - first_data + per_group - 1) / per_group;
+  const int64_t gdt_blocks = (groups * desc_size + block_size - 1) / block_size;
+  const int64_t inode_table_blocks = (inodes_per_group * inode_size + block_size - 1) / block_size;
+
+  // descriptors follow the superblock's block
+  // with 1K blocks, at 2048
+  const auto gdt_buff = make_buffer(window_size(gdt_blocks * block_size));
+  const char * gdt = gdt_buff ? read_window(fd, gdt_buff.get(), gdt_blocks * block_size, (first_data + 1) * block_size) : nullptr;
+  if (!gdt)
+    return {};
+
+  auto descriptor = [&](const int64_t group, const std::size_t lo, const std::size_t hi)
+  {
+    const char * desc = gdt + group * desc_size;
+    return int64_t{get<uint32_t>(desc, lo)} | (desc_size >= 64 ? int64_t{get<uint32_t>(desc, hi)} << 32 : 0);
+  };
+
+  // with sparse_super, backups are in groups 0, 1 and powers of 3, 5 and 7
+  auto has_super = [&](const int64_t group)
+  {
+    if (group <= 1 || !(ro_compat & RoCompatSparseSuper))
+      return true;
+
+    for (const int64_t base : {3, 5, 7})
+    {
+      int64_t n = group;
+      while (n % base == 0)
+        n /= base;
+
+      if (n == 1)
+        return true;
+    }
+    return false;
+  };
+
+  Extents used; // in blocks until aligned
+
+  auto add = [&used](const int64_t block, const int64_t count)
+  {
+    if (count > 0)
+      used.push_back({block, count});
+  };
+
+  const auto bitmap_buff = make_buffer(window_size(block_size));
+  if (!bitmap_buff)
+    return {};
+
+  for (int64_t group = 0 ; group < groups ; ++group)
+  {
+    const int64_t start = first_data + group * per_group;
+    const int64_t count = std::min(per_group, blocks - start);
+    const int64_t block_bitmap = descriptor(group, 0x00, 0x20);
+
+    if (has_super(group))
+      add(start, 1 + gdt_blocks + reserved_gdt);
+
+    add(block_bitmap, 1);
+    add(descriptor(group, 0x04, 0x24), 1);
+    add(descriptor(group, 0x08, 0x28), inode_table_blocks);
+
+    if (get<uint16_t>(gdt + group * desc_size, 0x12) & BlockUninit)
+      continue;
+
+    const auto bitmap = reinterpret_cast<const uint8_t *>(read_window(fd, bitmap_buff.get(), block_size, block_bitmap * block_size));
+    if (!bitmap)
+      return {};
+
+    // runs of set bits, skipping empty bytes
+    for (int64_t bit = 0 ; bit < count ; )
+    {
+      if (bit % 8 == 0 && bitmap[bit / 8] == 0)
+        bit += 8;
+      else if (!(bitmap[bit / 8] >> (bit % 8) & 1))
+        ++bit;
+      else
+      {
+        const int64_t run = bit;
+
+        while (bit < count && (bitmap[bit / 8] >> (bit % 8) & 1))
+          ++bit;
+
+        add(start + run, bit - run);
+      }
+    }
+  }
+
+  // boot block and primary superblock
+  add(0, first_data + 1);
+
+  fs_size = (blocks * block_size + Align - 1) / Align * Align;
+  return align_extents(std::move(used), block_size, fs_size);
+}
+
+
+// Contiguous regions of about the same size, split into records
+static std::vector<Extents> plan_streams(const Extents& used, const unsigned n_streams)
+{
+  int64_t total{};
+  for (const auto& extent : used)
+    total += extent.length;
+
+  std::vector<Extents> streams(n_streams);
+  int64_t done{};
+
+  for (const auto& [offset, length] : used)
+  {
+    for (int64_t pos = 0 ; pos < length ; pos += ChunkSize)
+    {
+      const auto size = std::min(ChunkSize, length - pos);
+      const auto stream = std::min<int64_t>(done * n_streams / std::max<int64_t>(total, 1), n_streams - 1);
+
+      streams[stream].push_back({offset + pos, size});
+      done += size;
+    }
+  }
+
+  std::erase_if(streams, [](const Extents& stream){ return stream.empty(); });
+  return streams;
+}
+
+
+static std::string stream_name(const std::size_t n)
+{
+  return std::format("{}.zst", n);
+}
+
+
+// zstd reading or writing a stream's file, so compression is in its own process
+struct ZstdPipe : public Command
+{
+  bool open(const std::string& cmd, const char * mode)
+  {
+    if (m_fd = ::popen(cmd.c_str(), mode); !m_fd)
+      PLOGE << "Failed to open pipe to: " << cmd;
+
+    return m_fd != nullptr;
+  }
+
+  FILE * get() const { return m_fd; }
+  int finish() { return close(); }
+};
+
+
+// Flushes the journal and blocks writes while the device is read, so the image is consistent
+struct Freeze
+{
+  explicit Freeze(const fs::path& mount_path) : dir(mount_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+  {
+    if (frozen = dir.valid() && ::ioctl(dir.fd, FIFREEZE, 0) == 0; !frozen)
+      PLOGE << "Failed to freeze " << mount_path.string() << ": " << strerror(errno);
+  }
+
+  ~Freeze()
+  {
+    if (frozen && ::ioctl(dir.fd, FITHAW, 0) == -1)
+      PLOGE << "Failed to thaw filesystem: " << strerror(errno);
+  }
+
+  FileDescriptor dir;
+  bool frozen{};
+};
+
+
+// Bytes of all streams, reported every 10%
+class Progress
+{
+public:
+  Progress(const int64_t total, const std::string_view verb, OutputHandler& handler) : m_total(total), m_verb(verb), m_handler(handler)
+  {
+  }
+
+  void add(const int64_t n)
+  {
+    const auto before = m_done.fetch_add(n);
+    const auto after = before + n;
+
+    if (m_handler && m_total && before * 10 / m_total != after * 10 / m_total)
+    {
+      std::scoped_lock lck{m_mux};
+      m_handler(std::format("{} {}%", m_verb, after * 100 / m_total));
+    }
+  }
+
+private:
+  int64_t m_total;
+  std::string_view m_verb;
+  OutputHandler& m_handler;
+  std::atomic<int64_t> m_done{};
+  std::mutex m_mux;
+};
+
+
+// Two buffers: one is filled while the other is drained, on another thread, so reading
+// and writing overlap. Both stop after a record with a zero length, or if either fails.
+class DoubleBuffer
+{
+public:
+  struct Slot
+  {
+    BlockRecord record{};
+    AlignedBuffer data{make_buffer(ChunkSize)};
+    bool full{};
+  };
+
+  using Handler = std::function<bool(Slot&)>;
+
+  bool run(const Handler& fill, const Handler& drain)
+  {
+    if (rng::any_of(m_slots, [](const Slot& slot){ return !slot.data; }))
+      return false;
+
+    auto filled = std::async(std::launch::async, &DoubleBuffer::loop, this, std::cref(fill), false);
+    const bool drained = loop(drain, true);
+
+    return filled.get() && drained;
+  }
+
+private:
+  bool loop(const Handler& handler, const bool draining)
+  {
+    for (std::size_t i = 0 ; ; ++i)
+    {
+      Slot& slot = m_slots[i % m_slots.size()];
+
+      {
+        std::unique_lock lck{m_mux};
+        m_cv.wait(lck, [&]{ return m_failed || slot.full == draining; });
+
+        if (m_failed)
+          return false;
+      }
+
+      if (!handler(slot))
+      {
+        {
+          std::scoped_lock lck{m_mux};
+          m_failed = true;
+        }
+        m_cv.notify_all();
+        return false;
+      }
+
+      const bool last = slot.record.length == 0;
+
+      {
+        std::scoped_lock lck{m_mux};
+        slot.full = !draining;
+      }
+      m_cv.notify_all();
+
+      if (last)
+        return true;
+    }
+  }
+
+private:
+  std::array<Slot, 2> m_slots;
+  std::mutex m_mux;
+  std::condition_variable m_cv;
+  bool m_failed{};
+};
+
+
+static bool capture_stream(const int fd, const Extents& records, const fs::path& file, Progress& progress, const BlockImage::Stop& stop)
+{
+  ZstdPipe zstd;
+  if (!zstd.open(std::format("zstd -q -f -o {}", file.string()), "w"))
+    return false;
+
+  std::size_t next{};
+
+  const bool ok = DoubleBuffer{}.run([&](DoubleBuffer::Slot& slot)
+  {
+    if (stop())
+      return false;
+    else if (next == records.size())
+    {
+      slot.record = {};
+      return true;
+    }
+
+    const auto [offset, length] = records[next++];
+
+    if (!read_at(fd, slot.data.get(), length, offset))
+      return false;
+
+    slot.record = {.offset = static_cast<uint64_t>(offset), .length = static_cast<uint32_t>(length), .crc = crc32c(slot.data.get(), length)};
+    return true;
+  },
+  [&](DoubleBuffer::Slot& slot)
+  {
+    if (std::fwrite(&slot.record, sizeof(BlockRecord), 1, zstd.get()) != 1 ||
+        std::fwrite(slot.data.get(), 1, slot.record.length, zstd.get()) != slot.record.length)
+    {
+      PLOGE << "Failed to write to " << file.string();
+      return false;
+    }
+
+    progress.add(slot.record.length);
+    return true;
+  });
+
+  const auto stat = zstd.finish();
+  PLOGE_IF(stat != CmdSuccess) << "zstd failed for " << file.string();
+
+  return ok && stat == CmdSuccess;
+}
+
+
+static bool deploy_stream(const int fd, const fs::path& file, const int64_t dev_size, Progress& progress, const BlockImage::Stop& stop)
+{
+  ZstdPipe zstd;
+  if (!zstd.open(std::format("zstd -d -c -q {}", file.string()), "r"))
+    return false;
+
+  const bool ok = DoubleBuffer{}.run([&](DoubleBuffer::Slot& slot)
+  {
+    if (stop())
+      return false;
+    else if (std::fread(&slot.record, sizeof(BlockRecord), 1, zstd.get()) != 1)
+    {
+      PLOGE << file.string() << " is truncated";
+      return false;
+    }
+
+    const auto& [offset, length, crc] = slot.record;
+
+    if (length == 0)
+      return true;
+    else if (length > ChunkSize || offset % Align || length % Align || offset + length > static_cast<uint64_t>(dev_size))
+    {
+      PLOGE << file.string() << " has an invalid record at " << offset;
+      return false;
+    }
+    else if (std::fread(slot.data.get(), 1, length, zstd.get()) != length)
+    {
+      PLOGE << file.string() << " is truncated";
+      return false;
+    }
+    else if (crc32c(slot.data.get(), length) != crc)
+    {
+      PLOGE << file.string() << " checksum mismatch at " << offset;
+      return false;
+    }
+
+    return true;
+  },
+  [&](DoubleBuffer::Slot& slot)
+  {
+    if (slot.record.length && !write_at(fd, slot.data.get(), slot.record.length, slot.record.offset))
+      return false;
+
+    progress.add(slot.record.length);
+    return true;
+  });
+
+  // if not ok, zstd may not have finished, which closing the pipe stops
+  const auto stat = zstd.finish();
+  return ok && stat == CmdSuccess;
+}
+
+
+bool BlockImage::capture(const std::string_view dev, const fs::path& image_dir, const fs::path& mount_path, OutputHandler handler, Stop stop)
+{
+  std::error_code ec;
+  if (fs::create_directories(image_dir, ec); ec)
+  {
+    PLOGE << "Failed to create " << image_dir.string() << ": " << ec.message();
+    return false;
+  }
+
+  std::optional<Freeze> freeze;
+  if (!mount_path.empty() && !freeze.emplace(mount_path).frozen)
+    return false;
+
+  FileDescriptor device{dev, O_RDONLY | O_DIRECT | O_CLOEXEC};
+  if (!device.valid())
+    return false;
+
+  BlockImageInfo info {.fs = "ext4"};
+
+  const auto used = ext4_used(device.fd, info.fs_size);
+  if (!used)
+    return false;
+
+  for (const auto& extent : *used)
+    info.used += extent.length;
+
+  const auto streams = plan_streams(*used, std::clamp(std::thread::hardware_concurrency(), 1U, MaxStreams));
+  info.streams = streams.size();
+
+  handler(std::format("Capture {} used of {} on {}, in {} streams", format_size(info.used), format_size(info.fs_size), dev, info.streams));
+
+  Progress progress {info.used, "Captured", handler};
+
+  std::vector<std::future<bool>> results;
+  for (std::size_t i = 0 ; i < streams.size() ; ++i)
+    results.emplace_back(std::async(std::launch::async, capture_stream, device.fd, std::cref(streams[i]), image_dir / stream_name(i), std::ref(progress), std::cref(stop)));
+
+  bool ok = true;
+  for (auto& result : results)
+    ok &= result.get();
+
+  // written last, so a failed capture can't be deployed
+  return ok && write_info(image_dir, info);
+}
+
+
+bool BlockImage::deploy(const fs::path& image_dir, const std::string_view dev, OutputHandler handler, Stop stop)
+{
+  BlockImageInfo info;
+  if (!read_info(image_dir, info))
+    return false;
+
+  FileDescriptor device{dev, O_WRONLY | O_DIRECT | O_CLOEXEC};
+  if (!device.valid())
+    return false;
+
+  // works for a block device, unlike fstat()
+  const off_t dev_size = ::lseek(device.fd, 0, SEEK_END);
+
+  if (dev_size == -1)
+  {
+    PLOGE << "Failed to get size of " << dev << ": " << strerror(errno);
+    return false;
+  }
+  else if (dev_size < info.fs_size)
+  {
+    PLOGE << dev << " is smaller than the image's filesystem: " << format_size(info.fs_size);
+    return false;
+  }
+
+  handler(std::format("Write {} to {}, from {} streams", format_size(info.used), dev, info.streams));
+
+  Progress progress {info.used, "Written", handler};
+
+  std::vector<std::future<bool>> results;
+  for (std::size_t i = 0 ; i < info.streams ; ++i)
+    results.emplace_back(std::async(std::launch::async, deploy_stream, device.fd, image_dir / stream_name(i), dev_size, std::ref(progress), std::cref(stop)));
+
+  bool ok = true;
+  for (auto& result : results)
+    ok &= result.get();
+
+  // O_DIRECT bypasses the page cache, but not the device's cache
+  if (ok && ::fsync(device.fd) == -1)
+  {
+    PLOGE << "Failed to sync " << dev << ": " << strerror(errno);
+    return false;
+  }
+
+  return ok;
+}
+
+
+bool BlockImage::write_info(const fs::path& image_dir, const BlockImageInfo& info)
+{
+  std::ofstream stream{image_dir / InfoName};
+
+  stream  << "fs " << info.fs << '\n'
+          << "fs_size " << info.fs_size << '\n'
+          << "used " << info.used << '\n'
+          << "streams " << info.streams << '\n';
+
+  return stream.good();
+}
+
+
+bool BlockImage::read_info(const fs::path& image_dir, BlockImageInfo& info)
+{
+  std::ifstream stream{image_dir / InfoName};
+
+  if (!stream)
+  {
+    PLOGE << "Failed to open block image info in " << image_dir.string();
+    return false;
+  }
+
+  for (std::string key; stream >> key; )
+  {
+    if (key == "fs")
+      stream >> info.fs;
+    else if (key == "fs_size")
+      stream >> info.fs_size;
+    else if (key == "used")
+      stream >> info.used;
+    else if (key == "streams")
+      stream >> info.streams;
+  }
+
+  return can_capture(info.fs) && info.fs_size > 0 && info.streams > 0;
+}
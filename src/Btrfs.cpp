@@ -0,0 +1,80 @@
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <unistd.h>
+#include <linux/btrfs.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <plog/Log.h>
+#include <wali/Btrfs.hpp>
+#include <wali/FileDescriptor.hpp>
+
+
+bool Btrfs::create_subvolume(const fs::path& parent, const std::string_view name)
+{
+  btrfs_ioctl_vol_args args{};
+
+  if (name.empty() || name.size() > BTRFS_PATH_NAME_MAX)
+  {
+    PLOGE << "Invalid subvolume name: " << name;
+    return false;
+  }
+
+  FileDescriptor dir{parent, O_RDONLY | O_DIRECTORY};
+  if (!dir.valid())
+    return false;
+
+  name.copy(args.name, BTRFS_PATH_NAME_MAX);
+
+  if (::ioctl(dir.fd, BTRFS_IOC_SUBVOL_CREATE, &args) == -1)
+  {
+    PLOGE << "Failed to create subvolume " << name << " in " << parent.string() << ": " << strerror(errno);
+    return false;
+  }
+
+  return true;
+}
+
+
+bool Btrfs::set_nodatacow(const fs::path& dir)
+{
+  // only applies to files created after the flag is set, so must be done on an empty directory
+  FileDescriptor file{dir, O_RDONLY | O_DIRECTORY};
+  if (!file.valid())
+    return false;
+
+  int flags{};
+  if (::ioctl(file.fd, FS_IOC_GETFLAGS, &flags) == -1)
+  {
+    PLOGE << "Failed to get flags for " << dir.string() << ": " << strerror(errno);
+    return false;
+  }
+
+  flags |= FS_NOCOW_FL;
+
+  if (::ioctl(file.fd, FS_IOC_SETFLAGS, &flags) == -1)
+  {
+    PLOGE << "Failed to set nodatacow on " << dir.string() << ": " << strerror(errno);
+    return false;
+  }
+
+  return true;
+}
+
+
+std::string Btrfs::mount_options(const BtrfsData& data, const bool ssd, const bool discard)
+{
+  std::string opts {"noatime,space_cache=v2"};
+
+  if (data.compress_level > 0)
+    opts += std::format(",compress=zstd:{}", data.compress_level);
+
+  if (ssd)
+    opts += ",ssd";
+
+  // async discard batches trims rather than issuing them inline with every delete
+  if (ssd && discard)
+    opts += ",discard=async";
+
+  return opts;
+}
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <filesystem>
+#include <fstream>
 #include <functional>
 #include <optional>
 #include <ranges>
@@ -125,6 +126,21 @@ void DiskUtils::probe_disk(Disk& disk)
   if (const auto size_opt = get_disk_size(disk.dev); size_opt)
     disk.size = *size_opt;
 
+  if (int64_t value{}; read_queue_value(disk.dev, "rotational", value))
+    disk.is_rotational = value != 0;
+
+  if (int64_t value{}; read_queue_value(disk.dev, "discard_max_bytes", value))
+    disk.is_discard = value > 0;
+
+  if (const auto name = fs::path{disk.dev}.filename().string(); name.starts_with("mmcblk"))
+    disk.device_class = DeviceClass::Mmc;
+  else if (name.starts_with("md"))
+    disk.device_class = DeviceClass::Raid;
+  else if (name.starts_with("nvme"))
+    disk.device_class = DeviceClass::Nvme;
+  else
+    disk.device_class = disk.is_rotational ? DeviceClass::Hdd : DeviceClass::Ssd;
+
   Probe probe{disk.dev};
 
   if (!probe.valid())
@@ -217,6 +233,22 @@ bool DiskUtils::probe_partition(Partition& partition)
 }
 
 
+bool DiskUtils::read_queue_value(const std::string_view disk_dev, const std::string_view name, int64_t& value)
+{
+  // i.e. /sys/block/nvme0n1/queue/rotational
+  const auto path = fs::path{"/sys/block"} / fs::path{disk_dev}.filename() / "queue" / name;
+
+  std::ifstream stream{path};
+  if (!(stream >> value))
+  {
+    PLOGW << "Could not read " << path.string();
+    return false;
+  }
+
+  return true;
+}
+
+
 std::optional<int64_t> DiskUtils::get_disk_size (const std::string_view dev)
 {
   if (int fd = open(dev.data(), O_RDONLY); fd != -1)
@@ -241,6 +273,19 @@ std::optional<std::reference_wrapper<const Partition>> DiskUtils::get_partition(
 }
 
 
+std::optional<std::reference_wrapper<const Disk>> DiskUtils::get_disk(const Tree& tree, const std::string_view dev)
+{
+  // dev can be the disk or one of its partitions
+  for (const auto& [disk, parts] : tree)
+  {
+    if (disk.dev == dev || rng::contains(parts, dev, &Partition::dev))
+      return disk;
+  }
+
+  return {};
+}
+
+
 std::string DiskUtils::get_partition_disk (const Tree& tree, const std::string_view dev)
 {
   for (const auto& [disk, parts] : tree)
@@ -260,6 +305,13 @@ int DiskUtils::get_partition_part_number (const Tree& tree, const std::string_vi
 }
 
 
+int64_t DiskUtils::get_partition_size (const Tree& tree, const std::string_view dev)
+{
+  const auto opt = get_partition(tree, dev);
+  return opt ? opt->get().size : 0;
+}
+
+
 std::string DiskUtils::get_partition_uuid(const Tree& tree, const std::string_view dev)
 {
   std::string uuid;
@@ -286,6 +338,67 @@ std::string DiskUtils::get_partition_fs(const Tree& tree, const std::string_view
 }
 
 
+bool DiskUtils::is_ssd(const Tree& tree, const std::string_view dev)
+{
+  const auto opt = get_disk(tree, dev);
+  return opt ? !opt->get().is_rotational : false;
+}
+
+
+bool DiskUtils::has_discard(const Tree& tree, const std::string_view dev)
+{
+  const auto opt = get_disk(tree, dev);
+  return opt ? opt->get().is_discard : false;
+}
+
+
+DeviceClass DiskUtils::get_device_class(const Tree& tree, const std::string_view dev)
+{
+  const auto opt = get_disk(tree, dev);
+  return opt ? opt->get().device_class : DeviceClass::Unknown;
+}
+
+
+std::string_view DiskUtils::get_device_class_name(const DeviceClass dc)
+{
+  switch (dc)
+  {
+    case DeviceClass::Hdd:  return "HDD";
+    case DeviceClass::Ssd:  return "SSD";
+    case DeviceClass::Nvme: return "NVMe";
+    case DeviceClass::Mmc:  return "eMMC/SD";
+    case DeviceClass::Raid: return "RAID";
+    default:                return "Unknown";
+  }
+}
+
+
+std::string_view DiskUtils::get_recommended_fs(const Tree& tree, const std::string_view dev)
+{
+  static const int64_t LargeDiskSize = gb_to_b(4096);
+
+  const auto opt = get_disk(tree, dev);
+
+  if (!opt)
+    return "ext4";
+
+  switch (const Disk& disk = opt->get(); disk.device_class)
+  {
+    case DeviceClass::Mmc:
+      return "f2fs";  // flash friendly, log structured
+
+    case DeviceClass::Raid:
+      return "xfs";   // aligns to stripe geometry, parallel allocation groups
+
+    case DeviceClass::Hdd:
+      return disk.size >= LargeDiskSize ? "xfs" : "ext4";
+
+    default:
+      return "ext4";
+  }
+}
+
+
 bool DiskUtils::is_mounted(const std::string_view path_or_dev, const bool is_dev)
 {
   bool mounted = false;
@@ -0,0 +1,190 @@
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <plog/Log.h>
+#include <wali/FileDescriptor.hpp>
+#include <wali/FileOps.hpp>
+
+
+bool FileOps::write(const fs::path& path, const std::string_view content, const mode_t mode)
+{
+  std::error_code ec;
+  if (fs::create_directories(path.parent_path(), ec); ec)
+  {
+    PLOGE << "Failed to create " << path.parent_path().string() << ": " << ec.message();
+    return false;
+  }
+
+  std::string tmp_path {(path.parent_path() / std::format(".{}.XXXXXX", path.filename().string())).string()};
+
+  FileDescriptor file{::mkstemp(tmp_path.data())};
+  if (!file.valid())
+  {
+    PLOGE << "Failed to create temporary file for " << path.string() << ": " << strerror(errno);
+    return false;
+  }
+
+  bool written = ::fchmod(file.fd, mode) == 0;
+
+  for (std::size_t offset = 0 ; written && offset < content.size() ; )
+  {
+    if (const auto n = ::write(file.fd, content.data() + offset, content.size() - offset); n > 0)
+      offset += n;
+    else if (n == -1 && errno != EINTR)
+      written = false;
+  }
+
+  if (!written || ::rename(tmp_path.c_str(), path.c_str()) == -1)
+  {
+    PLOGE << "Failed to write " << path.string() << ": " << strerror(errno);
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+bool FileOps::append_if_missing(const fs::path& path, const std::string_view line)
+{
+  std::string content;
+
+  if (std::ifstream stream{path}; stream)
+  {
+    std::stringstream ss;
+    ss << stream.rdbuf();
+    content = ss.str();
+  }
+
+  for (const auto existing : content | view::split('\n'))
+  {
+    if (std::string_view{existing} == line)
+      return true;
+  }
+
+  if (!content.empty() && !content.ends_with('\n'))
+    content += '\n';
+
+  content += line;
+  content += '\n';
+
+  return write(path, content);
+}
+
+
+bool FileOps::symlink(const fs::path& target, const fs::path& link)
+{
+  std::error_code ec;
+
+  fs::create_directories(link.parent_path(), ec);
+
+  // create then rename, so an existing link is replaced atomically
+  const auto tmp_link = link.parent_path() / std::format(".{}.wali", link.filename().string());
+
+  fs::remove(tmp_link, ec);
+
+  if (fs::create_symlink(target, tmp_link, ec); ec)
+  {
+    PLOGE << "Failed to create link " << link.string() << ": " << ec.message();
+    return false;
+  }
+  else if (fs::rename(tmp_link, link, ec); ec)
+  {
+    PLOGE << "Failed to replace " << link.string() << ": " << ec.message();
+    fs::remove(tmp_link, ec);
+    return false;
+  }
+
+  return true;
+}
+
+
+bool FileOps::copy_tree(const fs::path& src, const fs::path& dest)
+{
+  std::error_code ec;
+
+  if (!fs::is_directory(src, ec))
+  {
+    PLOGE << "Not a directory: " << src.string();
+    return false;
+  }
+
+  bool copied{true};
+
+  fs::create_directories(dest, ec);
+
+  for (auto it = fs::recursive_directory_iterator{src, ec} ; it != fs::recursive_directory_iterator{} ; it.increment(ec))
+  {
+    if (ec)
+    {
+      PLOGE << "Failed to read " << src.string() << ": " << ec.message();
+      return false;
+    }
+
+    const auto& entry = *it;
+    const auto target = dest / entry.path().lexically_relative(src);
+
+    if (entry.is_symlink(ec))
+      copied &= symlink(fs::read_symlink(entry.path(), ec), target);
+    else if (entry.is_directory(ec))
+    {
+      fs::create_directories(target, ec);
+      fs::permissions(target, entry.status().permissions(), ec);
+    }
+    else if (entry.is_regular_file(ec))
+      copied &= copy_file(entry.path(), target);
+  }
+
+  return copied;
+}
+
+
+bool FileOps::copy_file(const fs::path& src, const fs::path& dest)
+{
+  FileDescriptor in{src, O_RDONLY | O_CLOEXEC};
+  if (!in.valid())
+    return false;
+
+  struct stat st{};
+  if (::fstat(in.fd, &st) == -1)
+  {
+    PLOGE << "Failed to stat " << src.string() << ": " << strerror(errno);
+    return false;
+  }
+
+  FileDescriptor out{dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777};
+  if (!out.valid())
+    return false;
+
+  // in kernel, and a reflink if both are on the same filesystem which supports it
+  for (off_t remaining = st.st_size ; remaining > 0 ; )
+  {
+    const auto n = ::copy_file_range(in.fd, nullptr, out.fd, nullptr, remaining, 0);
+
+    if (n == -1 && errno == EINTR)
+      continue;
+    else if (n == -1 && remaining == st.st_size && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL))
+    {
+      // not supported between these filesystems (older kernels can't copy across filesystems)
+      std::error_code ec;
+      if (fs::copy_file(src, dest, fs::copy_options::overwrite_existing, ec); ec)
+      {
+        PLOGE << "Failed to copy " << src.string() << ": " << ec.message();
+        return false;
+      }
+      break;
+    }
+    else if (n <= 0)
+    {
+      PLOGE << "Failed to copy " << src.string() << ": " << (n == 0 ? "unexpected end of file" : strerror(errno));
+      return false;
+    }
+
+    remaining -= n;
+  }
+
+  // O_CREAT mode is ignored for an existing file
+  return ::fchmod(out.fd, st.st_mode & 07777) == 0;
+}
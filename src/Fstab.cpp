@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <libmount/libmount.h>
+#include <plog/Log.h>
+#include <wali/Fstab.hpp>
+
+
+std::vector<FstabEntry> Fstab::read(const fs::path& root, const fs::path& mountinfo)
+{
+  std::vector<FstabEntry> entries;
+
+  const std::string root_str {root.string()};
+
+  auto table = mnt_new_table();
+  if (!table)
+    return entries;
+
+  if (mnt_table_parse_file(table, mountinfo.c_str()) != 0)
+    PLOGE << "Failed to parse " << mountinfo.string();
+  else
+  {
+    auto itr = mnt_new_iter(MNT_ITER_FORWARD);
+    libmnt_fs * fs{};
+
+    while (mnt_table_next_fs(table, itr, &fs) == 0)
+    {
+      const std::string_view target {mnt_fs_get_target(fs) ?: ""};
+
+      // root itself, or below root but not a sibling with the same prefix, i.e. /mnt2
+      if (target != root_str && !target.starts_with(root_str + '/'))
+        continue;
+
+      const char * source = mnt_fs_get_srcpath(fs);
+      const char * fstype = mnt_fs_get_fstype(fs);
+      const char * options = mnt_fs_get_options(fs);
+
+      FstabEntry entry { .source = source ? source : "",
+                         .target = target == root_str ? "/" : std::string{target.substr(root_str.size())},
+                         .fstype = fstype ? fstype : "",
+                         .options = options ? options : "defaults"};
+
+      if (entry.fstype == "btrfs")
+      {
+        if (const char * subvol = mnt_fs_get_root(fs); subvol)
+          entry.subvol = std::string_view{subvol}.substr(1); // /@home to @home
+      }
+
+      entries.push_back(std::move(entry));
+    }
+
+    mnt_free_iter(itr);
+  }
+
+  mnt_free_table(table);
+
+  return entries;
+}
+
+
+void Fstab::prepare(std::vector<FstabEntry>& entries, const fs::path& root, const std::map<std::string, std::string>& mount_options,
+                    const std::string_view btrfs_options, UuidResolver uuid)
+{
+  // the subvolumes share a device, so only resolve each once
+  std::map<std::string, std::string> uuids;
+
+  for (auto& entry : entries)
+  {
+    if (!uuids.contains(entry.source))
+      uuids[entry.source] = uuid(entry.source);
+
+    const auto abs_target = (root / entry.target.substr(1)).lexically_normal().string();
+    const auto mount_path = abs_target.ends_with('/') ? abs_target.substr(0, abs_target.size()-1) : abs_target;
+
+    if (const auto& dev_uuid = uuids.at(entry.source); !dev_uuid.empty())
+      entry.source = std::format("UUID={}", dev_uuid);
+
+    if (const auto it = mount_options.find(mount_path); it != mount_options.end() && !it->second.empty())
+      entry.options = std::format("rw,{}", it->second);
+    else if (!entry.subvol.empty())
+      entry.options = std::format("{},subvol={}", btrfs_options, entry.subvol);
+
+    if (entry.fstype == "btrfs" || entry.fstype == "xfs")
+      entry.passno = 0;
+    else
+      entry.passno = entry.target == "/" ? 1 : 2;
+  }
+
+  // systemd mounts a tmpfs on /tmp, but without noatime and with the default size
+  entries.push_back({.source = "tmpfs", .target = "/tmp", .fstype = "tmpfs", .options = "rw,nosuid,nodev,noatime,size=50%,mode=1777"});
+}
+
+
+std::string Fstab::format(const std::vector<FstabEntry>& entries)
+{
+  std::size_t source_width{}, target_width{}, fstype_width{}, options_width{};
+
+  for (const auto& entry : entries)
+  {
+    source_width = std::max(source_width, entry.source.size());
+    target_width = std::max(target_width, entry.target.size());
+    fstype_width = std::max(fstype_width, entry.fstype.size());
+    options_width = std::max(options_width, entry.options.size());
+  }
+
+  std::string content {"# Static information about the filesystems.\n"
+                       "# See fstab(5) for details.\n\n"
+                       "# <file system> <dir> <type> <options> <dump> <pass>\n\n"};
+
+  for (const auto& entry : entries)
+  {
+    content += std::format("{:<{}}  {:<{}}  {:<{}}  {:<{}}  {} {}\n",
+                            entry.source, source_width,
+                            entry.target, target_width,
+                            entry.fstype, fstype_width,
+                            entry.options, options_width,
+                            entry.freq, entry.passno);
+  }
+
+  return content;
+}
+
+
+bool Fstab::write(const fs::path& path, const std::vector<FstabEntry>& entries)
+{
+  fs::create_directories(path.parent_path());
+
+  std::ofstream stream{path, std::ios_base::out | std::ios_base::trunc};
+  stream << format(entries);
+
+  PLOGE_IF(!stream) << "Failed to write " << path.string();
+
+  return stream.good();
+}
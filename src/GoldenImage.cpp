@@ -0,0 +1,206 @@
+#include <format>
+#include <fstream>
+#include <glob.h>
+#include <linux/magic.h>
+#include <sstream>
+#include <sys/vfs.h>
+#include <wali/FileOps.hpp>
+#include <wali/GoldenImage.hpp>
+
+
+// zstd compresses with all cores, decompression is single threaded but parts are concurrent
+static const constexpr char Compress[] = "--use-compress-program='zstd -T0'";
+// capabilities are the security.capability xattr
+static const constexpr char Metadata[] = "--xattrs --xattrs-include='*' --acls --numeric-owner";
+
+// names are relative to the part's dir, i.e. ./etc/fstab in root, ./journal in var/log
+static const StringViewVec Excludes
+{
+  "./etc/fstab",
+  "./etc/crypttab",
+  "./etc/mdadm.conf",
+  "./etc/machine-id",
+  "./etc/hostname",
+  "./etc/ssh/ssh_host_*",
+  "./etc/pacman.d/gnupg",
+  "./var/lib/systemd/random-seed",
+  "./loader/random-seed",
+  "./var/log/journal/*",
+  "./journal/*",
+  "./var/cache/pacman/pkg/*",
+  "./pacman/pkg/*"
+};
+
+
+ArchiveParts GoldenImage::plan(const std::vector<std::string>& mounts, const bool root_blocks)
+{
+  // only packages and snapshots, the mount points are in their parent's part
+  static const StringViewVec Skip {"var/cache/pacman/pkg", ".snapshots"};
+
+  ArchiveParts parts;
+
+  for (const auto& mount : mounts)
+  {
+    if (rng::contains(Skip, mount))
+      continue;
+    else if (mount == "." && root_blocks)
+      parts.push_back({.file = std::format("root{}", BlocksExt), .dir = "."});
+    else if (mount == ".")
+    {
+      parts.push_back({.file = "usr.tar.zst", .dir = ".", .members = "./usr"});
+      parts.push_back({.file = "root.tar.zst", .dir = ".", .members = ".", .exclude = "./usr"});
+    }
+    else
+    {
+      auto name = mount;
+      rng::replace(name, '/', '-');
+
+      parts.push_back({.file = std::format("{}.tar.zst", name), .dir = mount, .members = "."});
+    }
+  }
+
+  return parts;
+}
+
+
+bool GoldenImage::capture(const fs::path& root, const fs::path& image_dir, const ArchivePart& part, OutputHandler handler)
+{
+  std::string excludes;
+
+  for (const auto pattern : Excludes)
+    excludes += std::format("--exclude='{}' ", pattern);
+
+  if (!part.exclude.empty())
+    excludes += std::format("--exclude='{}' ", part.exclude);
+
+  // --one-file-system: other mounts are in their own part
+  const auto cmd = std::format("tar --create --file={} {} {} --one-file-system --sparse {}-C {} {}",
+                                (image_dir / part.file).string(), Compress, Metadata, excludes, (root / part.dir).lexically_normal().string(), part.members);
+
+  return ReadCommand::execute(cmd, std::move(handler)) == CmdSuccess;
+}
+
+
+bool GoldenImage::extract(const fs::path& image_dir, const fs::path& root, const ArchivePart& part, OutputHandler handler)
+{
+  const auto dir = (root / part.dir).lexically_normal();
+
+  std::error_code ec;
+  if (fs::create_directories(dir, ec); ec)
+  {
+    PLOGE << "Failed to create " << dir.string() << ": " << ec.message();
+    return false;
+  }
+
+  // vfat has no owners or xattrs, and its modes are set by the mount options
+  struct statfs st{};
+  const bool vfat = ::statfs(dir.c_str(), &st) == 0 && st.f_type == MSDOS_SUPER_MAGIC;
+  const std::string_view metadata = vfat ? "--no-same-owner --no-same-permissions" : Metadata;
+
+  // --no-overwrite-dir: mount points keep their mount's owner and mode
+  const auto cmd = std::format("tar --extract --file={} {} {} --no-overwrite-dir -C {}",
+                                (image_dir / part.file).string(), Compress, metadata, dir.string());
+
+  return ReadCommand::execute(cmd, std::move(handler)) == CmdSuccess;
+}
+
+
+void GoldenImage::clean(const fs::path& dir)
+{
+  for (const auto& path : find_excluded(dir))
+  {
+    std::error_code ec;
+    fs::remove_all(path, ec);
+    PLOGE_IF(ec) << "Failed to remove " << path.string() << ": " << ec.message();
+  }
+}
+
+
+MachineFiles GoldenImage::read_machine_files(const fs::path& root)
+{
+  MachineFiles files;
+
+  for (const auto& path : find_excluded(root))
+  {
+    std::error_code ec;
+
+    if (!path.lexically_relative(root).string().starts_with("etc/") || !fs::is_regular_file(path, ec))
+      continue;
+
+    std::ifstream stream{path, std::ios_base::binary};
+    std::stringstream ss;
+    ss << stream.rdbuf();
+
+    if (!stream)
+      PLOGE << "Failed to read " << path.string();
+    else
+      files.push_back({.path = path, .content = ss.str(), .perms = fs::status(path, ec).permissions()});
+  }
+
+  return files;
+}
+
+
+bool GoldenImage::restore_machine_files(const MachineFiles& files)
+{
+  bool restored{true};
+
+  for (const auto& file : files)
+    restored &= FileOps::write(file.path, file.content, static_cast<mode_t>(file.perms));
+
+  return restored;
+}
+
+
+std::vector<fs::path> GoldenImage::find_excluded(const fs::path& dir)
+{
+  std::vector<fs::path> paths;
+
+  for (const auto pattern : Excludes)
+  {
+    glob_t matches{};
+
+    if (::glob((dir / pattern).lexically_normal().c_str(), GLOB_NOSORT, nullptr, &matches) == 0)
+    {
+      for (std::size_t i = 0 ; i < matches.gl_pathc ; ++i)
+        paths.emplace_back(matches.gl_pathv[i]);
+    }
+
+    ::globfree(&matches);
+  }
+
+  return paths;
+}
+
+
+bool GoldenImage::write_manifest(const fs::path& image_dir, const ArchiveParts& parts)
+{
+  std::ofstream stream{image_dir / ManifestName};
+
+  for (const auto& part : parts)
+    stream << part.file << '\t' << part.dir << '\n';
+
+  return stream.good();
+}
+
+
+bool GoldenImage::read_manifest(const fs::path& image_dir, ArchiveParts& parts)
+{
+  std::ifstream stream{image_dir / ManifestName};
+
+  if (!stream)
+  {
+    PLOGE << "Failed to open manifest in " << image_dir.string();
+    return false;
+  }
+
+  parts.clear();
+
+  for (std::string line; std::getline(stream, line); )
+  {
+    if (const auto tab = line.find('\t'); tab != std::string::npos)
+      parts.push_back({.file = line.substr(0, tab), .dir = line.substr(tab + 1)});
+  }
+
+  return !parts.empty();
+}
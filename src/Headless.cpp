@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <memory>
+#include <wali/AnswerFile.hpp>
+#include <wali/Headless.hpp>
+#include <wali/Install.hpp>
+#include <wali/SystemFacts.hpp>
+#include <wali/Validation.hpp>
+
+
+int Headless::run(const fs::path& answers)
+{
+  PLOGI << "Headless install with " << answers;
+
+  const auto facts = SystemFacts::get();
+
+  if (!facts->startup_error.empty())
+  {
+    PLOGE << "Startup checks failed: " << facts->startup_error;
+    return Invalid;
+  }
+
+  auto data = std::make_shared<WidgetData>();
+
+  if (!AnswerFile::read(answers, *data))
+    return Invalid;
+
+  // as MountsWidget::set_data(), an existing /home keeps its filesystem
+  if (auto& mounts = data->mounts; mounts.home_target == HomeMountTarget::Existing && mounts.home_fs.empty())
+    mounts.home_fs = DiskUtils::get_partition_fs(facts->tree, mounts.home_dev);
+
+  ValidationMessages messages;
+  const auto valid = Validation::all(*data, *facts, messages);
+
+  for (const auto& msg : messages)
+  {
+    switch (msg.level)
+    {
+      case ValidationMessage::Level::Error:   PLOGE << msg.text; break;
+      case ValidationMessage::Level::Warning: PLOGW << msg.text; break;
+      case ValidationMessage::Level::Info:    PLOGI << msg.text; break;
+    }
+  }
+
+  if (!valid)
+  {
+    PLOGE << "Answer file is invalid, nothing has changed";
+    return Invalid;
+  }
+
+  InstallState result {InstallState::None};
+  std::size_t stage{};
+
+  auto stage_change = [&stage](const std::string name, const StageStatus status)
+  {
+    if (status == StageStatus::Start)
+      PLOGI << std::format("[{}/{}] {}", ++stage, Stages.size(), name);
+    else if (status == StageStatus::Fail)
+      PLOGE << std::format("[{}/{}] {} failed", stage, Stages.size(), name);
+  };
+
+  Install install;
+  install.install({ .stage_change = stage_change,
+                    .log = [](const std::string, const InstallLogLevel){}, // Install also logs to plog, which is stdout
+                    .complete = [&result](const InstallState state){ result = state; }
+                  },
+                  data);
+
+  switch (result)
+  {
+    case InstallState::Complete:
+      PLOGI << std::format("Complete: {} packages in {}", data->summary.package_count, data->summary.duration);
+      return Complete;
+
+    case InstallState::Partial:
+    case InstallState::Bootable:
+      PLOGW << "Partial: bootable, but a non-essential step failed";
+      return Partial;
+
+    default:
+      PLOGE << "Failed: system is not bootable";
+      return Failed;
+  }
+}
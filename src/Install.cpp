@@ -2,26 +2,63 @@
 
 #include "wali/DiskUtils.hpp"
 #include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <csignal>
+#include <cstdlib>
 #include <cstring>
 #include <exception>
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <future>
 #include <iterator>
 #include <mutex>
 #include <ranges>
+#include <set>
 #include <string>
 #include <string_view>
 #include <thread>
 #include <sys/mount.h>
 #include <system_error>
+#include <wali/Btrfs.hpp>
 #include <wali/Commands.hpp>
 #include <wali/Common.hpp>
+#include <wali/Accounts.hpp>
+#include <wali/BlockImage.hpp>
+#include <wali/FileOps.hpp>
+#include <wali/Fstab.hpp>
+#include <wali/GoldenImage.hpp>
 #include <wali/Install.hpp>
+#include <wali/JobLimit.hpp>
+#include <wali/LoopDevice.hpp>
+#include <wali/Luks.hpp>
+#include <wali/MountUtils.hpp>
+#include <wali/SystemFacts.hpp>
+#include <wali/Systemd.hpp>
 #include <wali/widgets/WidgetData.hpp>
 
 
+static std::atomic_uint next_id;
+
+// shared by all installs, see InstallJobs
+static JobLimit pacman_jobs {InstallJobs{}.pacman};
+static JobLimit mkfs_jobs {InstallJobs{}.mkfs};
+static JobLimit fetch_jobs {1}; // the host's pacman locks its database
+static fs::path package_cache;
+
+// disks in use by an install
+static std::mutex claims_mutex;
+static std::set<std::string> claimed_disks;
+
+
+void Install::set_jobs(const InstallJobs& jobs)
+{
+  pacman_jobs.set_limit(jobs.pacman);
+  mkfs_jobs.set_limit(jobs.mkfs);
+  package_cache = jobs.package_cache;
+}
+
 bool Install::exec(std::function<bool(Install&)> f, const std::string_view name)
 {
   StageStatus state = StageStatus::Fail;
@@ -50,25 +87,30 @@ bool Install::exec(std::function<bool(Install&)> f, const std::string_view name)
 
 void Install::exec_stages()
 {
-  auto exec_minimal = [this]
+  // deploying an archive replaces the stages that install packages, so the stages
+  // (and the UI's logs) are the same
+  const bool deploy = deploying();
+
+  auto exec_minimal = [this, deploy]
   {
     return  exec(&Install::filesystems,   STAGE_FS) &&
             exec(&Install::mount,         STAGE_MOUNT) &&
-            exec(&Install::pacstrap,      STAGE_PACSTRAP) &&
+            exec(deploy ? &Install::deploy : &Install::pacstrap, STAGE_PACSTRAP) &&
             exec(&Install::fstab,         STAGE_FSTAB) &&
+            exec(&Install::initramfs,     STAGE_INITRAMFS) &&
             exec(&Install::root_account,  STAGE_ROOT_ACC) &&
             exec(&Install::boot_loader,   STAGE_BOOT_LOADER);
   };
 
-  auto exec_extra = [this]
+  auto exec_extra = [this, deploy]
   {
     return  exec(&Install::user_account,  STAGE_USER_ACC) &&
-            exec(&Install::video,         STAGE_VIDEO) &&
-            exec(&Install::desktop,       STAGE_DESKTOP) &&
+            exec(deploy ? &Install::deployed : &Install::video,     STAGE_VIDEO) &&
+            exec(deploy ? &Install::deployed : &Install::desktop,   STAGE_DESKTOP) &&
             exec(&Install::localise,      STAGE_LOCALISE) &&
             exec(&Install::network,       STAGE_NETWORK) &&
             exec(&Install::swap,          STAGE_SWAP) &&
-            exec(&Install::packages,      STAGE_PACKAGES);
+            exec(deploy ? &Install::deployed : &Install::packages,  STAGE_PACKAGES);
   };
 
 
@@ -78,8 +120,6 @@ void Install::exec_stages()
   {
     on_state(InstallState::Running);
 
-    m_tree = DiskUtils::probe();
-
     if (const bool minimal = exec_minimal(); m_state != InstallState::Cancelled)
     {
       m_state = minimal ? InstallState::Partial : InstallState::Fail;
@@ -101,15 +141,59 @@ void Install::exec_stages()
     m_state = InstallState::Fail;
   }
 
+  // not the state, which is Partial whilst the extra stages run
+  m_stages_done = true;
   m_cv.notify_one();
 }
 
+// Processes called `name` that are chrooted into `root` (arch-chroot), or have an argument
+// within it (pacstrap runs pacman -r), so other installs' processes are not found.
+static std::vector<pid_t> find_processes(const std::string_view name, const fs::path& root)
+{
+  auto within = [root = root.string()](const std::string_view path)
+  {
+    return path.starts_with(root) && (path.size() == root.size() || path[root.size()] == '/');
+  };
+
+  std::vector<pid_t> pids;
+  std::error_code ec;
+
+  for (const auto& entry : fs::directory_iterator{"/proc", ec})
+  {
+    const auto pid = entry.path().filename().string();
+
+    if (!rng::all_of(pid, [](const unsigned char c){ return std::isdigit(c); }))
+      continue;
+
+    std::string comm;
+    std::ifstream{entry.path() / "comm"} >> comm;
+
+    if (comm != name)
+      continue;
+
+    bool found{};
+
+    if (const auto proc_root = fs::read_symlink(entry.path() / "root", ec); !ec)
+      found = within(proc_root.string());
+
+    // arguments are separated by '\0', an option's value may follow '='
+    std::ifstream cmdline{entry.path() / "cmdline"};
+    for (std::string arg; !found && std::getline(cmdline, arg, '\0'); )
+      found = within(arg.substr(arg.find('=') == std::string::npos ? 0 : arg.find('=') + 1));
+
+    if (found)
+      pids.push_back(std::stoi(pid));
+  }
+
+  return pids;
+}
+
 void Install::kill()
 {
   static const auto MaxDuration = chrono::seconds{5};
 
   // not all stages can be killed because they are so quick it isn't worth the effort setting the
-  // process, calling killall etc. Instead, exec() will return false
+  // process etc. Instead, exec() will return false
   if (m_process.empty())
     return;
 
@@ -120,10 +204,13 @@ void Install::kill()
   const auto force_end = WaliClock::now() + MaxDuration;
   while (WaliClock::now() < force_end && !killed)
   {
-    if (auto fd = ::popen(std::format("killall -s SIGKILL -- {}", m_process).c_str(), "r") ; fd)
-      killed = ::pclose(fd) == CmdSuccess;
+    const auto pids = find_processes(m_process, m_root_mnt);
+
+    for (const auto pid : pids)
+      ::kill(pid, SIGKILL);
 
-    std::this_thread::sleep_for(chrono::milliseconds(500));
+    if (killed = pids.empty(); !killed)
+      std::this_thread::sleep_for(chrono::milliseconds(500));
   }
 
   PLOGE_IF(!killed) << "Failed to kill " << m_process;
@@ -132,6 +219,14 @@ void Install::kill()
 void Install::cleanup()
 {
   log_stage_start(STAGE_UNMOUNT);
+
+  // only a complete install, a partial install may be missing packages
+  if (!m_data->archive.capture.empty() && m_state == InstallState::Complete && !capture())
+    m_state = InstallState::Partial;
+
+  if (!m_loop_dev.empty() && m_data->mounts.image.compact && succeeded())
+    trim_image();
+
   const auto unmounted = unmount() ? StageStatus::Complete : StageStatus::Fail;
   log_stage_end(STAGE_UNMOUNT, unmounted);
 }
@@ -143,9 +238,34 @@ void Install::install(InstallHandlers handlers, WidgetDataPtr data)
   m_log = handlers.log;
   m_data = data;
   m_state = InstallState::None;
+  m_stages_done = false;
+  m_mount_options.clear();
+  m_cache_shared = false;
+
+  m_id = ++next_id;
+  m_root_mnt = RootMnt / std::format("wali-{}", m_id);
+  m_luks_root = std::format("{}-{}", LuksRootName, m_id);
+  m_luks_home = std::format("{}-{}", LuksHomeName, m_id);
+  m_md_root = std::format("{}-{}", MdRootDev, m_id);
+  m_md_home = std::format("{}-{}", MdHomeDev, m_id);
 
   auto start = WaliClock::now();
 
+  // attached first, so the image's partitions are in the tree
+  const bool attached = attach_image();
+
+  m_tree = DiskUtils::probe();
+
+  if (!attached || !claim_disks())
+  {
+    m_state = InstallState::Fail;
+    detach_image();
+    on_state(m_state);
+    return;
+  }
+
+  log_info(std::format("Install {} mounts to {}", m_id, m_root_mnt.string()));
+
   try
   {
     auto thread = std::jthread([this]{ return exec_stages(); });
@@ -155,7 +275,7 @@ void Install::install(InstallHandlers handlers, WidgetDataPtr data)
 
     m_cv.wait(lck, [this]
     {
-      return m_state == InstallState::Cancelled || m_state == InstallState::Complete || m_state == InstallState::Fail;
+      return m_state == InstallState::Cancelled || m_stages_done;
     });
 
     if (m_state == InstallState::Cancelled)
@@ -167,278 +287,1312 @@ void Install::install(InstallHandlers handlers, WidgetDataPtr data)
     m_state = InstallState::Fail;
   }
 
-  if (m_state != InstallState::Fail && m_state != InstallState::Cancelled)
+  if (succeeded())
   {
-    const auto [size, used] = GetDevSpace{}(m_data->mounts.root_dev);
+    const auto [size, used] = GetDevSpace{}(m_root_mnt, root_block_dev());
     m_data->summary.root_size = size;
     m_data->summary.root_used = used;
-    m_data->summary.package_count = CountPackages{}(m_data->mounts.root_dev);
+    m_data->summary.package_count = CountPackages{}(m_root_mnt);
     m_data->summary.duration = chrono::duration_cast<chrono::seconds>(WaliClock::now() - start);
   }
 
   cleanup();
+  release_disks();
+  detach_image();
+
+  // only if empty, so nothing is lost if unmount failed
+  std::error_code ec;
+  fs::remove(m_root_mnt, ec);
 
   on_state(m_state);
 }
 
+// The image is partitioned as PartitionsWidget would a disk, but root uses the remaining space
+bool Install::attach_image()
+{
+  auto& mounts = m_data->mounts;
+  const auto& image = mounts.image;
+
+  if (image.path.empty())
+    return true;
+
+  log_info(std::format("Create {} image {}", format_size(image.size), image.path));
+
+  if (!LoopDevice::create_image(image.path, image.size))
+  {
+    log_error(std::format("Failed to create {}", image.path));
+    return false;
+  }
+
+  if (m_loop_dev = LoopDevice::attach(image.path); m_loop_dev.empty())
+  {
+    log_error(std::format("Failed to attach {}", image.path));
+    return false;
+  }
+
+  log_info(std::format("Attached to {}", m_loop_dev));
+
+  auto log = [this](const std::string_view m){ log_info(m); };
+
+  const bool partitioned =  CreatePartitionTable{}(m_loop_dev, log) &&
+                            CreatePartition{}(m_loop_dev, 1, ImageBootSize / B_MB, log) &&
+                            CreatePartition{}(m_loop_dev, 2, log);
+
+  // the partitions' devices and links are created by udev
+  if (!partitioned || ReadCommand::execute("udevadm settle") != CmdSuccess)
+  {
+    log_error(std::format("Failed to partition {}", m_loop_dev));
+    return false;
+  }
+
+  // partition types are set when the filesystems are created
+  mounts.boot_dev = std::format("{}p1", m_loop_dev);
+  mounts.boot_fs = "vfat";
+  mounts.root_dev = std::format("{}p2", m_loop_dev);
+  mounts.home_dev = mounts.root_dev;
+  mounts.home_fs = mounts.root_fs;
+
+  return true;
+}
+
+void Install::trim_image()
+{
+  // the loop driver punches discarded blocks from the image
+  for (const auto& path : {m_root_mnt, m_root_mnt / "boot"})
+  {
+    if (const auto trimmed = LoopDevice::trim(path); trimmed < 0)
+      log_warning(std::format("Failed to trim {}", path.string()));
+    else if (trimmed > 0)
+      log_info(std::format("Trimmed {} from {}", format_size(trimmed), path.string()));
+  }
+}
+
+void Install::detach_image()
+{
+  if (m_loop_dev.empty())
+    return;
+
+  log_info(std::format("Detach {}", m_loop_dev));
+  log_warning_if(!LoopDevice::detach(m_loop_dev), std::format("Failed to detach {}", m_loop_dev));
+  m_loop_dev.clear();
+
+  if (const auto& image = m_data->mounts.image; image.compact && succeeded())
+  {
+    log_info(std::format("Compact {}", image.path));
+
+    if (const auto allocated = LoopDevice::compact(image.path); allocated < 0)
+      log_warning(std::format("Failed to compact {}", image.path));
+    else if (allocated > 0)
+      log_info(std::format("{} uses {} of {}", image.path, format_size(allocated), format_size(image.size)));
+  }
+}
+
+std::set<std::string> Install::target_disks() const
+{
+  const MountData& data = m_data->mounts;
+
+  std::vector<std::string> devs {data.boot_dev, data.root_dev};
+  devs.insert(devs.end(), data.root_stripe.devs.cbegin(), data.root_stripe.devs.cend());
+
+  if (data.home_target != HomeMountTarget::Root)
+    devs.push_back(data.home_dev);
+
+  if (data.home_target == HomeMountTarget::New)
+    devs.insert(devs.end(), data.home_stripe.devs.cbegin(), data.home_stripe.devs.cend());
+
+  std::set<std::string> disks;
+  for (const auto& dev : devs)
+    disks.insert(DiskUtils::get_partition_disk(m_tree, dev));
+
+  return disks;
+}
+
+// the whole disk, because partition table edits and md/LUKS setup on a disk can't be shared
+bool Install::claim_disks()
+{
+  const auto disks = target_disks();
+
+  std::scoped_lock lock{claims_mutex};
+
+  if (const auto it = rng::find_if(disks, [](const std::string& disk){ return claimed_disks.contains(disk); }); it != disks.end())
+  {
+    log_error(std::format("{} is in use by another install", *it));
+    return false;
+  }
+
+  claimed_disks.insert(disks.cbegin(), disks.cend());
+  m_claimed_disks = disks;
+  return true;
+}
+
+void Install::release_disks()
+{
+  std::scoped_lock lock{claims_mutex};
+
+  for (const auto& disk : m_claimed_disks)
+    claimed_disks.erase(disk);
+
+  m_claimed_disks.clear();
+}
+
 // filesystem
 bool Install::filesystems()
 {
   const MountData& data = m_data->mounts;
 
-  log_info(std::format("/     -> {} with {}", data.root_dev, data.root_fs));
-  log_info(std::format("/boot -> {} with {}", data.boot_dev, data.boot_fs));
+  log_info(std::format("/     -> {} with {}", data.root_dev, data.root_fs));
+
+  if (data.root_stripe.level != RaidLevel::None)
+    log_info(std::format("/     {} with {}", raid_level_name(data.root_stripe.level), flatten(data.root_stripe.devs)));
+
+  if (data.home_target == HomeMountTarget::New && data.home_stripe.level != RaidLevel::None)
+    log_info(std::format("/home {} with {}", raid_level_name(data.home_stripe.level), flatten(data.home_stripe.devs)));
+
+  log_info(std::format("/boot -> {} with {}", data.boot_dev, data.boot_fs));
+
+  if (data.home_target == HomeMountTarget::Existing)
+    log_info(std::format("/home -> {}", data.home_dev));
+  else if(data.home_target == HomeMountTarget::Root)
+    log_info(std::format("/home -> {} with {}", data.root_dev, data.root_fs));
+  else
+    log_info(std::format("/home -> {} with {}", data.home_dev, data.home_fs));
+
+  if (data.uses_luks())
+  {
+    log_info("Benchmark ciphers");
+
+    m_luks_cipher = Luks::benchmark();
+
+    if (m_luks_cipher.mib_per_sec > 0)
+      log_info(std::format("Using {} {}-bit: {:.0f} MiB/s", m_luks_cipher.cipher, m_luks_cipher.key_bits, m_luks_cipher.mib_per_sec));
+    else
+      log_warning(std::format("Benchmark failed, using {} {}-bit", m_luks_cipher.cipher, m_luks_cipher.key_bits));
+  }
+
+  const auto jobs = plan_filesystems();
+
+  // created before the jobs start so the map isn't modified concurrently
+  m_disk_locks.clear();
+  for (const auto& job : jobs)
+  {
+    m_disk_locks.try_emplace(DiskUtils::get_partition_disk(m_tree, job.dev));
+
+    for (const auto& dev : job.stripe.devs)
+      m_disk_locks.try_emplace(DiskUtils::get_partition_disk(m_tree, dev));
+  }
+
+  std::vector<std::future<bool>> results;
+  results.reserve(jobs.size());
+
+  for (const auto& job : jobs)
+    results.emplace_back(std::async(std::launch::async, &Install::create_filesystem, this, std::cref(job)));
+
+  // wait for all, even if one fails, so we don't leave a device half formatted
+  bool created{true};
+  for (auto& result : results)
+    created &= result.get();
+
+  return created;
+}
+
+std::vector<FilesystemJob> Install::plan_filesystems() const
+{
+  const MountData& data = m_data->mounts;
+
+  std::vector<FilesystemJob> jobs;
+
+  jobs.push_back({.dev = data.boot_dev, .fs = "vfat", .part_type = PartTypeEfi});
+
+  FilesystemJob root {.dev = data.root_dev, .fs = data.root_fs, .part_type = PartTypeRoot, .stripe = data.root_stripe};
+
+  if (root_base_dev() != data.root_dev)
+    root.md_dev = m_md_root;
+
+  if (data.luks.root)
+    root.luks_name = m_luks_root;
+
+  root.block_image = root_block_image();
+
+  if (data.root_fs == "btrfs")
+  {
+    root.subvolumes.push_back("@");
+
+    // mount() expects @home on the root partition
+    if (data.home_target == HomeMountTarget::Root)
+      root.subvolumes.push_back("@home");
+
+    for (const auto& subvol : data.btrfs.subvolumes)
+      root.subvolumes.push_back(subvol.name);
+  }
+
+  jobs.push_back(std::move(root));
+
+  // an existing home partition is only mounted
+  if (data.home_target == HomeMountTarget::New)
+  {
+    FilesystemJob home {.dev = data.home_dev, .fs = data.home_fs, .part_type = PartTypeHome, .stripe = data.home_stripe};
+
+    if (home_base_dev() != data.home_dev)
+      home.md_dev = m_md_home;
+
+    if (data.luks.home)
+      home.luks_name = m_luks_home;
+
+    if (data.home_fs == "btrfs")
+      home.subvolumes.push_back("@home");
+
+    jobs.push_back(std::move(home));
+  }
+
+  return jobs;
+}
+
+bool Install::create_filesystem(const FilesystemJob& job)
+{
+  JobSlot slot {mkfs_jobs, [this]{ return cancelled(); }};
+
+  if (!slot)
+    return false;
+
+  const bool striped = job.stripe.level != RaidLevel::None;
+
+  std::vector<std::string> devs {job.dev};
+  devs.insert(devs.end(), job.stripe.devs.cbegin(), job.stripe.devs.cend());
+
+  // mappings and arrays remaining from a previous attempt keep their devices busy
+  if (!job.luks_name.empty() && fs::exists(Luks::mapper_dev(job.luks_name)))
+    log_warning_if(!Luks::close(job.luks_name), std::format("Failed to close {}", job.luks_name));
+
+  if (!job.md_dev.empty() && fs::exists(job.md_dev))
+    log_warning_if(!StopRaid{}(job.md_dev), std::format("Failed to stop {}", job.md_dev));
+
+  for (const auto& dev : devs)
+  {
+    if (!wipe_fs(dev))
+    {
+      log_error(std::format("Failed to wipe filesystem on {}", dev));
+      return false;
+    }
+
+    set_partition_type(dev, job.md_dev.empty() ? job.part_type : PartTypeRaid);
+  }
+
+  // the device the filesystem is created on
+  std::string fs_dev {job.dev};
+
+  if (!job.md_dev.empty())
+  {
+    log_info(std::format("Create {} {} from {}", raid_level_name(job.stripe.level), job.md_dev, flatten(devs)));
+
+    if (!CreateRaid{}(job.md_dev, raid_level_name(job.stripe.level), devs, [this](const std::string_view m){ log_info(m); }))
+    {
+      log_error(std::format("Failed to create {}", job.md_dev));
+      return false;
+    }
+
+    fs_dev = job.md_dev;
+  }
+
+  if (!job.luks_name.empty())
+  {
+    if (job.fs == "btrfs" && striped)
+    {
+      log_error("Encryption is not supported for a multi-device btrfs");
+      return false;
+    }
+    else if (!encrypt(fs_dev, job.dev, job.luks_name))
+      return false;
+
+    fs_dev = Luks::mapper_dev(job.luks_name);
+  }
+
+  bool created{};
+
+  if (!job.block_image.empty())
+    created = write_block_image(job.block_image, fs_dev);
+  else if (job.fs == "btrfs" && striped)
+  {
+    // metadata is small, so always mirror it, even if data is only striped
+    const auto data_profile = raid_level_name(job.stripe.level);
+    const auto meta_profile = job.stripe.level == RaidLevel::Raid0 ? raid_level_name(RaidLevel::Raid1) : data_profile;
+
+    log_info(std::format("Create btrfs ({} data, {} metadata) on {}", data_profile, meta_profile, flatten(devs)));
+    created = CreateFilesystem::btrfs(devs, data_profile, meta_profile);
+  }
+  else
+  {
+    log_info(std::format("Create {} on {}", job.fs, fs_dev));
+
+    if (job.fs == "vfat")
+      created = CreateFilesystem::vfat32(fs_dev);
+    else if (job.fs == "ext4")
+      created = CreateFilesystem::ext4(fs_dev);
+    else if (job.fs == "btrfs")
+      created = CreateFilesystem::btrfs(fs_dev);
+    else if (job.fs == "xfs")
+      created = CreateFilesystem::xfs(fs_dev, xfs_agcount(job.dev));
+    else if (job.fs == "f2fs")
+      created = CreateFilesystem::f2fs(fs_dev);
+  }
+
+  if (!created)
+    log_error(std::format("Failed to create {} on {}", job.fs, fs_dev));
+  else if (!job.subvolumes.empty())
+    created = create_btrfs_subvolumes(fs_dev, job.subvolumes);
+
+  return created;
+}
+
+bool Install::write_block_image(const fs::path& image, const std::string_view dev)
+{
+  log_info(std::format("Write {} to {}", image.string(), dev));
+
+  if (!BlockImage::deploy(image, dev, [this](const std::string_view m){ log_info(m); }, [this]{ return cancelled(); }))
+  {
+    log_error(std::format("Failed to write {} to {}", image.string(), dev));
+    return false;
+  }
+
+  log_info("Set filesystem UUID and grow to the partition");
+  return RestoreExt4{}(dev, [this](const std::string_view m){ log_info(m); });
+}
+
+unsigned Install::xfs_agcount(const std::string_view dev) const
+{
+  static const int64_t LargeSize = gb_to_b(1024);
+  static const unsigned MaxAgCount = 64;
+
+  // mkfs's default is fine for small devices, but large arrays on build servers have many
+  // concurrent writers, so use at least one allocation group per CPU
+  if (DiskUtils::get_partition_size(m_tree, dev) < LargeSize)
+    return 0;
+  else
+    return std::clamp(std::thread::hardware_concurrency(), 4U, MaxAgCount);
+}
+
+bool Install::wipe_fs(const std::string_view dev)
+{
+  log_info(std::format("Wipe filesystem on {}", dev));
+  return ReadCommand::execute(std::format ("wipefs -a -f {}", dev)) == CmdSuccess;
+}
+
+bool Install::create_btrfs_subvolumes(const std::string_view dev, const std::vector<std::string_view>& names)
+{
+  // each device is mounted to its own directory, rather than the mount root, so jobs don't
+  // depend on each other (i.e. home doesn't have to wait for root to be mounted)
+  const auto mount_point = fs::temp_directory_path() / "wali" / fs::path{dev}.filename();
+
+  if (std::string error; !MountUtils::mount(dev, mount_point.string(), "", error))
+  {
+    log_error(std::format("Failed to mount {} to create subvolumes: {}", dev, error));
+    return false;
+  }
+
+  bool created{true};
+
+  for (const auto name : names)
+  {
+    log_info(std::format("Create btrfs subvolume {} on {}", name, dev));
+
+    if (!Btrfs::create_subvolume(mount_point, name))
+    {
+      log_error(std::format("Failed to create subvolume {} on {}", name, dev));
+      created = false;
+      break;
+    }
+  }
+
+  if (std::string error; !MountUtils::unmount(mount_point.string(), error))
+    log_warning(std::format("Failed to unmount {}: {}", mount_point.string(), error));
+
+  std::error_code ec;
+  fs::remove(mount_point, ec);
+
+  return created;
+}
+
+void Install::set_partition_type(const std::string_view dev, const std::string_view type)
+{
+  const int part_num = DiskUtils::get_partition_part_number(m_tree, dev);
+  const auto parent_dev = DiskUtils::get_partition_disk(m_tree, dev);
+
+  log_info(std::format("Set partition type {} for {}", type, dev));
+
+  // sgdisk rewrites the partition table, so edits on the same disk can't overlap
+  std::scoped_lock lock{m_disk_locks[parent_dev]};
+
+  log_warning_if(!SetPartitionType{}(parent_dev, part_num, type), std::format("Set partition type failed on {}", dev));
+}
+
+bool Install::encrypt(const std::string_view dev, const std::string_view part, const std::string_view name)
+{
+  const auto& [cipher, key_bits, _] = m_luks_cipher;
+
+  log_info(std::format("Encrypt {} with {} {}-bit", dev, cipher, key_bits));
+
+  if (!Luks::format(dev, m_data->mounts.luks.passphrase, m_luks_cipher))
+  {
+    log_error(std::format("Failed to encrypt {}", dev));
+    return false;
+  }
+
+  // the partition, because an md array has no queue of its own to probe
+  const bool ssd = DiskUtils::is_ssd(m_tree, part);
+  const bool discard = DiskUtils::has_discard(m_tree, part);
+
+  log_info(std::format("Open {} as {}", dev, name));
+
+  if (!Luks::open(dev, name, m_data->mounts.luks.passphrase, ssd, discard))
+  {
+    log_error(std::format("Failed to open {}", dev));
+    return false;
+  }
+
+  return true;
+}
+
+// partition or md array
+std::string Install::root_base_dev() const
+{
+  const MountData& data = m_data->mounts;
+
+  // a multi-device btrfs can be mounted from any of its devices
+  return data.root_md() ? m_md_root : data.root_dev;
+}
+
+std::string Install::home_base_dev() const
+{
+  const MountData& data = m_data->mounts;
+
+  if (data.home_target == HomeMountTarget::Root)
+    return root_base_dev();
+  else
+    return data.home_md() ? m_md_home : data.home_dev;
+}
+
+// device containing the filesystem
+std::string Install::root_block_dev() const
+{
+  return m_data->mounts.luks.root ? Luks::mapper_dev(m_luks_root) : root_base_dev();
+}
+
+std::string Install::home_block_dev() const
+{
+  const MountData& data = m_data->mounts;
+
+  if (data.home_target == HomeMountTarget::Root)
+    return root_block_dev();
+  else
+    return data.home_target == HomeMountTarget::New && data.luks.home ? Luks::mapper_dev(m_luks_home) : home_base_dev();
+}
+
+// mount
+bool Install::mount()
+{
+  const MountData data = m_data->mounts;
+
+  auto btrfs_opts = [&](const std::string_view dev, const std::string_view subvol)
+  {
+    return std::format("{},subvol={}", mount_options("btrfs", dev), subvol);
+  };
+
+  bool mounted_root{}, mounted_boot{}, mounted_home{true}, mounted_subvols{true};
+
+  // compression applies during install, so reduces what pacstrap writes
+  const auto root_opts = data.root_fs == "btrfs" ? btrfs_opts(data.root_dev, "@") : mount_options(data.root_fs, data.root_dev);
+  mounted_root = do_mount(root_block_dev(), m_root_mnt.string(), root_opts);
+
+  if (mounted_root)
+  {
+    mounted_boot = do_mount(data.boot_dev, (m_root_mnt / "boot").string(), mount_options(data.boot_fs, data.boot_dev));
+
+    // for btrfs, we need an entry in fstab for @home subvolume, so we still mount
+    // even if home is on the root partition
+    if (data.home_target != HomeMountTarget::Root || data.home_fs == "btrfs")
+    {
+      // TODO this is incomplete: if existing partition is btrfs, we're assuming there's @home
+      //      subvolume
+      const auto home_opts = data.home_fs == "btrfs" ? btrfs_opts(data.home_dev, "@home") : mount_options(data.home_fs, data.home_dev);
+      mounted_home = do_mount(home_block_dev(), (m_root_mnt / "home").string(), home_opts);
+    }
+
+    if (data.root_fs == "btrfs")
+    {
+      // sorted so a parent is mounted before its children (i.e. @cache before @pkg)
+      auto subvols = data.btrfs.subvolumes;
+      rng::sort(subvols, std::less{}, &BtrfsSubvolume::path);
+
+      for (const auto& [name, path] : subvols)
+        mounted_subvols &= do_mount(root_block_dev(), (m_root_mnt / path).string(), btrfs_opts(data.root_dev, name));
+    }
+  }
+
+  return mounted_root && mounted_boot && mounted_home && mounted_subvols;
+}
+
+std::string Install::mount_options(const std::string_view fs, const std::string_view dev) const
+{
+  if (fs == "btrfs")
+    return Btrfs::mount_options(m_data->mounts.btrfs, DiskUtils::is_ssd(m_tree, dev), DiskUtils::has_discard(m_tree, dev));
+  else if (fs == "xfs")
+    return "noatime";
+  else if (fs == "f2fs")
+  {
+    // atgc/gc_merge: better garbage collection, compress_extension=*: compress all files
+    return "noatime,lazytime,compress_algorithm=zstd,compress_chksum,compress_extension=*,atgc,gc_merge";
+  }
+  else if (fs == "ext4")
+  {
+    // journal commit every 30s rather than 5s, fewer small writes at the risk of losing 30s on power loss
+    return "noatime,commit=30";
+  }
+  else if (fs == "vfat")
+  {
+    // the ESP holds the boot loader random seed, which bootctl requires is not world readable
+    return "noatime,fmask=0077,dmask=0077";
+  }
+  else
+    return "";
+}
+
+bool Install::unmount()
+{
+  log_info("Recursive unmount");
+  std::string error;
+  const bool unmounted = MountUtils::unmount_recursive(m_root_mnt.string(), error);
+  log_error_if(!unmounted, std::format("Unmount failed: {}", error));
+
+  // mappings before arrays, because an array may be beneath a mapping
+  for (const auto& name : {m_luks_root, m_luks_home})
+  {
+    if (fs::exists(Luks::mapper_dev(name)))
+      log_warning_if(!Luks::close(name), std::format("Failed to close {}", name));
+  }
+
+  for (const auto& md_dev : {m_md_root, m_md_home})
+  {
+    if (fs::exists(md_dev))
+      log_warning_if(!StopRaid{}(md_dev), std::format("Failed to stop {}", md_dev));
+  }
+
+  return unmounted;
+}
+
+bool Install::do_mount(const std::string_view dev, const std::string_view path, const std::string_view opts)
+{
+  log_info(std::format("Mount {} onto {} {}", path, dev, opts.empty() ? "" : std::format("with options {}", opts)));
+
+  // fstab uses the same options, rather than what the kernel reports (which includes defaults)
+  m_mount_options[std::string{path}] = opts;
+
+  std::string error;
+  const bool mounted = MountUtils::mount(dev, path, opts, error);
+  log_error_if(!mounted, std::format("Failed to mount {}: {}", path, error));
+
+  return mounted;
+}
+
+
+// pacman
+PackageSet Install::base_packages(const MountData& mounts, const CpuVendor cpu)
+{
+  static const PackageSet BasePackages =
+  {
+    "base",
+    "linux",
+    "linux-firmware",
+    "sudo",
+    "which",          // used in user_shell()
+    "nano",
+    "reflector",      // pacman mirrors list
+    "gpm"             // laptop touchpad support
+  };
+
+  // installed with the kernel so mkinitcpio's fsck hook includes them
+  static const std::map<std::string_view, std::string> FilesystemPackages =
+  {
+    {"vfat",  "dosfstools"},
+    {"btrfs", "btrfs-progs"},
+    {"xfs",   "xfsprogs"},
+    {"f2fs",  "f2fs-tools"}
+  };
+
+  PackageSet packages {BasePackages};
+
+  for (const auto& fs : {mounts.boot_fs, mounts.root_fs, mounts.home_fs})
+  {
+    if (FilesystemPackages.contains(fs))
+      packages.insert(FilesystemPackages.at(fs));
+  }
+
+  if (mounts.uses_md())
+    packages.insert("mdadm");
+
+  if (mounts.uses_luks())
+    packages.insert("cryptsetup");
+
+  if (cpu != CpuVendor::None)
+    packages.insert(cpu == CpuVendor::Amd ? "amd-ucode" : "intel-ucode");
+
+  return packages;
+}
+
+PackageSet Install::planned_packages(const WidgetData& data, const CpuVendor cpu)
+{
+  auto packages = base_packages(data.mounts, cpu);
+
+  if (data.mounts.boot_loader == Bootloader::Grub)
+    packages.insert({"grub", "efibootmgr", "os-prober"});
+
+  if (const auto& shell = data.accounts.user_shell; !shell.empty() && shell != "sh")
+    packages.insert(shell);
+
+  if (data.desktop.iwd)
+    packages.insert("iwd");
+
+  if (data.desktop.netmanager)
+    packages.insert("networkmanager");
+
+  if (data.mounts.zram)
+    packages.insert("zram-generator");
+
+  packages.insert(data.desktop.desktop.cbegin(), data.desktop.desktop.cend());
+  packages.insert(data.desktop.dm.cbegin(), data.desktop.dm.cend());
+  packages.insert(data.video.drivers.cbegin(), data.video.drivers.cend());
+  packages.insert(data.packages.additional.cbegin(), data.packages.additional.cend());
+
+  return packages;
+}
+
+bool Install::pacstrap()
+{
+  const auto packages = base_packages(m_data->mounts, SystemFacts::get()->cpu);
+
+  std::stringstream cmd_string;
+
+  if (package_cache.empty())
+    cmd_string << "pacstrap -K " <<  m_root_mnt.string() << ' ' << flatten(packages);
+  else
+  {
+    log_warning_if(!fetch_packages(packages), "Failed to download to the package cache");
+
+    // -c to use the host's cache rather than the target's, then override the host's with the shared cache
+    cmd_string << "pacstrap -K -c " <<  m_root_mnt.string() << ' ' << flatten(packages) << "--cachedir " << package_cache.string();
+  }
+
+  JobSlot slot {pacman_jobs, [this]{ return cancelled(); }};
+
+  if (!slot)
+    return false;
+
+  // pacstrap is actually a script, ultimately calling pacman
+  m_process = "pacman";
+
+  const int stat = ReadCommand::execute(cmd_string.str(), [this](const std::string_view m)
+  {
+    log_info(m);
+  });
+
+  if (stat != CmdSuccess)
+    log_error("Pacstrap encountered an error");
+
+  return stat == CmdSuccess;
+}
+
+bool Install::packages()
+{
+  log_info("Install additional packages");
+  install_packages(m_data->packages.additional);
+
+  if (m_data->mounts.root_fs == "btrfs")
+    btrfs_nodatacow();
+
+  return true;
+}
+
+void Install::btrfs_nodatacow()
+{
+  // done last rather than when mounting: if we create a directory before pacman, pacman
+  // keeps our owner/permissions rather than the package's (i.e. /var/lib/postgres)
+  for (const auto& dir : m_data->mounts.btrfs.nodatacow)
+  {
+    const auto path = m_root_mnt / dir;
+
+    if (!fs::is_directory(path))
+      continue;
+
+    log_info(std::format("Set nodatacow on /{}", dir));
+    log_warning_if(!Btrfs::set_nodatacow(path), std::format("Failed to set nodatacow on /{}", dir));
+  }
+}
+
+// Extracts a captured install instead of pacstrap. The parts are extracted concurrently,
+// with the mounts already created by the filesystems and mount stages.
+bool Install::deploy()
+{
+  const fs::path image_dir {m_data->archive.deploy};
+
+  ArchiveParts parts;
+  if (!GoldenImage::read_manifest(image_dir, parts))
+  {
+    log_error(std::format("Failed to read archive manifest in {}", image_dir.string()));
+    return false;
+  }
+
+  log_info(std::format("Deploy {} archives from {}", parts.size(), image_dir.string()));
+
+  m_process = "tar";
+
+  // the parts' output is interleaved, so serialise calls to the log handler
+  std::mutex log_mux;
+  auto handler = [this, &log_mux](const std::string_view m)
+  {
+    std::scoped_lock lck{log_mux};
+    log_info(m);
+  };
+
+  std::vector<std::future<bool>> extracts;
+  for (const auto& part : parts)
+  {
+    // written by the filesystems stage, without what the captured machine's (see capture())
+    if (GoldenImage::is_blocks(part))
+      continue;
+
+    log_info(std::format("Extract {} to /{}", part.file, part.dir == "." ? "" : part.dir));
+    extracts.emplace_back(std::async(std::launch::async, GoldenImage::extract, image_dir, m_root_mnt, part, handler));
+  }
+
+  bool ok = true;
+  for (auto& extract : extracts)
+    ok &= extract.get();
+
+  if (!ok)
+  {
+    log_error("Failed to extract archive");
+    return false;
+  }
+
+  // excluded when captured, so each machine has its own
+  if (ReadCommand::execute(std::format("systemd-machine-id-setup --root={}", m_root_mnt.string())) != CmdSuccess)
+    log_warning("Failed to create machine-id");
+
+  if (!init_keyring() || !lock_deployed_users())
+    return false;
+
+  if (m_data->mounts.root_fs == "btrfs")
+    btrfs_nodatacow();
+
+  return true;
+}
+
+// The keyring includes a private key, so it is generated rather than copied
+bool Install::init_keyring()
+{
+  log_info("Initialise pacman keyring");
+
+  Chroot chroot{m_root_mnt};
+  const bool init = chroot("pacman-key --init") && chroot("pacman-key --populate");
+  log_error_if(!init, "Failed to initialise pacman keyring");
+
+  return init;
+}
+
+// The archive's users are not in the answer file, so can't login. Locked before the
+// user stage, which runs even if the answer file has no user.
+bool Install::lock_deployed_users()
+{
+  Accounts accounts{m_root_mnt};
+
+  if (!accounts.load())
+  {
+    log_error("Failed to read account databases");
+    return false;
+  }
+
+  for (const auto& locked : accounts.lock_users_except(m_data->accounts.user_username))
+  {
+    log_info(std::format("Lock account for {}", locked));
+    accounts.set_group_member("wheel", locked, false);
+    remove_from_sudoers(locked);
+  }
+
+  const bool saved = accounts.save();
+  log_error_if(!saved, "Failed to write account databases");
+
+  return saved;
+}
+
+// The video, desktop and packages stages when deploying
+bool Install::deployed()
+{
+  log_info(std::format("Installed from {}", m_data->archive.deploy));
+  return true;
+}
+
+// The root's block image, if deploying one
+fs::path Install::root_block_image() const
+{
+  ArchiveParts parts;
+
+  if (deploying() && GoldenImage::read_manifest(m_data->archive.deploy, parts))
+  {
+    if (const auto it = rng::find_if(parts, [](const ArchivePart& part){ return part.dir == "." && GoldenImage::is_blocks(part); }); it != parts.end())
+      return fs::path{m_data->archive.deploy} / it->file;
+  }
+
+  return {};
+}
+
+// Archives a complete install, before it is unmounted
+bool Install::capture()
+{
+  const fs::path image_dir {m_data->archive.capture};
+
+  log_info(std::format("Capture install to {}", image_dir.string()));
+
+  std::error_code ec;
+  if (fs::create_directories(image_dir, ec); ec)
+  {
+    log_error(std::format("Failed to create {}: {}", image_dir.string(), ec.message()));
+    return false;
+  }
+
+  std::vector<std::string> mounts;
+  for (const auto& path : m_mount_options | std::views::keys)
+    mounts.emplace_back(fs::path{path}.lexically_relative(m_root_mnt).string());
+
+  const auto parts = GoldenImage::plan(mounts, m_data->archive.blocks);
+
+  // the root's blocks are captured as they are, so what the tar parts exclude is removed
+  // before the root is frozen, freeing its blocks so they aren't read. The machine's
+  // files are restored after, so this install is still complete.
+  const bool root_blocks = rng::any_of(parts, GoldenImage::is_blocks);
+  MachineFiles machine_files;
+
+  if (root_blocks)
+  {
+    // otherwise the shared cache, bound onto the root's, would be emptied
+    if (!unshare_package_cache())
+    {
+      log_error("Failed to unmount the shared package cache");
+      return false;
+    }
+
+    log_info("Remove files specific to this machine from root");
+    machine_files = GoldenImage::read_machine_files(m_root_mnt);
+    GoldenImage::clean(m_root_mnt);
+
+    // discarded, so the freed blocks (i.e. host keys) don't remain on the device
+    log_warning_if(LoopDevice::trim(m_root_mnt) < 0, "Failed to discard the removed files");
+  }
+
+  m_process = "tar";
+
+  std::mutex log_mux;
+  auto handler = [this, &log_mux](const std::string_view m)
+  {
+    std::scoped_lock lck{log_mux};
+    log_info(m);
+  };
+
+  std::vector<std::future<bool>> captures;
+  for (const auto& part : parts)
+  {
+    log_info(std::format("Archive /{} to {}", part.dir == "." ? "" : part.dir, part.file));
+
+    // frozen while mounted, so the other parts (mounted beneath) are captured at the same time
+    if (GoldenImage::is_blocks(part))
+    {
+      captures.emplace_back(std::async(std::launch::async, BlockImage::capture, root_block_dev(), image_dir / part.file, m_root_mnt,
+                                       handler, [this]{ return cancelled(); }));
+    }
+    else
+      captures.emplace_back(std::async(std::launch::async, GoldenImage::capture, m_root_mnt, image_dir, part, handler));
+  }
+
+  bool ok = true;
+  for (auto& capture : captures)
+    ok &= capture.get();
+
+  // after the root is thawed
+  if (root_blocks)
+  {
+    log_info("Restore files specific to this machine");
+
+    if (!GoldenImage::restore_machine_files(machine_files) || !init_keyring())
+    {
+      log_error("Failed to restore the captured install");
+      m_state = InstallState::Partial;
+    }
+  }
+
+  // the manifest is written last, so a failed capture isn't an image (see GoldenImage::is_image())
+  if (!ok || !GoldenImage::write_manifest(image_dir, parts))
+  {
+    log_error("Failed to capture install");
+    return false;
+  }
+
+  return true;
+}
+
+bool Install::install_packages(const PackageSet& packages)
+{
+  if (packages.empty())
+    return true;
+
+  log_info(std::format("Packages: {}", packages.size()));
+
+  // pacman in the chroot downloads what isn't already in the cache
+  log_warning_if(!fetch_packages(packages), "Failed to download to the package cache");
+
+  JobSlot slot {pacman_jobs, [this]{ return cancelled(); }};
+
+  if (!slot)
+    return false;
+
+  m_process = "pacman";
+
+  // --needed: stages may request the same package (i.e. iwd), or it is in a deployed archive
+  std::stringstream ss;
+  ss << "pacman -S --needed --noconfirm " << flatten(packages);
+
+  const auto ok = Chroot{m_root_mnt}(ss.str(), [this](const std::string_view m){ log_info(m);});
+  log_error_if(!ok, "pacman failed to install package(s)");
+
+  return ok;
+}
+
+// Downloads to the shared cache with the host's pacman, so concurrent installs don't
+// download the same packages, or write the same file in the cache at once. Not killed
+// if cancelled, because other installs may be waiting for the same packages.
+bool Install::fetch_packages(const PackageSet& packages)
+{
+  if (package_cache.empty() || packages.empty())
+    return true;
+
+  JobSlot slot {fetch_jobs, [this]{ return cancelled(); }};
 
-  bool volumes_created{true};
+  if (!slot)
+    return false;
 
-  const bool fs_created = create_boot_filesystem() && create_root_filesystem() && create_home_filesystem();
+  log_info(std::format("Download {} packages to {}", packages.size(), package_cache.string()));
 
-  if (fs_created)
-  {
-    // need to mount devices to create subvolumes
-    bool mounted_home{true}, mounted_root{false};
+  // an empty database, otherwise dependencies installed on the host are skipped, then
+  // downloaded by pacstrap and pacman to the shared cache concurrently
+  std::string db_template {(fs::temp_directory_path() / "wali-fetch-XXXXXX").string()};
 
-    if (data.root_fs == "btrfs")
-    {
-      mounted_root = Mount{}(data.root_dev, RootMnt.string());
-      volumes_created = mounted_root && create_btrfs_subvolume(RootMnt, "@");
-    }
+  if (!::mkdtemp(db_template.data()))
+  {
+    log_error(std::format("Failed to create package database directory: {}", ::strerror(errno)));
+    return false;
+  }
 
-    if (data.home_target != HomeMountTarget::Root)
-      mounted_home = Mount{}(data.home_dev, HomeMnt.string());
+  const fs::path db_dir {db_template};
 
-    // don't create subvolume, we assume it already exists (and is name @home)
-    // TODO this shouldn't assume existing subvol is @home
-    if (data.home_fs == "btrfs" && mounted_home && data.home_target != HomeMountTarget::Existing)
-      volumes_created &= create_btrfs_subvolume(HomeMnt, "@home");
+  // packages already in the cache are not downloaded again
+  const auto cmd = std::format("pacman -Syw --noconfirm --root {0} --dbpath {0} --logfile {1} --cachedir {2} {3}",
+                                db_dir.string(), (db_dir / "pacman.log").string(), package_cache.string(), flatten(packages));
+  const bool fetched = ReadCommand::execute(cmd, [this](const std::string_view m){ log_info(m); }) == CmdSuccess;
 
-    if (mounted_root)
-      unmount(); // recursive
-  }
+  std::error_code ec;
+  fs::remove_all(db_dir, ec);
 
-  return fs_created && volumes_created;
+  return fetched;
 }
 
-bool Install::wipe_fs(const std::string_view dev)
+// The target's pacman uses its own cache, so bind mount the shared cache over it
+bool Install::share_package_cache()
 {
-  log_info(std::format("Wipe filesystem on {}", dev));
-  return ReadCommand::execute(std::format ("wipefs -a -f {}", dev)) == CmdSuccess;
-}
+  if (package_cache.empty())
+    return true;
 
-bool Install::create_boot_filesystem()
-{
-  const MountData& data = m_data->mounts;
+  const auto target_cache = m_root_mnt / "var/cache/pacman/pkg";
 
-  wipe_fs(data.boot_dev);
+  log_info(std::format("Bind {} onto {}", package_cache.string(), target_cache.string()));
 
-  set_partition_type(data.boot_dev, PartTypeEfi);
+  std::string error;
+  m_cache_shared = MountUtils::mount(package_cache.string(), target_cache.string(), "bind", error);
+  log_warning_if(!m_cache_shared, std::format("Failed to share package cache: {}", error));
 
-  log_info(std::format("Create vfat32 on {}", data.boot_dev));
-  return CreateFilesystem::vfat32(data.boot_dev);
+  return m_cache_shared;
 }
 
-bool Install::create_root_filesystem()
+
+bool Install::unshare_package_cache()
 {
-  const MountData& data = m_data->mounts;
+  if (!m_cache_shared)
+    return true;
 
-  wipe_fs(data.root_dev);
+  const auto target_cache = m_root_mnt / "var/cache/pacman/pkg";
 
-  set_partition_type(data.root_dev, PartTypeRoot);
+  log_info(std::format("Unmount {}", target_cache.string()));
 
-  if (data.root_fs == "ext4")
-    return create_ext4_filesystem(data.root_dev);
-  else
-    return create_btrfs_filesystem(data.root_dev) ;
+  std::string error;
+  m_cache_shared = !MountUtils::unmount(target_cache.string(), error);
+  log_error_if(m_cache_shared, std::format("Failed to unmount package cache: {}", error));
+
+  return !m_cache_shared;
 }
 
-bool Install::create_home_filesystem()
+
+// fstab
+bool Install::fstab ()
 {
-  bool home_valid{true};
+  log_info("Read mounts");
 
-  const MountData& data = m_data->mounts;
+  auto entries = Fstab::read(m_root_mnt);
 
-  if (data.home_target == HomeMountTarget::Existing)
-    log_info(std::format("/home -> {}", data.home_dev));
-  else if(data.home_target == HomeMountTarget::Root)
-    log_info(std::format("/home -> {} with {}", data.root_dev, data.root_fs));
-  else
+  if (entries.empty())
   {
-    const auto home_dev = data.home_dev;
-    const auto home_fs = data.home_fs;
+    log_error(std::format("No mounts found below {}", m_root_mnt.string()));
+    return false;
+  }
+
+  // btrfs and f2fs discard inline (async), others are trimmed periodically instead
+  const bool trim_timer = rng::any_of(entries, [](const FstabEntry& entry){ return entry.fstype != "btrfs" && entry.fstype != "f2fs"; });
 
-    wipe_fs(home_dev);
+  Fstab::prepare(entries, m_root_mnt, m_mount_options, mount_options("btrfs", m_data->mounts.root_dev), [this](const std::string& dev)
+  {
+    return DiskUtils::get_partition_uuid(m_tree, dev);
+  });
 
-    // new partition
-    log_info(std::format("/home -> {} with {}", home_dev, home_fs));
+  for (const auto& entry : entries)
+  {
+    if (entry.source.starts_with("/dev/"))
+      log_warning(std::format("No UUID for {}, using device path", entry.source));
 
-    if (!wipe_fs(home_dev))
-      return false;
+    log_info(std::format("{} -> {} ({})", entry.target, entry.source, entry.options));
+  }
+
+  const auto fstab_path = m_root_mnt / "etc/fstab";
 
-    home_valid = home_fs == "ext4" ?  create_ext4_filesystem(home_dev) :
-                                      create_btrfs_filesystem(home_dev);
+  log_info(std::format("Write {}", fstab_path.string()));
 
-    set_partition_type(home_dev, PartTypeHome);
+  if (!Fstab::write(fstab_path, entries))
+  {
+    log_error("Failed to write fstab");
+    return false;
   }
 
-  return home_valid;
-}
+  // after the fstab is written, otherwise it would be in the installed system's fstab
+  share_package_cache();
 
-bool Install::create_ext4_filesystem(const std::string_view dev)
-{
-  log_info(std::format("Create ext4 on {}", dev));
-  return CreateFilesystem::ext4(dev);
-}
+  if (trim_timer && (DiskUtils::has_discard(m_tree, m_data->mounts.root_dev) || DiskUtils::has_discard(m_tree, m_data->mounts.home_dev)))
+    log_warning_if(!enable_service({"fstrim.timer"}), "Failed to enable periodic trim");
 
-bool Install::create_btrfs_filesystem(const std::string_view dev)
-{
-  log_info(std::format("Create btrfs on {}", dev));
-  return CreateFilesystem::btrfs(dev);
+  return true;
 }
 
-bool Install::create_btrfs_subvolume(const fs::path mount_point, const std::string_view name)
+// initramfs
+bool Install::initramfs()
 {
-  const auto path = (mount_point / name).string();
+  // the default hooks are sufficient, unless the root or home is on an md array or encrypted
+  std::vector<std::string_view> hooks;
 
-  log_info(std::format("Create btrfs subvolume {}", path));
-  return CreateBtrfsSubVolume{}(path);
-}
+  if (m_data->mounts.uses_md())
+  {
+    if (!raid_config())
+      return false;
 
-void Install::set_partition_type(const std::string_view dev, const std::string_view type)
-{
-  const int part_num = DiskUtils::get_partition_part_number(m_tree, dev);
-  const auto parent_dev = DiskUtils::get_partition_disk(m_tree, dev);
+    hooks.push_back("mdadm_udev");
+  }
 
-  log_info(std::format("Set partition type {} for {}", type, dev));
+  // root is unlocked by the initramfs, home by systemd-cryptsetup after switching root
+  if (m_data->mounts.luks.root)
+    hooks.push_back(is_systemd_initramfs() ? "sd-encrypt" : "encrypt");
 
-  log_warning_if(!SetPartitionType{}(parent_dev, part_num, type), std::format("Set partition type failed on {}", dev));
+  if (m_data->mounts.uses_luks() && !crypttab())
+    return false;
+
+  // a deployed initramfs was generated for the captured machine (autodetect hook)
+  if (hooks.empty() && !deploying())
+  {
+    log_info("Default hooks are sufficient");
+    return true;
+  }
+
+  if (!hooks.empty() && !add_initramfs_hooks(hooks))
+    return false;
+
+  log_info("Generate initramfs");
+
+  m_process = "mkinitcpio";
+
+  const bool generated = Chroot{m_root_mnt}("mkinitcpio -P", [this](const std::string_view m){ log_info(m); });
+  log_error_if(!generated, "mkinitcpio failed");
+
+  return generated;
 }
 
-// mount
-bool Install::mount()
+bool Install::raid_config()
 {
-  const MountData data = m_data->mounts;
+  const fs::path MdadmConfPath {m_root_mnt / "etc/mdadm.conf"};
 
-  bool mounted_root{}, mounted_boot{}, mounted_home{true};
+  log_info("Create mdadm.conf");
 
-  const std::string_view root_opts = data.root_fs == "btrfs" ? "subvol=@" : "";
-  mounted_root = do_mount(data.root_dev, RootMnt.string(), root_opts);
+  std::vector<std::string> md_devs;
 
-  if (mounted_root)
+  if (root_base_dev() == m_md_root)
+    md_devs.push_back(m_md_root);
+
+  if (home_base_dev() == m_md_home)
+    md_devs.push_back(m_md_home);
+
+  const auto arrays = GetRaidConfig{}(md_devs);
+
+  if (arrays.empty())
   {
-    mounted_boot = do_mount(data.boot_dev, BootMnt.string());
+    log_error("Failed to read md array config");
+    return false;
+  }
 
-    // for btrfs, we need an entry in fstab for @home subvolume, so we still mount
-    // even if home is on the root partition
-    if (data.home_target != HomeMountTarget::Root || data.home_fs == "btrfs")
-    {
-      // TODO this is incomplete: if existing partition is btrfs, we're assuming there's @home
-      //      subvolume
-      const auto home_opts = data.home_fs == "btrfs" ? "subvol=@home" : "" ;
-      mounted_home = do_mount(data.home_dev, HomeMnt.string(), home_opts);
-    }
+  std::ofstream stream{MdadmConfPath, std::ios_base::out | std::ios_base::app};
+
+  for (const auto& array : arrays)
+  {
+    log_info(array);
+    stream << array << '\n';
   }
 
-  return mounted_root && mounted_boot && mounted_home;
-}
+  log_error_if(!stream, "Failed to write mdadm.conf");
 
-bool Install::unmount()
-{
-  log_info("Recursive unmount");
-  return Unmount{}(RootMnt.string(), true);
+  return stream.good();
 }
 
-bool Install::do_mount(const std::string_view dev, const std::string_view path, const std::string_view opts)
+bool Install::crypttab()
 {
-  log_info(std::format("Mount {} onto {} {}", path, dev, opts.empty() ? "" : std::format("with options {}", opts)));
-  return Mount{}(dev, path, opts);
-}
+  const fs::path CrypttabPath {m_root_mnt / "etc/crypttab"};
+
+  const MountData& data = m_data->mounts;
 
+  if (!data.luks.home || data.home_target != HomeMountTarget::New)
+    return true;
 
-// pacman
-bool Install::pacstrap()
-{
-  static PackageSet packages =
+  const auto uuid = DiskUtils::get_partition_uuid(m_tree, home_base_dev());
+
+  if (uuid.empty())
   {
-    "base",
-    "linux",
-    "linux-firmware",
-    "sudo",
-    "which",          // used in user_shell()
-    "nano",
-    "reflector",      // pacman mirrors list
-    "gpm"             // laptop touchpad support
-  };
+    log_error("Failed to get UUID of encrypted home");
+    return false;
+  }
 
-  if (const auto vendor = GetCpuVendor{}(); vendor != CpuVendor::None)
-    packages.insert(vendor == CpuVendor::Amd ? "amd-ucode" : "intel-ucode");
+  log_info(std::format("Add {} to crypttab", LuksHomeName));
 
-  std::stringstream cmd_string;
-  cmd_string << "pacstrap -K " <<  RootMnt.string() << ' ';
-  cmd_string << flatten(packages);
+  // performance flags and discard are stored in the LUKS2 header (--persistent)
+  std::ofstream stream{CrypttabPath, std::ios_base::out | std::ios_base::app};
+  stream << std::format("{}\tUUID={}\tnone\tluks\n", LuksHomeName, uuid);
 
-  // pacstrap is actually a script, ultimately calling pacman
-  m_process = "pacman";
+  log_error_if(!stream, "Failed to write crypttab");
 
-  const int stat = ReadCommand::execute(cmd_string.str(), [this](const std::string_view m)
+  return stream.good();
+}
+
+// HOOKS=(base udev autodetect ... block filesystems fsck)
+static std::vector<std::string> parse_initramfs_hooks(const std::string_view line)
+{
+  std::vector<std::string> hooks;
+
+  const auto open = line.find('('), close = line.find(')');
+
+  if (open == std::string_view::npos || close == std::string_view::npos)
+    return hooks;
+
+  for (const auto hook : line.substr(open+1, close-open-1) | view::split(' '))
   {
-    log_info(m);
-  });
+    if (!hook.empty())
+      hooks.emplace_back(std::string_view{hook});
+  }
 
-  if (stat != CmdSuccess)
-    log_error("Pacstrap encountered an error");
+  return hooks;
+}
 
-  return stat == CmdSuccess;
+std::vector<std::string> Install::read_initramfs_hooks() const
+{
+  std::ifstream stream{m_root_mnt / "etc/mkinitcpio.conf"};
+
+  for (std::string line; std::getline(stream, line); )
+  {
+    if (line.starts_with("HOOKS=("))
+      return parse_initramfs_hooks(line);
+  }
+
+  return {};
 }
 
-bool Install::packages()
+// The systemd hook requires sd-encrypt and rd.luks kernel params, otherwise encrypt and cryptdevice
+bool Install::is_systemd_initramfs() const
 {
-  log_info("Install additional packages");
-  install_packages(m_data->packages.additional);
-  return true;
+  return rng::contains(read_initramfs_hooks(), "systemd");
 }
 
-bool Install::install_packages(const PackageSet& packages)
+bool Install::add_initramfs_hooks(const std::vector<std::string_view>& hooks)
 {
-  if (packages.empty())
-    return true;
+  const fs::path ConfigPath {m_root_mnt / "etc/mkinitcpio.conf"};
 
-  log_info(std::format("Packages: {}", packages.size()));
+  std::vector<std::string> lines;
 
-  std::stringstream ss;
-  ss << "pacman -S --noconfirm " << flatten(packages);
+  {
+    std::ifstream stream{ConfigPath};
+    for (std::string line; std::getline(stream, line); )
+      lines.push_back(std::move(line));
+  }
 
-  const auto ok = Chroot{}(ss.str(), [this](const std::string_view m){ log_info(m);});
-  log_error_if(!ok, "pacman failed to install package(s)");
+  auto it = rng::find_if(lines, [](const std::string& line){ return line.starts_with("HOOKS=("); });
 
-  return ok;
-}
+  if (it == lines.end())
+  {
+    log_error("mkinitcpio.conf does not contain HOOKS");
+    return false;
+  }
 
+  if (it->find(')') == std::string::npos)
+  {
+    log_error("mkinitcpio.conf HOOKS is not on one line");
+    return false;
+  }
 
-// fstab
-bool Install::fstab ()
-{
-  fs::create_directory((RootMnt / FsTabPath).parent_path());
+  auto current = parse_initramfs_hooks(*it);
+
+  // each hook must run before filesystems, which mounts root
+  for (const auto hook : hooks)
+  {
+    if (rng::contains(current, hook))
+      continue;
 
-  const auto cmd_string = std::format("genfstab -U {} > {}", RootMnt.string(), FsTabPath.string());
+    log_info(std::format("Add {} hook", hook));
+    current.insert(rng::find(current, "filesystems"), std::string{hook});
+  }
 
-  log_info(cmd_string);
+  auto flat = flatten(current);
+  flat.pop_back(); // trailing separator
 
-  const auto stat = ReadCommand::execute(cmd_string);
-  log_error_if(stat != CmdSuccess, std::format("genfstab failed: {}", ::strerror(stat)));
+  *it = std::format("HOOKS=({})", flat);
 
-  return stat == CmdSuccess;
+  const bool written = FileOps::write(ConfigPath, flatten(lines, '\n'));
+  log_error_if(!written, "Failed to write mkinitcpio.conf");
+
+  return written;
 }
 
+
 // accounts
 bool Install::root_account()
 {
   const auto& root_password = m_data->accounts.root_pass;
 
-  bool set{};
   if (root_password.empty())
+  {
     log_error("Root password empty");
-  else
-    set = set_password("root", root_password);
+    return false;
+  }
+
+  log_info("Set password for root");
+
+  Accounts accounts{m_root_mnt};
+
+  const bool set = accounts.load() && accounts.set_password("root", root_password) && accounts.save();
+  log_error_if(!set, "Failed to set root password");
 
   return set;
 }
@@ -460,29 +1614,53 @@ bool Install::user_account()
     return false;
   }
 
-  log_info(std::format("Create account for {}", user));
+  Accounts accounts{m_root_mnt};
 
-  const std::string_view wheel_group = user_sudo ? "-G wheel" : "";
+  // installed first, so the account is created with the shell's path. Loaded after, because
+  // pacman's hooks (sysusers, shells) edit passwd and group, which save() would overwrite
+  const auto shell = user_shell(accounts);
 
-  if (!Chroot{}(std::format("useradd -s /usr/bin/bash -m {} {}", wheel_group, user)))
-    log_warning("Failed to create user account");
+  if (!accounts.load())
+  {
+    log_error("Failed to read account databases");
+    return false;
+  }
 
-  if (!set_password(user, password))
-    log_warning("Failed to set user password"); // TODO should fail?
+  std::vector<std::string_view> groups;
+  if (user_sudo)
+    groups.push_back("wheel");
 
-  if (user_sudo && !add_to_sudoers(user))
-    log_warning("Failed to allow user to sudo");
+  // a deployed archive may have the user, so apply the answer file's shell and groups
+  const bool exists = accounts.has_user(user);
 
-  user_shell();
+  if (exists)
+  {
+    log_info(std::format("Account for {} exists, set shell and groups", user));
 
-  return true;
-}
+    if (!accounts.set_shell(user, shell) || !accounts.set_group_member("wheel", user, user_sudo))
+      log_warning("Failed to set user shell or groups");
+  }
+  else
+    log_info(std::format("Create account for {}", user));
 
-bool Install::set_password(const std::string_view user, const std::string_view pass)
-{
-  log_info(std::format("Set password for {}", user));
+  if (!exists && !accounts.add_user(user, shell, groups))
+    log_warning("Failed to create user account");
+  else if (log_info(std::format("Set password for {}", user)); !accounts.set_password(user, password))
+    log_warning("Failed to set user password"); // TODO should fail?
+
+  if (deploying() && exists && !user_sudo)
+    remove_from_sudoers(user);
+
+  if (!accounts.save())
+  {
+    log_error("Failed to write account databases");
+    return false;
+  }
+
+  if (user_sudo && !(exists && has_sudoers(user)) && !add_to_sudoers(user))
+    log_warning("Failed to allow user to sudo");
 
-  return ChrootWrite{}(std::format("echo \"{}:{}\" | chpasswd", user, pass));
+  return true;
 }
 
 bool Install::add_to_sudoers (const std::string_view user)
@@ -492,7 +1670,7 @@ bool Install::add_to_sudoers (const std::string_view user)
   // note: user added to wheel group by user_account()
 
   static const fs::perms SudoersFilePerms = fs::perms::owner_read | fs::perms::group_read;
-  static const fs::path SudoersDir{RootMnt / "etc/sudoers.d"};
+  const fs::path SudoersDir {m_root_mnt / "etc/sudoers.d"};
 
   // the directory should be empty, but sanity check
   const auto count = std::distance(fs::directory_iterator{SudoersDir}, fs::directory_iterator{});
@@ -512,22 +1690,58 @@ bool Install::add_to_sudoers (const std::string_view user)
   return true;
 }
 
-void Install::user_shell()
+bool Install::has_sudoers(const std::string_view user)
+{
+  const auto suffix = std::format("_{}", user);
+
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator{m_root_mnt / "etc/sudoers.d", ec})
+  {
+    if (entry.path().filename().string().ends_with(suffix))
+      return true;
+  }
+
+  return false;
+}
+
+void Install::remove_from_sudoers(const std::string_view user)
+{
+  // only files named as add_to_sudoers() does
+  const auto suffix = std::format("_{}", user);
+
+  std::vector<fs::path> files;
+
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator{m_root_mnt / "etc/sudoers.d", ec})
+  {
+    if (entry.path().filename().string().ends_with(suffix))
+      files.push_back(entry.path());
+  }
+
+  for (const auto& file : files)
+  {
+    log_info(std::format("Removing {} from sudoers", user));
+    fs::remove(file, ec);
+  }
+}
+
+std::string Install::user_shell(const Accounts& accounts)
 {
+  static const auto DefaultShell = "/usr/bin/bash";
+
   const auto& shell = m_data->accounts.user_shell;
-  const auto& username = m_data->accounts.user_username;
 
   log_info(std::format("Set user shell: {}", shell));
 
-  if (shell == "sh" || install_packages({shell}))
-  {
-    std::string path;
-    const bool have_path = Chroot{}(std::format("which {}", shell), [&](const std::string_view m){ path = m; });
+  if (shell != "sh" && !install_packages({shell}))
+    return DefaultShell;
 
-    if (have_path && !path.empty())
-      log_warning_if(!Chroot{}(std::format("chsh -s {} {}", path, username)), "Failed to set user shell");
-    else
-      log_warning("Failed to get path of installed shell");
+  if (auto path = accounts.find_shell(shell); !path.empty())
+    return path;
+  else
+  {
+    log_warning("Failed to get path of installed shell");
+    return DefaultShell;
   }
 }
 
@@ -558,9 +1772,11 @@ bool Install::boot_loader_grub()
 
   // install
   log_info("Run grub-install");
-  const auto install_cmd = std::format("grub-install --target=x86_64-efi --efi-directory=/boot --boot-directory=/boot --bootloader-id=GRUB");
+  // an image boots on another machine, so it uses the fallback path rather than this machine's EFI variables
+  const auto image_args = m_loop_dev.empty() ? "" : " --removable --no-nvram";
+  const auto install_cmd = std::format("grub-install --target=x86_64-efi --efi-directory=/boot --boot-directory=/boot --bootloader-id=GRUB{}", image_args);
 
-  if (!Chroot{}(install_cmd))
+  if (!Chroot{m_root_mnt}(install_cmd))
   {
     log_error("grub-install failed");
     return false;
@@ -569,15 +1785,19 @@ bool Install::boot_loader_grub()
   // configure
   log_info("Configure grub");
 
-  fs::create_directory(BootMnt / "grub"); // outside of arch-chroot, so full path required: /mnt/boot/grub
-  return Chroot{}(std::format("grub-mkconfig -o {}", EfiConfigTarget.string()));
+  // a deployed archive has the captured machine's parameters, even if root isn't encrypted
+  if ((m_data->mounts.luks.root || deploying()) && !set_grub_cmdline(luks_kernel_params()))
+    return false;
+
+  fs::create_directory(m_root_mnt / "boot/grub"); // outside of arch-chroot, so full path required
+  return Chroot{m_root_mnt}(std::format("grub-mkconfig -o {}", EfiConfigTarget.string()));
 }
 
 
 bool Install::boot_loader_sysdboot()
 {
-  static const fs::path LoaderConfig {BootMnt / "loader/loader.conf"};
-  static const fs::path EntriesFile {BootMnt / "loader/entries/arch.conf"};
+  const fs::path LoaderConfig {m_root_mnt / "boot" / "loader/loader.conf"};
+  const fs::path EntriesFile {m_root_mnt / "boot" / "loader/entries/arch.conf"};
   static const auto LoaderConfigContent = "default  arch.conf\n"
                                           "timeout  4\n"
                                           "console-mode max\n"
@@ -589,15 +1809,18 @@ bool Install::boot_loader_sysdboot()
 
   log_info("Run bootctl");
 
-  const auto root_uuid = DiskUtils::get_partition_uuid(m_tree, m_data->mounts.root_dev);
+  const auto root_uuid = DiskUtils::get_partition_uuid(m_tree, root_block_dev());
   if (root_uuid.empty())
   {
     log_error("Failed to get boot partition UUID");
     return false;
   }
 
-  // this installs the boot manager to /mnt/boot/EFI/[systemd,BOOT]
-  if (!Chroot{}("bootctl install"))
+  // as grub, an image doesn't set this machine's EFI variables
+  const auto install_cmd = m_loop_dev.empty() ? "bootctl install" : "bootctl install --no-variables";
+
+  // this installs the boot manager to <root>/boot/EFI/[systemd,BOOT]
+  if (!Chroot{m_root_mnt}(install_cmd))
   {
     log_error("bootctl failed to install the boot manager");
     return false;
@@ -633,10 +1856,10 @@ bool Install::boot_loader_sysdboot()
     if (m_data->mounts.root_fs == "btrfs")
       root_flags = "rootflags=subvol=@";
 
-    entry_stream << EntryContent <<  "options root=UUID=" << root_uuid << " " << root_flags << " rw\n";
+    entry_stream << EntryContent <<  "options " << luks_kernel_params() << "root=UUID=" << root_uuid << " " << root_flags << " rw\n";
     entry_stream.close();
 
-    ok = Chroot{}("bootctl install");
+    ok = Chroot{m_root_mnt}(install_cmd);
     log_error_if(!ok, "bootctl failed to parse config");
   }
 
@@ -644,13 +1867,72 @@ bool Install::boot_loader_sysdboot()
 }
 
 
+// parameters for the initramfs to unlock root, with a trailing space if not empty
+std::string Install::luks_kernel_params() const
+{
+  if (!m_data->mounts.luks.root)
+    return {};
+
+  const auto uuid = DiskUtils::get_partition_uuid(m_tree, root_base_dev());
+
+  if (is_systemd_initramfs())
+    return std::format("rd.luks.name={}={} ", uuid, LuksRootName);
+  else
+    return std::format("cryptdevice=UUID={}:{} ", uuid, LuksRootName);
+}
+
+bool Install::set_grub_cmdline(const std::string_view params)
+{
+  const fs::path ConfigPath {m_root_mnt / "etc/default/grub"};
+  static const std::string_view Key {"GRUB_CMDLINE_LINUX=\""};
+
+  std::vector<std::string> lines;
+  bool set{};
+
+  {
+    std::ifstream stream{ConfigPath};
+    for (std::string line; std::getline(stream, line); )
+    {
+      if (line.starts_with(Key))
+      {
+        // a deployed archive has the captured machine's, which are always first (see luks_kernel_params())
+        while (line.substr(Key.size()).starts_with("cryptdevice=") || line.substr(Key.size()).starts_with("rd.luks.name="))
+        {
+          // the last parameter ends at the closing quote, which is kept
+          const auto end = line.find_first_of(" \"", Key.size());
+
+          if (end == std::string::npos)
+            line.erase(Key.size());
+          else
+            line.erase(Key.size(), end - Key.size() + (line[end] == ' ' ? 1 : 0));
+        }
+
+        line.insert(Key.size(), params);
+        set = true;
+      }
+
+      lines.push_back(std::move(line));
+    }
+  }
+
+  if (!set)
+    lines.push_back(std::format("{}{}\"", Key, params));
+
+  const bool written = FileOps::write(ConfigPath, flatten(lines, '\n'));
+  log_error_if(!written, "Failed to write grub config");
+
+  return written;
+}
+
+
 // localise
 bool Install::localise()
 {
   static const fs::path TimezonePath{"/usr/share/zoneinfo/"};
-  static const fs::path LocaleGen{"/etc/locale.gen"};
-  static const fs::path LocaleConf{"/etc/locale.conf"};
-  static const fs::path TerminalConf{"/etc/vconsole.conf"};
+  const fs::path LocaleGen {m_root_mnt / "etc/locale.gen"};
+  const fs::path LocaleConf {m_root_mnt / "etc/locale.conf"};
+  const fs::path TerminalConf {m_root_mnt / "etc/vconsole.conf"};
+  const fs::path LocalTime {m_root_mnt / "etc/localtime"};
 
   const auto& [zone, locale, keymap] = m_data->localise;
 
@@ -658,18 +1940,17 @@ bool Install::localise()
   {
     log_info("Update locale.gen");
 
-    // NOTE: appending is a bit lazy, and perhaps not obvious to future readers
-    if (!ChrootWrite{}(std::format("echo \"{} UTF-8\" >> {}", locale, LocaleGen.string())))
+    if (!FileOps::append_if_missing(LocaleGen, std::format("{} UTF-8", locale)))
       log_warning(std::format("Failed to update {}", LocaleGen.string()));
     else
     {
-      if (log_info("Generate locales"); !Chroot{}("locale-gen"))
+      if (log_info("Generate locales"); !Chroot{m_root_mnt}("locale-gen"))
         log_warning("locale-gen failed");
       else
       {
         log_info("Set locale");
 
-        const auto set_locale = ChrootWrite{}(std::format("echo \"LANG={}\" >> {}", locale, LocaleConf.string()));
+        const auto set_locale = FileOps::write(LocaleConf, std::format("LANG={}\n", locale));
         log_warning_if(!set_locale, std::format("Failed to update {}", LocaleConf.string()));
       }
     }
@@ -678,7 +1959,9 @@ bool Install::localise()
   if (!zone.empty())
   {
     log_info("Set timezone");
-    if (!Chroot{}(std::format("ln -sf {} /etc/localtime", (TimezonePath / zone).string())))
+
+    // link target is within the installed system
+    if (!FileOps::symlink(TimezonePath / zone, LocalTime))
       log_warning("Failed to set locale timezone");
     else if (log_info("Syncing clock"); ReadCommand::execute("hwclock --systohc") != CmdSuccess)
       log_warning("Failed to sync hardware clock");
@@ -687,7 +1970,7 @@ bool Install::localise()
   if (!keymap.empty())
   {
     log_info("Set vconsole keymap");
-    const auto set = ChrootWrite{}(std::format("echo \"KEYMAP={}\" >> {}", keymap, TerminalConf.string()));
+    const auto set = FileOps::write(TerminalConf, std::format("KEYMAP={}\n", keymap));
     log_warning_if(!set, std::format("Failed to update {}", TerminalConf.string()));
   }
 
@@ -698,12 +1981,12 @@ bool Install::localise()
 // network
 bool Install::network()
 {
-  static const fs::path HostnamePath{"/etc/hostname"};
+  const fs::path HostnamePath {m_root_mnt / "etc/hostname"};
 
   const auto [hostname, ntp, copy_conf] = m_data->network;
 
   log_info("Set hostname");
-  log_warning_if(!ChrootWrite{}(std::format("echo \"{}\" > {}", hostname, HostnamePath.string())), "Failed to create /etc/hostname");
+  log_warning_if(!FileOps::write(HostnamePath, std::format("{}\n", hostname)), "Failed to create /etc/hostname");
 
   enable_service({"systemd-resolved"});
 
@@ -716,14 +1999,10 @@ bool Install::network()
   if (m_data->network.copy_config)
   {
     static const fs::path LiveConfigPath {"/etc/systemd/network"};
-    static const fs::path TargetConfigPath {RootMnt / "etc/systemd/network"};
-
-    const auto src = LiveConfigPath.string();
-    const auto dest = TargetConfigPath.string();
-    const auto cmd = std::format("mkdir -p {} && cp -rf {}/* {}", dest, src, dest);
+    const fs::path TargetConfigPath {m_root_mnt / "etc/systemd/network"};
 
     log_info("Copy systemd-network config");
-    log_warning_if(ReadCommand::execute(cmd) != CmdSuccess, "Failed to copy systemd-network configs");
+    log_warning_if(!FileOps::copy_tree(LiveConfigPath, TargetConfigPath), "Failed to copy systemd-network configs");
   }
 
   if (ntp)
@@ -735,30 +2014,24 @@ bool Install::network()
 bool Install::setup_iwd()
 {
   // iwd config: https://wiki.archlinux.org/title/Iwd#Network_configuration
-  static const fs::path LiveIwdConfigPath{RootMnt / "etc/iwd/main.conf"};
-  static const auto IwdConfig = "[General]\nEnableNetworkConfiguration=true";
-  static const auto create_config = std::format("mkdir -p {} && echo -e \"{}\" > {}", LiveIwdConfigPath.parent_path().string(),
-                                                                                      IwdConfig,
-                                                                                      LiveIwdConfigPath.string());
+  const fs::path IwdConfigPath {m_root_mnt / "etc/iwd/main.conf"};
+  static const auto IwdConfig = "[General]\nEnableNetworkConfiguration=true\n";
 
   log_info("Install and enable iwd");
 
   const auto setup = install_packages({"iwd"}) && enable_service({"iwd", "systemd-networkd"});
   log_warning_if(!setup, "iwd package or service enable failed");
-  log_warning_if(ReadCommand::execute(create_config) != CmdSuccess, "Failed to create IWD config");
+  log_warning_if(!FileOps::write(IwdConfigPath, IwdConfig), "Failed to create IWD config");
 
   if (m_data->network.copy_config)
   {
     static const fs::path LiveIwdConnectionsPath{"/var/lib/iwd"};
-    static const fs::path TargetIwdConnectionsPath{RootMnt / "var/lib/iwd"};
+    const fs::path TargetIwdConnectionsPath {m_root_mnt / "var/lib/iwd"};
 
     log_info("Copy iwd config");
 
-    const auto src = LiveIwdConnectionsPath.string();
-    const auto dest = TargetIwdConnectionsPath.string();
-    const auto cmd = std::format("mkdir -p {} && cp -rf {}/* {}", dest, src, dest);
-
-    log_warning_if(ReadCommand::execute(cmd) != CmdSuccess, "Failed to copy iwd configs");
+    // modes are preserved, these contain passphrases so are only readable by root
+    log_warning_if(!FileOps::copy_tree(LiveIwdConnectionsPath, TargetIwdConnectionsPath), "Failed to copy iwd configs");
   }
 
   return true;
@@ -773,7 +2046,7 @@ bool Install::setup_network_manager()
 // swap
 bool Install::swap()
 {
-  static const fs::path ZramConfigPath {RootMnt / "etc/systemd/zram-generator.conf"};
+  const fs::path ZramConfigPath {m_root_mnt / "etc/systemd/zram-generator.conf"};
   static const auto ZramConfig ="[zram0]\n"
                                 "zram-size = min(ram / 4, 4096)\n" // 25% of ram or 4GB
                                 "compression-algorithm = zstd\n";
@@ -788,12 +2061,7 @@ bool Install::swap()
 
   log_info("Create zram config");
 
-  {
-    std::ofstream cfg_file{ZramConfigPath, std::ios_base::out | std::ios_base::trunc};
-    cfg_file << ZramConfig;
-  }
-
-  if (fs::exists(ZramConfigPath) && fs::file_size(ZramConfigPath))
+  if (FileOps::write(ZramConfigPath, ZramConfig))
     enable_service({"systemd-zram-setup@zram0.service"});
   else
     log_error("Failed to create zram config");
@@ -825,19 +2093,23 @@ bool Install::video()
 // general
 bool Install::enable_service(const ServiceSet& services)
 {
-  bool enabled_all{true};
+  if (services.empty())
+    return true;
 
-  for (const auto& svc : services)
-  {
-    log_info(std::format("Enable service {}", svc));
+  log_info(std::format("Enable {}", flatten(services)));
 
-    const auto enabled = Chroot{}(std::format("systemctl enable {}", svc));
-    log_error_if(!enabled, std::format("Failed to enable service: {}", svc));
+  const auto remaining = Systemd::enable(m_root_mnt, {services.cbegin(), services.cend()});
 
-    enabled_all &= enabled;
-  }
+  if (remaining.empty())
+    return true;
+
+  // units that couldn't be enabled natively, in one call rather than a chroot for each
+  log_info(std::format("Enable with systemctl: {}", flatten(remaining)));
+
+  const auto enabled = ReadCommand::execute(std::format("systemctl --root={} enable {}", m_root_mnt.string(), flatten(remaining))) == CmdSuccess;
+  log_error_if(!enabled, std::format("Failed to enable: {}", flatten(remaining)));
 
-  return enabled_all;
+  return enabled;
 }
 
 std::size_t Install::count_files (const fs::path& dir, const std::vector<std::string_view> ext)
@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <wali/DiskUtils.hpp>
+#include <wali/Install.hpp>
+#include <wali/InstallEstimate.hpp>
+#include <wali/PackageResolver.hpp>
+#include <wali/SystemFacts.hpp>
+
+
+InstallEstimate InstallEstimate::estimate(const WidgetData& data)
+{
+  const auto facts = SystemFacts::get();
+
+  InstallEstimate est;
+
+  if (facts->packages->empty())
+    return est;
+
+  const auto resolved = PackageResolver::resolve(*facts->packages, Install::planned_packages(data, facts->cpu));
+
+  est.available = true;
+  est.package_count = resolved.packages.size();
+  est.download_size = resolved.download_size;
+  est.installed_size = resolved.installed_size;
+  est.missing = resolved.missing;
+
+  // pacstrap downloads to the target's package cache, and leave 10% for
+  // filesystem overhead, logs and the initramfs
+  est.required = est.installed_size + est.download_size + est.installed_size / 10;
+  est.root_capacity = get_root_capacity(data.mounts);
+
+  return est;
+}
+
+
+std::int64_t InstallEstimate::get_root_capacity(const MountData& mounts)
+{
+  // root is the image's remaining space
+  if (!mounts.image.path.empty())
+    return mounts.image.size - ImageBootSize;
+  else if (mounts.root_dev.empty())
+    return 0;
+
+  const auto& tree = SystemFacts::get()->tree;
+
+  // an array is limited by its smallest member
+  auto smallest = DiskUtils::get_partition_size(tree, mounts.root_dev);
+  for (const auto& dev : mounts.root_stripe.devs)
+    smallest = std::min(smallest, DiskUtils::get_partition_size(tree, dev));
+
+  const auto members = static_cast<std::int64_t>(mounts.root_stripe.devs.size() + 1);
+
+  switch (mounts.root_stripe.level)
+  {
+    case RaidLevel::Raid0:  return smallest * members;
+    case RaidLevel::Raid10: return smallest * members / 2;
+    default:                return smallest; // raid1 mirrors
+  }
+}
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <plog/Log.h>
+#include <wali/Localise.hpp>
+
+
+static const fs::path ZoneInfoDir {"/usr/share/zoneinfo"};
+static const fs::path SupportedLocalesPath {"/usr/share/i18n/SUPPORTED"};
+
+// same directories as localectl searches
+static const std::array<fs::path, 3> KeymapDirs
+{
+  "/usr/share/keymaps",
+  "/usr/share/kbd/keymaps",
+  "/usr/lib/kbd/keymaps"
+};
+
+static const std::array<std::string_view, 5> KeymapExtensions
+{
+  ".map", ".map.gz", ".map.bz2", ".map.xz", ".map.zst"
+};
+
+
+std::vector<std::string> Localise::timezones()
+{
+  std::vector<std::string> zones;
+  zones.reserve(600); // "timedatectl list-timezones | wc -l" returns 598
+
+  std::string content;
+
+  if (read_file(ZoneInfoDir / "tzdata.zi", content))
+  {
+    // zone:  "Z Europe/London 0:1:15 - LMT 1847 D 1"
+    // link:  "L Europe/London Europe/Belfast"
+    for_each_line(content, [&zones](const std::string_view line)
+    {
+      if (line.size() < 3 || (line[0] != 'Z' && line[0] != 'L') || line[1] != ' ')
+        return;
+
+      auto field = line.substr(2);
+
+      if (line[0] == 'L')
+      {
+        // alias is the second field
+        if (const auto space = field.find(' '); space == std::string_view::npos)
+          return;
+        else
+          field = field.substr(space+1);
+      }
+
+      if (const auto end = field.find(' '); end != std::string_view::npos)
+        field = field.substr(0, end);
+
+      if (!field.empty())
+        zones.emplace_back(field);
+    });
+  }
+  else if (read_file(ZoneInfoDir / "zone1970.tab", content))
+  {
+    // "GB,GG,IM,JE\t+513030-0000731\tEurope/London"
+    for_each_line(content, [&zones](const std::string_view line)
+    {
+      if (line.empty() || line[0] == '#')
+        return;
+
+      const auto first = line.find('\t');
+      const auto second = first == std::string_view::npos ? first : line.find('\t', first+1);
+
+      if (second != std::string_view::npos)
+        zones.emplace_back(line.substr(second+1, line.find('\t', second+1) - (second+1)));
+    });
+  }
+  else
+    PLOGE << "No timezone data in " << ZoneInfoDir;
+
+  // timedatectl always includes UTC, which is not a zone in tzdata
+  if (!zones.empty())
+    zones.emplace_back("UTC");
+
+  sort_unique(zones);
+  return zones;
+}
+
+
+std::vector<std::string> Localise::keymaps()
+{
+  std::vector<std::string> keys;
+
+  auto keymap_name = [](const fs::path& path) -> std::string_view
+  {
+    const std::string_view name {path.filename().native()};
+
+    for (const auto ext : KeymapExtensions)
+    {
+      if (name.size() > ext.size() && name.ends_with(ext))
+        return name.substr(0, name.size() - ext.size());
+    }
+    return {};
+  };
+
+  for (const auto& dir : KeymapDirs)
+  {
+    std::error_code ec;
+    if (!fs::is_directory(dir, ec))
+      continue;
+
+    for (auto it = fs::recursive_directory_iterator{dir, ec} ; !ec && it != fs::recursive_directory_iterator{} ; it.increment(ec))
+    {
+      // included by other keymaps, not loadable on their own
+      if (it->is_directory() && it->path().filename() == "include")
+        it.disable_recursion_pending();
+      else if (it->is_regular_file())
+      {
+        if (const auto name = keymap_name(it->path()); !name.empty())
+          keys.emplace_back(name);
+      }
+    }
+
+    PLOGE_IF(ec) << "Failed reading keymaps in " << dir << ": " << ec.message();
+  }
+
+  sort_unique(keys);
+  return keys;
+}
+
+
+std::vector<std::string> Localise::locales()
+{
+  std::vector<std::string> locales;
+  locales.reserve(500); // "cat /usr/share/i18n/SUPPORTED | wc -l" returns 500
+
+  std::string content;
+  if (!read_file(SupportedLocalesPath, content))
+  {
+    PLOGE << "Failed to read " << SupportedLocalesPath;
+    return locales;
+  }
+
+  // "en_GB.UTF-8 UTF-8"
+  for_each_line(content, [&locales](const std::string_view line)
+  {
+    const auto space = line.find(' ');
+
+    if (space != std::string_view::npos && line.substr(space+1) == "UTF-8")
+      locales.emplace_back(line.substr(0, space));
+  });
+
+  sort_unique(locales);
+  return locales;
+}
+
+
+bool Localise::read_file(const fs::path& path, std::string& content)
+{
+  std::ifstream stream{path};
+  if (!stream)
+    return false;
+
+  std::stringstream buff;
+  buff << stream.rdbuf();
+  content = std::move(buff).str();
+  return true;
+}
+
+
+void Localise::sort_unique(std::vector<std::string>& names)
+{
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+}
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <linux/fs.h>
+#include <linux/loop.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <plog/Log.h>
+#include <wali/FileDescriptor.hpp>
+#include <wali/LoopDevice.hpp>
+
+
+bool LoopDevice::create_image(const fs::path& path, const int64_t size)
+{
+  FileDescriptor file{path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600};
+  if (!file.valid())
+    return false;
+
+  // extending with ftruncate() rather than writing is what makes it sparse
+  if (::ftruncate(file.fd, size) == -1)
+  {
+    PLOGE << "Failed to size " << path.string() << ": " << strerror(errno);
+    return false;
+  }
+
+  return true;
+}
+
+
+std::string LoopDevice::attach(const fs::path& path)
+{
+  static const int MaxAttempts = 8;
+
+  FileDescriptor file{path, O_RDWR | O_CLOEXEC};
+  FileDescriptor control{"/dev/loop-control", O_RDWR | O_CLOEXEC};
+
+  if (!file.valid() || !control.valid())
+    return {};
+
+  // direct I/O so the image's blocks aren't cached twice (loop device and file), the
+  // kernel ignores it if the file's filesystem can't support it
+  loop_config config{};
+  config.fd = static_cast<__u32>(file.fd);
+  config.info.lo_flags = LO_FLAGS_PARTSCAN | LO_FLAGS_DIRECT_IO;
+  path.string().copy(reinterpret_cast<char *>(config.info.lo_file_name), LO_NAME_SIZE - 1);
+
+  // another process can configure the free device before we do
+  for (int attempt = 0 ; attempt < MaxAttempts ; ++attempt)
+  {
+    const int n = ::ioctl(control.fd, LOOP_CTL_GET_FREE);
+
+    if (n == -1)
+    {
+      PLOGE << "Failed to get a free loop device: " << strerror(errno);
+      return {};
+    }
+
+    const auto dev = std::format("/dev/loop{}", n);
+
+    FileDescriptor loop{dev, O_RDWR | O_CLOEXEC};
+    if (!loop.valid())
+      return {};
+
+    if (::ioctl(loop.fd, LOOP_CONFIGURE, &config) == 0)
+      return dev;
+    else if (errno != EBUSY)
+    {
+      PLOGE << "Failed to attach " << path.string() << " to " << dev << ": " << strerror(errno);
+      return {};
+    }
+  }
+
+  PLOGE << "No loop device available for " << path.string();
+  return {};
+}
+
+
+bool LoopDevice::detach(const std::string_view dev)
+{
+  static const int MaxAttempts = 10;
+
+  FileDescriptor loop{dev, O_RDWR | O_CLOEXEC};
+  if (!loop.valid())
+    return false;
+
+  // udev may still be probing the partitions after unmount
+  for (int attempt = 0 ; attempt < MaxAttempts ; ++attempt)
+  {
+    if (::ioctl(loop.fd, LOOP_CLR_FD, 0) == 0)
+      return true;
+    else if (errno != EBUSY)
+      break;
+
+    std::this_thread::sleep_for(chrono::milliseconds{200});
+  }
+
+  PLOGE << "Failed to detach " << dev << ": " << strerror(errno);
+  return false;
+}
+
+
+int64_t LoopDevice::trim(const fs::path& mount_path)
+{
+  FileDescriptor dir{mount_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC};
+  if (!dir.valid())
+    return -1;
+
+  fstrim_range range{.start = 0, .len = ULLONG_MAX, .minlen = 0};
+
+  if (::ioctl(dir.fd, FITRIM, &range) == -1)
+  {
+    PLOGE << "Failed to trim " << mount_path.string() << ": " << strerror(errno);
+    return -1;
+  }
+
+  // the kernel sets len to the bytes trimmed
+  return static_cast<int64_t>(range.len);
+}
+
+
+int64_t LoopDevice::compact(const fs::path& path)
+{
+  static const off_t BlockSize = 64 * 1024;
+
+  FileDescriptor file{path, O_RDWR | O_CLOEXEC};
+  if (!file.valid())
+    return -1;
+
+  struct stat st{};
+  if (::fstat(file.fd, &st) == -1)
+  {
+    PLOGE << "Failed to stat " << path.string() << ": " << strerror(errno);
+    return -1;
+  }
+
+  std::vector<char> buff(BlockSize);
+
+  auto is_zero = [&buff](const std::size_t n)
+  {
+    return buff[0] == 0 && std::memcmp(buff.data(), buff.data() + 1, n - 1) == 0;
+  };
+
+  // only the allocated extents are read, holes are already what we want
+  for (off_t data = ::lseek(file.fd, 0, SEEK_DATA) ; data >= 0 && data < st.st_size ; data = ::lseek(file.fd, data, SEEK_DATA))
+  {
+    const off_t hole = ::lseek(file.fd, data, SEEK_HOLE);
+
+    for (off_t n{} ; data < hole ; data += n)
+    {
+      if (n = ::pread(file.fd, buff.data(), std::min(BlockSize, hole - data), data); n <= 0)
+      {
+        PLOGE << "Failed to read " << path.string() << ": " << strerror(errno);
+        return -1;
+      }
+
+      if (is_zero(n) && ::fallocate(file.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, data, n) == -1)
+      {
+        PLOGE << "Failed to punch hole in " << path.string() << ": " << strerror(errno);
+        return -1;
+      }
+    }
+  }
+
+  if (::fstat(file.fd, &st) == -1)
+    return -1;
+
+  return static_cast<int64_t>(st.st_blocks) * 512;
+}
@@ -0,0 +1,155 @@
+#include <cstring>
+#include <format>
+#include <vector>
+#include <libmount/libmount.h>
+#include <plog/Log.h>
+#include <wali/MountUtils.hpp>
+
+
+struct MountContext
+{
+  MountContext() : cxt(mnt_new_context())
+  {
+  }
+
+  ~MountContext()
+  {
+    if (cxt)
+      mnt_free_context(cxt);
+  }
+
+  // as the mount/umount commands would report, i.e. "/mnt: target is busy."
+  std::string error(const int rc) const
+  {
+    char buff[1024]{};
+
+    mnt_context_get_excode(cxt, rc, buff, sizeof(buff));
+
+    if (buff[0])
+      return buff;
+    else if (const int err = mnt_context_get_syscall_errno(cxt); err)
+      return strerror(err);
+    else
+      return std::format("error {}", rc);
+  }
+
+  libmnt_context * cxt;
+};
+
+
+bool MountUtils::mount(const std::string_view dev, const std::string_view path, const std::string_view opts, std::string& error)
+{
+  std::error_code ec;
+  if (fs::create_directories(path, ec); ec)
+  {
+    error = std::format("Failed to create {}: {}", path, ec.message());
+    return false;
+  }
+
+  MountContext context;
+  if (!context.cxt)
+  {
+    error = "Failed to create mount context";
+    return false;
+  }
+
+  const std::string dev_str{dev}, path_str{path}, opts_str{opts};
+
+  mnt_context_set_source(context.cxt, dev_str.c_str());
+  mnt_context_set_target(context.cxt, path_str.c_str());
+
+  if (!opts.empty())
+    mnt_context_set_options(context.cxt, opts_str.c_str());
+
+  if (const int rc = mnt_context_mount(context.cxt); rc != 0)
+  {
+    error = context.error(rc);
+    PLOGE << "Mount " << dev << " onto " << path << " failed: " << error;
+    return false;
+  }
+
+  return true;
+}
+
+
+bool MountUtils::unmount(const std::string_view path, std::string& error)
+{
+  if (do_unmount(path, false, error))
+    return true;
+
+  // still detached from the tree, so the devices can be reused, cleanup completes when no longer busy
+  PLOGW << "Unmount " << path << " failed (" << error << "), trying lazy unmount";
+  return do_unmount(path, true, error);
+}
+
+
+bool MountUtils::do_unmount(const std::string_view path, const bool lazy, std::string& error)
+{
+  MountContext context;
+  if (!context.cxt)
+  {
+    error = "Failed to create mount context";
+    return false;
+  }
+
+  const std::string path_str{path};
+
+  mnt_context_set_target(context.cxt, path_str.c_str());
+  mnt_context_enable_lazy(context.cxt, lazy);
+
+  if (const int rc = mnt_context_umount(context.cxt); rc != 0)
+  {
+    error = context.error(rc);
+    return false;
+  }
+
+  return true;
+}
+
+
+bool MountUtils::unmount_recursive(const std::string_view path, std::string& error)
+{
+  const std::string root{path};
+  std::vector<std::string> targets;
+
+  if (auto table = mnt_new_table(); !table)
+  {
+    error = "Failed to create mount table";
+    return false;
+  }
+  else
+  {
+    if (mnt_table_parse_file(table, "/proc/self/mountinfo") == 0)
+    {
+      auto itr = mnt_new_iter(MNT_ITER_FORWARD);
+      libmnt_fs * fs{};
+
+      while (mnt_table_next_fs(table, itr, &fs) == 0)
+      {
+        const std::string_view target {mnt_fs_get_target(fs) ?: ""};
+
+        if (target == root || target.starts_with(root + '/'))
+          targets.emplace_back(target);
+      }
+
+      mnt_free_iter(itr);
+    }
+
+    mnt_free_table(table);
+  }
+
+  // mountinfo is in mount order, so a parent is always before its children
+  bool unmounted{true};
+
+  for (const auto& target : targets | view::reverse)
+  {
+    if (std::string err; !unmount(target, err))
+    {
+      PLOGE << "Unmount " << target << " failed: " << err;
+      error = std::format("{}: {}", target, err);
+      unmounted = false;
+    }
+  }
+
+  return unmounted;
+}
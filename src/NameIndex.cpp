@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <cctype>
+#include <tuple>
+#include <wali/NameIndex.hpp>
+
+
+NameIndex::NameIndex(std::vector<std::string> names) : m_names(std::move(names))
+{
+  std::sort(m_names.begin(), m_names.end());
+  m_names.erase(std::unique(m_names.begin(), m_names.end()), m_names.end());
+
+  m_lower.reserve(m_names.size());
+  for (const auto& name : m_names)
+    m_lower.emplace_back(lower(name));
+}
+
+
+std::vector<std::string_view> NameIndex::find(const std::string_view query, const std::size_t limit,
+                                              const std::vector<std::string>& priority, bool& more) const
+{
+  enum Rank { Prefix, WordStart };
+
+  more = false;
+
+  if (query.empty() || !limit)
+    return {};
+
+  const auto q = lower(query);
+
+  auto word_start = [&q](const std::string_view name)
+  {
+    for (auto pos = name.find(q, 1) ; pos != std::string_view::npos ; pos = name.find(q, pos+1))
+    {
+      if (WordSeparators.find(name[pos-1]) != std::string_view::npos)
+        return true;
+    }
+    return false;
+  };
+
+  auto is_priority = [&priority](const std::string& name)
+  {
+    return std::find(priority.cbegin(), priority.cend(), name) != priority.cend();
+  };
+
+  // (rank, not priority, index), so sorting the tuples gives the display order
+  std::vector<std::tuple<Rank, bool, std::size_t>> matches;
+
+  for (std::size_t i = 0 ; i < m_lower.size() ; ++i)
+  {
+    if (m_lower[i].starts_with(q))
+      matches.emplace_back(Prefix, !is_priority(m_names[i]), i);
+    else if (word_start(m_lower[i]))
+      matches.emplace_back(WordStart, !is_priority(m_names[i]), i);
+  }
+
+  more = matches.size() > limit;
+
+  const auto n = std::min(limit, matches.size());
+  std::partial_sort(matches.begin(), matches.begin() + n, matches.end());
+
+  std::vector<std::string_view> result;
+  result.reserve(n);
+
+  for (std::size_t i = 0 ; i < n ; ++i)
+    result.emplace_back(m_names[std::get<2>(matches[i])]);
+
+  return result;
+}
+
+
+bool NameIndex::contains(const std::string_view name) const
+{
+  return std::binary_search(m_names.cbegin(), m_names.cend(), name);
+}
+
+
+std::string NameIndex::lower(const std::string_view s)
+{
+  std::string result{s};
+  std::transform(result.begin(), result.end(), result.begin(), [](const unsigned char c){ return std::tolower(c); });
+  return result;
+}
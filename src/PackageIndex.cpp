@@ -0,0 +1,229 @@
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <archive.h>
+#include <archive_entry.h>
+#include <plog/Log.h>
+#include <wali/PackageIndex.hpp>
+
+
+PackageIndex::PackageIndex()
+{
+  // id 0 is the empty string, so fields missing from a desc are empty
+  m_strings.emplace_back();
+  m_string_ids.emplace(std::string_view{}, 0);
+}
+
+
+bool PackageIndex::load(const fs::path& sync_dir, const StringViewVec& repos)
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  bool any{false};
+
+  for (const auto repo : repos)
+  {
+    const auto path = sync_dir / std::format("{}.db", repo);
+
+    if (!fs::exists(path))
+      PLOGW << "Sync database does not exist: " << path;
+    else
+      any |= read_db(path, intern(repo));
+  }
+
+  const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+  PLOGI << "Package index: " << m_packages.size() << " packages, " << m_strings.size() << " strings in " << ms.count() << "ms";
+
+  return any;
+}
+
+
+const PackageIndex::Package * PackageIndex::find(const std::string_view name) const
+{
+  if (const auto it = m_by_name.find(name); it != m_by_name.end())
+    return &m_packages[it->second];
+  return nullptr;
+}
+
+
+std::span<const std::uint32_t> PackageIndex::providers(const std::string_view name) const
+{
+  if (const auto it = m_providers.find(name); it != m_providers.end())
+    return it->second;
+  return {};
+}
+
+
+std::span<const std::uint32_t> PackageIndex::group(const std::string_view name) const
+{
+  if (const auto it = m_groups.find(name); it != m_groups.end())
+    return it->second;
+  return {};
+}
+
+
+std::string_view PackageIndex::dep_name(const std::string_view dep)
+{
+  // depends may have a version constraint: name, name=1.0, name>=1.0, name<2
+  return dep.substr(0, dep.find_first_of("<>="));
+}
+
+
+bool PackageIndex::read_db(const fs::path& path, const StrId repo)
+{
+  // the db is a tar, compressed with gzip or zstd depending on pacman version
+  archive * ar = archive_read_new();
+  archive_read_support_filter_all(ar);
+  archive_read_support_format_tar(ar);
+
+  if (archive_read_open_filename(ar, path.c_str(), 64 * 1024) != ARCHIVE_OK)
+  {
+    PLOGE << "Failed to open " << path << ": " << archive_error_string(ar);
+    archive_read_free(ar);
+    return false;
+  }
+
+  std::string desc;
+  std::array<char, 16 * 1024> buff;
+  archive_entry * entry{};
+  int r{};
+
+  // each package is a directory "name-version/" containing "desc"
+  while ((r = archive_read_next_header(ar, &entry)) == ARCHIVE_OK)
+  {
+    const std::string_view entry_path {archive_entry_pathname(entry)};
+
+    if (!entry_path.ends_with("/desc"))
+      continue;
+
+    desc.clear();
+
+    la_ssize_t n{};
+    while ((n = archive_read_data(ar, buff.data(), buff.size())) > 0)
+      desc.append(buff.data(), n);
+
+    if (n < 0)
+    {
+      PLOGE << "Failed to read " << entry_path << " in " << path << ": " << archive_error_string(ar);
+      r = ARCHIVE_FATAL;
+      break;
+    }
+
+    parse_desc(desc, repo);
+  }
+
+  PLOGE_IF(r != ARCHIVE_EOF && r != ARCHIVE_OK) << "Failed reading " << path << ": " << archive_error_string(ar);
+
+  archive_read_free(ar);
+  return r == ARCHIVE_EOF;
+}
+
+
+void PackageIndex::parse_desc(const std::string_view desc, const StrId repo)
+{
+  // %NAME%
+  // firefox
+  //
+  // %DEPENDS%
+  // glibc
+  // gtk3
+  //
+  // ...
+
+  Package pkg{.repo = repo};
+  bool have_name{false};
+
+  enum class Field { None, Name, Version, Desc, CSize, ISize, Depends, Provides, Groups };
+  Field field{Field::None};
+
+  std::vector<StrId> depends, provides, groups;
+
+  for (std::size_t start = 0, end = 0 ; start < desc.size() ; start = end+1)
+  {
+    if (end = desc.find('\n', start); end == std::string_view::npos)
+      end = desc.size();
+
+    const auto line = desc.substr(start, end-start);
+
+    if (line.empty())
+      field = Field::None;
+    else if (line.front() == '%' && line.back() == '%')
+    {
+      if (line == "%NAME%")           field = Field::Name;
+      else if (line == "%VERSION%")   field = Field::Version;
+      else if (line == "%DESC%")      field = Field::Desc;
+      else if (line == "%CSIZE%")     field = Field::CSize;
+      else if (line == "%ISIZE%")     field = Field::ISize;
+      else if (line == "%DEPENDS%")   field = Field::Depends;
+      else if (line == "%PROVIDES%")  field = Field::Provides;
+      else if (line == "%GROUPS%")    field = Field::Groups;
+      else                            field = Field::None;
+    }
+    else
+    {
+      switch (field)
+      {
+        case Field::Name:     pkg.name = intern(line); have_name = true; break;
+        case Field::Version:  pkg.version = intern(line); break;
+        case Field::Desc:     pkg.desc = intern(line); break;
+        case Field::CSize:    pkg.download_size = std::strtoull(std::string{line}.c_str(), nullptr, 10); break;
+        case Field::ISize:    pkg.installed_size = std::strtoull(std::string{line}.c_str(), nullptr, 10); break;
+        case Field::Depends:  depends.push_back(intern(line)); break;
+        case Field::Provides: provides.push_back(intern(line)); break;
+        case Field::Groups:   groups.push_back(intern(line)); break;
+        default: break;
+      }
+    }
+  }
+
+  if (!have_name)
+    return;
+
+  auto add_list = [this](const std::vector<StrId>& ids)
+  {
+    Range r {.begin = static_cast<std::uint32_t>(m_lists.size())};
+    m_lists.insert(m_lists.end(), ids.cbegin(), ids.cend());
+    r.end = static_cast<std::uint32_t>(m_lists.size());
+    return r;
+  };
+
+  pkg.depends = add_list(depends);
+  pkg.provides = add_list(provides);
+  pkg.groups = add_list(groups);
+
+  // core is read before extra, and pacman prefers the first repo with the package
+  if (const auto i = static_cast<std::uint32_t>(m_packages.size()); m_by_name.emplace(str(pkg.name), i).second)
+  {
+    m_packages.push_back(pkg);
+
+    for (const auto id : provides)
+      m_providers[dep_name(str(id))].push_back(i);
+
+    for (const auto id : groups)
+      m_groups[str(id)].push_back(i);
+  }
+}
+
+
+PackageIndex::StrId PackageIndex::intern(const std::string_view s)
+{
+  if (const auto it = m_string_ids.find(s); it != m_string_ids.end())
+    return it->second;
+
+  if (s.size() > m_block_free)
+  {
+    const auto size = std::max(ArenaBlockSize, s.size());
+    m_block = m_arena.emplace_back(std::make_unique<char[]>(size)).get();
+    m_block_free = size;
+  }
+
+  std::memcpy(m_block, s.data(), s.size());
+  const std::string_view stored {m_block, s.size()};
+  m_block += s.size();
+  m_block_free -= s.size();
+
+  const auto id = static_cast<StrId>(m_strings.size());
+  m_strings.push_back(stored);
+  m_string_ids.emplace(stored, id);
+  return id;
+}
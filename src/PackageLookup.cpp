@@ -0,0 +1,264 @@
+#include <Wt/Http/Client.h>
+#include <Wt/Json/Array.h>
+#include <Wt/Json/Object.h>
+#include <Wt/Json/Parser.h>
+#include <Wt/WApplication.h>
+#include <Wt/WIOService.h>
+#include <Wt/WServer.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <plog/Log.h>
+#include <wali/PackageLookup.hpp>
+
+
+using namespace Wt;
+
+// put 'any' arch to avoid missing packages, i.e. "reflector" is 'any'
+static constexpr const auto SearchString =  "https://archlinux.org/packages/search/json/?"
+                                            "arch=x86_64&arch=any&repo=Core&repo=Extra&name={}";
+
+static constexpr double InitialLimit = 8;
+static constexpr double MaxLimit = 16;
+static constexpr unsigned MaxAttempts = 4;
+static constexpr chrono::milliseconds RetryDelay {500};
+static constexpr chrono::seconds DecreaseInterval {1};
+static constexpr chrono::minutes CacheTtl {10};
+
+
+struct Batch
+{
+  std::string session_id;
+  OnLookup on_result;
+  OnLookupDone on_done;
+  std::size_t remaining{};
+};
+
+struct Job
+{
+  std::string name;
+  std::shared_ptr<Batch> batch;
+  unsigned attempt{};
+};
+
+struct CacheEntry
+{
+  LookupResult result;
+  WaliClock::time_point expires;
+};
+
+
+static std::mutex lookup_mutex;
+static std::deque<Job> jobs;
+static std::vector<std::unique_ptr<Http::Client>> clients; // every client created, never more than MaxLimit
+static std::vector<Http::Client *> idle;
+static std::map<Http::Client *, Job> active;
+static double limit {InitialLimit};
+static WaliClock::time_point last_decrease;
+static std::map<std::string, CacheEntry, std::less<>> cache;
+static bool stopped{};
+
+
+static void pump();
+
+
+static void deliver(const Job& job, const LookupResult result)
+{
+  WServer::instance()->post(job.batch->session_id, [batch = job.batch, name = job.name, result]
+  {
+    batch->on_result(name, result);
+
+    if (--batch->remaining == 0)
+      batch->on_done();
+
+    WApplication::instance()->triggerUpdate();
+  });
+}
+
+
+static LookupResult parse_response(const std::string& name, const std::string& body)
+{
+  Json::Value root;
+  if (Json::ParseError err; !Json::parse(body, root, err))
+    PLOGE << "Response contains invalid JSON";
+  else if (root.type() != Json::Type::Object)
+    PLOGE << "Response JSON root is not an object";
+  else if (Json::Object root_object = root; !(root_object.contains("results") && root_object.get("results").type() == Json::Type::Array))
+    PLOGE << "Response JSON 'results' does not exist or is not an array";
+  else
+  {
+    // a package that does not exist is an empty array
+    const Json::Array& results = root_object.get("results");
+    const auto found = std::any_of(results.cbegin(), results.cend(), [&name](const Json::Value& result)
+    {
+      return result.type() == Json::Type::Object && static_cast<std::string>(static_cast<const Json::Object&>(result).get("pkgname")) == name;
+    });
+    return found ? LookupResult::Found : LookupResult::NotFound;
+  }
+
+  return LookupResult::Failed;
+}
+
+
+// caller must hold lookup_mutex
+static void retry(Job job)
+{
+  if (++job.attempt >= MaxAttempts)
+  {
+    PLOGW << "Package lookup failed after " << job.attempt << " attempts: " << job.name;
+    deliver(job, LookupResult::Failed);
+    return;
+  }
+
+  WServer::instance()->ioService().schedule(RetryDelay * job.attempt, [job = std::move(job)]
+  {
+    {
+      std::scoped_lock lock{lookup_mutex};
+      jobs.push_front(job);
+    }
+    pump();
+  });
+}
+
+
+static void on_response(Http::Client * client, const std::error_code err, const Http::Message& rsp)
+{
+  {
+    std::scoped_lock lock{lookup_mutex};
+
+    auto job = std::move(active.extract(client).mapped());
+    idle.push_back(client);
+
+    if (!err && rsp.status() == 200)
+    {
+      if (const auto result = parse_response(job.name, rsp.body()); result == LookupResult::Failed)
+        retry(std::move(job));
+      else
+      {
+        limit = std::min(MaxLimit, limit + 1);
+        cache.insert_or_assign(job.name, CacheEntry{.result = result, .expires = WaliClock::now() + CacheTtl});
+        deliver(job, result);
+      }
+    }
+    else
+    {
+      // all requests sent before the first 429 are likely to also receive 429,
+      // so only decrease once per interval
+      if (rsp.status() == 429 && WaliClock::now() - last_decrease > DecreaseInterval)
+      {
+        limit = std::max(1.0, limit / 2);
+        last_decrease = WaliClock::now();
+        PLOGW << "Package lookup rate limited, concurrent requests now " << limit;
+      }
+      else if (rsp.status() != 429)
+        PLOGW << "Package lookup for " << job.name << ": " << rsp.status() << " : " << err.message();
+
+      retry(std::move(job));
+    }
+  }
+
+  // not within done(), the client may be reused immediately
+  WServer::instance()->ioService().post(pump);
+}
+
+
+// caller must hold lookup_mutex
+static Http::Client * acquire_client()
+{
+  if (!idle.empty())
+  {
+    const auto client = idle.back();
+    idle.pop_back();
+    return client;
+  }
+  else if (clients.size() < static_cast<std::size_t>(MaxLimit))
+  {
+    // created with the server's io service, so not owned by a session
+    auto& client = clients.emplace_back(std::make_unique<Http::Client>(WServer::instance()->ioService()));
+    client->setMaxRedirects(10);
+    client->setMaximumResponseSize(16 * 1024);
+    client->setTimeout(chrono::seconds{10});
+    client->done().connect([c = client.get()](std::error_code err, const Http::Message& rsp) { on_response(c, err, rsp); });
+    return client.get();
+  }
+  return nullptr;
+}
+
+
+static void pump()
+{
+  std::vector<std::pair<Http::Client *, std::string>> requests;
+
+  {
+    std::scoped_lock lock{lookup_mutex};
+
+    while (!stopped && !jobs.empty() && active.size() < static_cast<std::size_t>(limit))
+    {
+      const auto client = acquire_client();
+      if (!client)
+        break;
+
+      auto& job = active.insert_or_assign(client, std::move(jobs.front())).first->second;
+      jobs.pop_front();
+
+      requests.emplace_back(client, std::format(SearchString, job.name));
+    }
+  }
+
+  // outside the lock, because get() may call done() before returning
+  for (const auto& [client, url] : requests)
+  {
+    if (!client->get(url))
+    {
+      PLOGE << "Package lookup request failed: " << url;
+
+      std::scoped_lock lock{lookup_mutex};
+      idle.push_back(client);
+      deliver(active.extract(client).mapped(), LookupResult::Failed);
+    }
+  }
+}
+
+
+void PackageLookup::lookup(const std::vector<std::string>& names, const std::string& session_id, OnLookup on_result, OnLookupDone on_done)
+{
+  auto batch = std::make_shared<Batch>(session_id, std::move(on_result), std::move(on_done), names.size());
+
+  if (names.empty())
+  {
+    WServer::instance()->post(session_id, batch->on_done);
+    return;
+  }
+
+  {
+    std::scoped_lock lock{lookup_mutex};
+
+    const auto now = WaliClock::now();
+    std::erase_if(cache, [now](const auto& entry){ return entry.second.expires <= now; });
+
+    for (const auto& name : names)
+    {
+      if (const auto it = cache.find(name); it != cache.end())
+        deliver(Job{.name = name, .batch = batch}, it->second.result);
+      else
+        jobs.push_back(Job{.name = name, .batch = batch});
+    }
+  }
+
+  pump();
+}
+
+
+void PackageLookup::shutdown()
+{
+  std::scoped_lock lock{lookup_mutex};
+
+  stopped = true;
+  jobs.clear();
+  active.clear();
+  idle.clear();
+  clients.clear();
+}
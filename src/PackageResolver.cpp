@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <plog/Log.h>
+#include <wali/PackageResolver.hpp>
+
+
+Resolution PackageResolver::resolve(const PackageIndex& index, const PackageSet& names)
+{
+  Resolution result;
+
+  std::vector<bool> selected(index.size());
+  auto& queue = result.packages; // also the result, in the order selected
+
+  auto select = [&](const std::uint32_t i)
+  {
+    if (!selected[i])
+    {
+      selected[i] = true;
+      queue.push_back(i);
+    }
+  };
+
+  // as pacman: a package with the name, else a provider, preferring one already selected
+  auto satisfy = [&](const std::string_view name)
+  {
+    if (const auto pkg = index.find(name); pkg)
+      select(index.index_of(*pkg));
+    else if (const auto providers = index.providers(name); !providers.empty())
+    {
+      if (rng::none_of(providers, [&selected](const std::uint32_t i){ return selected[i]; }))
+        select(providers.front());
+    }
+    else
+      return false;
+
+    return true;
+  };
+
+  for (const auto& name : names)
+  {
+    if (satisfy(name))
+      continue;
+    else if (const auto group = index.group(name); !group.empty())
+      rng::for_each(group, select);
+    else
+      result.missing.push_back(name);
+  }
+
+  // queue grows whilst iterating
+  for (std::size_t q = 0 ; q < queue.size() ; ++q)
+  {
+    const auto& pkg = index.packages()[queue[q]];
+
+    for (const auto dep : index.list(pkg.depends))
+    {
+      const auto name = PackageIndex::dep_name(index.str(dep));
+      PLOGW_IF(!satisfy(name)) << "Dependency " << name << " of " << index.str(pkg.name) << " not found";
+    }
+  }
+
+  for (const auto i : result.packages)
+  {
+    result.download_size += index.packages()[i].download_size;
+    result.installed_size += index.packages()[i].installed_size;
+  }
+
+  return result;
+}
+
+
+Expansion PackageResolver::expand(const PackageIndex& index, const std::vector<std::string>& names, const PackageSet& exclude)
+{
+  Expansion result;
+
+  auto add = [&](const std::string_view name)
+  {
+    if (!exclude.contains(std::string{name}))
+      result.packages.emplace(name);
+  };
+
+  for (const auto& name : names)
+  {
+    if (exclude.contains(name))
+      continue;
+    else if (index.contains(name))
+      add(name);
+    else if (const auto group = index.group(name); !group.empty())
+      rng::for_each(group, [&](const std::uint32_t i){ add(index.str(index.packages()[i].name)); });
+    else if (const auto providers = index.providers(name); !providers.empty())
+      add(index.str(index.packages()[providers.front()].name));
+    else
+      result.missing.emplace(name);
+  }
+
+  return result;
+}
+
+
+std::vector<std::string> PackageResolver::parse_list(const std::string_view text)
+{
+  static const constexpr std::string_view Separators {" \t\r\n,"};
+
+  std::vector<std::string> names;
+
+  for (std::size_t pos = 0 ; pos < text.size() ; )
+  {
+    if (text[pos] == '#')
+      pos = std::min(text.find('\n', pos), text.size());
+    else if (Separators.find(text[pos]) != std::string_view::npos)
+      ++pos;
+    else
+    {
+      const auto end = std::min(text.find_first_of(" \t\r\n,#", pos), text.size());
+      names.emplace_back(text.substr(pos, end - pos));
+      pos = end;
+    }
+  }
+
+  return names;
+}
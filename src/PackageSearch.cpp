@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <numeric>
+#include <tuple>
+#include <plog/Log.h>
+#include <wali/PackageSearch.hpp>
+
+
+static void append_lower(std::string& dest, const std::string_view src)
+{
+  std::transform(src.cbegin(), src.cend(), std::back_inserter(dest), [](const unsigned char c){ return std::tolower(c); });
+}
+
+
+PackageSearch::PackageSearch(PackageIndexPtr index) : m_index(std::move(index))
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  const auto& packages = m_index->packages();
+
+  m_entries.reserve(packages.size());
+
+  // (trigram << 32) | package, sorted to build the postings
+  std::vector<std::uint64_t> pairs;
+
+  auto add_trigrams = [&pairs](const std::string_view s, const std::uint32_t i)
+  {
+    for (std::size_t pos = 0 ; pos + 3 <= s.size() ; ++pos)
+      pairs.push_back((static_cast<std::uint64_t>(trigram(s, pos)) << 32) | i);
+  };
+
+  for (std::uint32_t i = 0 ; i < packages.size() ; ++i)
+  {
+    Entry entry;
+
+    entry.name_offset = m_text.size();
+    append_lower(m_text, m_index->str(packages[i].name));
+    entry.name_size = m_text.size() - entry.name_offset;
+
+    // separator so a substring search can't match across name and description
+    m_text += '\n';
+
+    entry.desc_offset = m_text.size();
+    append_lower(m_text, m_index->str(packages[i].desc));
+    entry.desc_size = m_text.size() - entry.desc_offset;
+
+    m_text += '\n';
+
+    m_entries.push_back(entry);
+
+    add_trigrams(name(i), i);
+    add_trigrams(desc(i), i);
+  }
+
+  std::sort(pairs.begin(), pairs.end());
+  pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+  m_postings.reserve(pairs.size());
+
+  for (const auto pair : pairs)
+  {
+    const auto tri = static_cast<Trigram>(pair >> 32);
+
+    if (m_trigrams.empty() || m_trigrams.back() != tri)
+    {
+      m_trigrams.push_back(tri);
+      m_offsets.push_back(m_postings.size());
+    }
+
+    m_postings.push_back(static_cast<std::uint32_t>(pair));
+  }
+
+  m_offsets.push_back(m_postings.size());
+
+  const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+  PLOGI << "Package search: " << m_trigrams.size() << " trigrams, " << m_postings.size() << " postings in " << ms.count() << "ms";
+}
+
+
+std::vector<std::uint32_t> PackageSearch::find(const std::string_view query, const std::size_t limit) const
+{
+  std::string q;
+  append_lower(q, query);
+
+  if (q.empty() || !limit)
+    return {};
+
+  // (rank, name size, name, package)
+  std::vector<std::tuple<int, std::size_t, std::string_view, std::uint32_t>> matches;
+
+  for (const auto i : candidates(q))
+  {
+    if (const auto r = rank(i, q); r >= 0)
+      matches.emplace_back(r, m_entries[i].name_size, name(i), i);
+  }
+
+  const auto n = std::min(limit, matches.size());
+  std::partial_sort(matches.begin(), matches.begin() + n, matches.end());
+
+  std::vector<std::uint32_t> result;
+  result.reserve(n);
+
+  for (std::size_t i = 0 ; i < n ; ++i)
+    result.push_back(std::get<3>(matches[i]));
+
+  return result;
+}
+
+
+std::vector<std::uint32_t> PackageSearch::candidates(const std::string_view query) const
+{
+  // too short for a trigram, every package is a candidate
+  if (query.size() < 3)
+  {
+    std::vector<std::uint32_t> all(m_entries.size());
+    std::iota(all.begin(), all.end(), 0);
+    return all;
+  }
+
+  std::vector<std::pair<const std::uint32_t *, const std::uint32_t *>> lists;
+
+  for (std::size_t pos = 0 ; pos + 3 <= query.size() ; ++pos)
+  {
+    const auto tri = trigram(query, pos);
+    const auto it = std::lower_bound(m_trigrams.cbegin(), m_trigrams.cend(), tri);
+
+    if (it == m_trigrams.cend() || *it != tri)
+      return {};  // no package contains this trigram
+
+    const auto t = std::distance(m_trigrams.cbegin(), it);
+    lists.emplace_back(m_postings.data() + m_offsets[t], m_postings.data() + m_offsets[t+1]);
+  }
+
+  // intersect shortest first, so the working set is small from the start
+  std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b){ return (a.second - a.first) < (b.second - b.first); });
+
+  std::vector<std::uint32_t> result {lists[0].first, lists[0].second};
+  std::vector<std::uint32_t> next;
+
+  for (std::size_t l = 1 ; l < lists.size() && !result.empty() ; ++l)
+  {
+    next.clear();
+    std::set_intersection(result.cbegin(), result.cend(), lists[l].first, lists[l].second, std::back_inserter(next));
+    result.swap(next);
+  }
+
+  return result;
+}
+
+
+int PackageSearch::rank(const std::uint32_t i, const std::string_view query) const
+{
+  static const constexpr std::string_view WordSeparators {"-_.+@"};
+
+  const auto n = name(i);
+
+  if (n == query)
+    return 0;
+  else if (n.starts_with(query))
+    return 1;
+
+  if (auto pos = n.find(query); pos != std::string_view::npos)
+  {
+    for ( ; pos != std::string_view::npos ; pos = n.find(query, pos+1))
+    {
+      if (WordSeparators.find(n[pos-1]) != std::string_view::npos)
+        return 2;
+    }
+    return 3;
+  }
+
+  // one or two characters are in most descriptions, so only names are useful
+  if (query.size() < 3)
+    return -1;
+
+  // trigrams only say the query's trigrams are somewhere in the package
+  return desc(i).find(query) != std::string_view::npos ? 4 : -1;
+}
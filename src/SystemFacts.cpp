@@ -0,0 +1,172 @@
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <sstream>
+#include <tuple>
+#include <plog/Log.h>
+#include <wali/Commands.hpp>
+#include <wali/Localise.hpp>
+#include <wali/SystemFacts.hpp>
+
+
+static std::mutex facts_mutex;
+static std::shared_future<FactsPtr> facts;
+
+static std::mutex profiles_mutex;
+static std::optional<std::vector<ProfileFile>> profile_files;
+
+
+void SystemFacts::warm()
+{
+  std::scoped_lock lock{facts_mutex};
+
+  if (!facts.valid())
+    facts = std::async(std::launch::async, &SystemFacts::collect).share();
+}
+
+
+FactsPtr SystemFacts::get()
+{
+  warm();
+
+  std::shared_future<FactsPtr> current;
+  {
+    std::scoped_lock lock{facts_mutex};
+    current = facts;
+  }
+
+  // wait outside the lock, so a refresh isn't blocked by sessions waiting
+  return current.get();
+}
+
+
+bool SystemFacts::is_ready()
+{
+  std::scoped_lock lock{facts_mutex};
+  return facts.valid() && facts.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
+}
+
+
+FactsPtr SystemFacts::refresh()
+{
+  std::shared_future<FactsPtr> pending;
+  {
+    std::scoped_lock lock{facts_mutex};
+    pending = facts = std::async(std::launch::async, &SystemFacts::collect).share();
+  }
+
+  return pending.get();
+}
+
+
+FactsPtr SystemFacts::refresh_disks()
+{
+  auto updated = std::make_shared<Facts>(*get());
+  updated->tree = DiskUtils::probe();
+
+  std::promise<FactsPtr> promise;
+  promise.set_value(updated);
+
+  std::scoped_lock lock{facts_mutex};
+  facts = promise.get_future().share();
+
+  return updated;
+}
+
+
+const std::vector<ProfileFile>& SystemFacts::profiles(const fs::path& docroot)
+{
+  static const fs::path ProfileDir {"profiles"};
+
+  std::scoped_lock lock{profiles_mutex};
+
+  if (profile_files)
+    return *profile_files;
+
+  auto& files = profile_files.emplace();
+
+  const auto path = docroot / ProfileDir;
+
+  if (!fs::exists(path))
+  {
+    PLOGE << "Profile path does not exist: " << path.string();
+    return files;
+  }
+
+  auto is_json = [](const fs::directory_entry& e){ return e.path().extension() == ".json"; };
+
+  for (const auto& entry : fs::directory_iterator{path} | std::views::filter(is_json))
+  {
+    PLOGI << "Reading profile: " << entry.path().string();
+
+    std::stringstream buff;
+    {
+      std::ifstream stream {entry.path()};
+      buff << stream.rdbuf();
+    }
+
+    files.emplace_back(entry.path().string(), buff.str());
+  }
+
+  return files;
+}
+
+
+FactsPtr SystemFacts::collect()
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  // each is independent and most wait on a child process, so run them together
+  auto startup = std::async(std::launch::async, &SystemFacts::startup_checks);
+  auto timezones = std::async(std::launch::async, []
+  {
+    auto zones = Localise::timezones();
+    return zones.empty() ? GetTimeZones{}() : zones;
+  });
+  auto locales = std::async(std::launch::async, &Localise::locales);
+  auto keymaps = std::async(std::launch::async, []
+  {
+    auto keys = Localise::keymaps();
+    return keys.empty() ? GetKeyMaps{}() : keys;
+  });
+  auto gpu = std::async(std::launch::async, []{ return GetGpuVendor{}(); });
+  auto cpu = std::async(std::launch::async, []{ return GetCpuVendor{}(); });
+  auto tree = std::async(std::launch::async, []{ return DiskUtils::probe(); });
+  auto packages = std::async(std::launch::async, []
+  {
+    auto index = std::make_shared<PackageIndex>();
+    index->load();
+
+    PackageIndexPtr shared {std::move(index)};
+    return std::make_pair(shared, std::make_shared<const PackageSearch>(shared));
+  });
+
+  auto result = std::make_shared<Facts>();
+  result->startup_error = startup.get();
+  result->timezones = NameIndex{timezones.get()};
+  result->locales = NameIndex{locales.get()};
+  result->keymaps = NameIndex{keymaps.get()};
+  result->gpu = gpu.get();
+  result->cpu = cpu.get();
+  result->tree = tree.get();
+  std::tie(result->packages, result->package_search) = packages.get();
+
+  const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+  PLOGI << "System facts collected in " << ms.count() << "ms";
+
+  return result;
+}
+
+
+std::string SystemFacts::startup_checks()
+{
+  if (!PlatformSizeValid{}())
+    return "Platform size not found or not 64bit";
+  else if (ReadCommand cmd; cmd.execute("timedatectl") != CmdSuccess)
+    return "Sync clock with timedatectl failed";
+  else
+    return "";
+}
@@ -0,0 +1,259 @@
+#include <array>
+#include <format>
+#include <fstream>
+#include <plog/Log.h>
+#include <wali/Systemd.hpp>
+
+
+// Relative to the root, in order of precedence
+static const std::array<fs::path, 2> UnitPaths = {"etc/systemd/system", "usr/lib/systemd/system"};
+static const fs::path ConfigPath {"etc/systemd/system"};
+
+
+std::vector<std::string> Systemd::enable(const fs::path& root, const std::vector<std::string>& units)
+{
+  std::vector<std::string> failed;
+  std::vector<std::string> done; // prevents cycles with Also=
+
+  for (const auto& unit : units)
+  {
+    if (!enable_unit(root, unit, done))
+      failed.push_back(unit);
+  }
+
+  return failed;
+}
+
+
+bool Systemd::enable_unit(const fs::path& root, const std::string_view unit, std::vector<std::string>& done)
+{
+  auto name = parse_name(unit);
+
+  if (rng::contains(done, name.name))
+    return true;
+
+  done.push_back(name.name);
+
+  const auto path = find_unit(root, name);
+  if (!path)
+  {
+    PLOGW << "Unit file not found: " << name.name;
+    return false;
+  }
+
+  UnitInstall install;
+  if (!parse_install(*path, install))
+    return false;
+
+  // a template enabled without an instance uses the DefaultInstance
+  if (name.instance.empty() && name.prefix.ends_with('@'))
+  {
+    if (install.default_instance.empty())
+    {
+      PLOGW << "Template has no instance or DefaultInstance: " << name.name;
+      return false;
+    }
+
+    name = parse_name(std::format("{}{}{}", name.prefix, install.default_instance, name.suffix));
+  }
+
+  // the link target is the path in the installed system
+  const auto target = fs::path{"/"} / path->lexically_relative(root);
+  bool linked{true};
+
+  // symlinks named as the unit (including the instance), in the dependency directories
+  auto link_dependency = [&](const std::vector<std::string>& units, const std::string_view dir_suffix)
+  {
+    for (const auto& dependent : units)
+    {
+      const auto dir = root / ConfigPath / std::format("{}{}", expand(dependent, name), dir_suffix);
+      linked &= link(dir / name.name, target);
+    }
+  };
+
+  link_dependency(install.wanted_by, ".wants");
+  link_dependency(install.required_by, ".requires");
+  link_dependency(install.upheld_by, ".upholds");
+
+  for (const auto& alias : install.alias)
+    linked &= link(root / ConfigPath / expand(alias, name), target);
+
+  for (const auto& also : install.also)
+    linked &= enable_unit(root, expand(also, name), done);
+
+  PLOGI_IF(install.wanted_by.empty() && install.required_by.empty() && install.upheld_by.empty() && install.alias.empty())
+    << "Unit has no install config: " << name.name;
+
+  return linked;
+}
+
+
+Systemd::UnitName Systemd::parse_name(const std::string_view unit)
+{
+  UnitName name{.name = std::string{unit}};
+
+  // as systemctl, a name without a type is a service
+  if (name.name.rfind('.') == std::string::npos)
+    name.name += ".service";
+
+  const auto dot = name.name.rfind('.');
+  name.suffix = name.name.substr(dot);
+
+  if (const auto at = name.name.find('@'); at != std::string::npos)
+  {
+    name.prefix = name.name.substr(0, at+1);
+    name.instance = name.name.substr(at+1, dot-at-1);
+  }
+  else
+    name.prefix = name.name.substr(0, dot);
+
+  return name;
+}
+
+
+std::optional<fs::path> Systemd::find_unit(const fs::path& root, const UnitName& name)
+{
+  // an instance is enabled from its template, unless it has its own unit file
+  std::vector<std::string> names {name.name};
+  if (!name.instance.empty())
+    names.push_back(name.prefix + name.suffix);
+
+  for (const auto& file : names)
+  {
+    for (const auto& dir : UnitPaths)
+    {
+      // a unit in /etc which links to /usr/lib is enabled from /usr/lib, as systemctl does
+      if (const auto path = root / dir / file; fs::is_regular_file(path) && !fs::is_symlink(path))
+        return path;
+    }
+  }
+
+  return std::nullopt;
+}
+
+
+bool Systemd::parse_install(const fs::path& path, UnitInstall& install)
+{
+  std::ifstream stream{path};
+  if (!stream)
+  {
+    PLOGE << "Failed to open " << path.string();
+    return false;
+  }
+
+  bool in_install{};
+
+  for (std::string line; std::getline(stream, line); )
+  {
+    const auto first = line.find_first_not_of(" \t");
+    if (first == std::string::npos || line[first] == '#' || line[first] == ';')
+      continue;
+
+    const std::string_view trimmed {std::string_view{line}.substr(first)};
+
+    if (trimmed.starts_with('['))
+    {
+      in_install = trimmed.starts_with("[Install]");
+      continue;
+    }
+    else if (!in_install)
+      continue;
+
+    const auto eq = trimmed.find('=');
+    if (eq == std::string_view::npos)
+      continue;
+
+    auto trim = [](const std::string_view sv)
+    {
+      const auto start = sv.find_first_not_of(" \t");
+      return start == std::string_view::npos ? std::string_view{} : sv.substr(start, sv.find_last_not_of(" \t") - start + 1);
+    };
+
+    const auto key = trim(trimmed.substr(0, eq));
+    const auto value = trim(trimmed.substr(eq + 1));
+
+    std::vector<std::string> * list{};
+
+    if (key == "WantedBy")
+      list = &install.wanted_by;
+    else if (key == "RequiredBy")
+      list = &install.required_by;
+    else if (key == "UpheldBy")
+      list = &install.upheld_by;
+    else if (key == "Alias")
+      list = &install.alias;
+    else if (key == "Also")
+      list = &install.also;
+    else if (key == "DefaultInstance")
+      install.default_instance = value;
+
+    if (!list)
+      continue;
+
+    // an empty assignment resets the list
+    if (value.empty())
+      list->clear();
+
+    for (const auto item : value | view::split(' '))
+    {
+      if (const std::string_view sv{item}; !sv.empty())
+        list->emplace_back(sv);
+    }
+  }
+
+  return true;
+}
+
+
+// Specifiers used in [Install]: %n, %N, %p, %i, %I and %%
+std::string Systemd::expand(const std::string_view value, const UnitName& name)
+{
+  std::string expanded;
+
+  for (std::size_t i = 0 ; i < value.size() ; ++i)
+  {
+    if (value[i] != '%' || i + 1 == value.size())
+    {
+      expanded += value[i];
+      continue;
+    }
+
+    switch (value[++i])
+    {
+      case 'n': expanded += name.name; break;
+      case 'N': expanded += name.name.substr(0, name.name.size() - name.suffix.size()); break;
+      case 'p': expanded += name.prefix.ends_with('@') ? name.prefix.substr(0, name.prefix.size()-1) : name.prefix; break;
+      case 'i':
+      case 'I': expanded += name.instance; break;
+      case '%': expanded += '%'; break;
+      default:
+        expanded += '%';
+        expanded += value[i];
+      break;
+    }
+  }
+
+  return expanded;
+}
+
+
+bool Systemd::link(const fs::path& link_path, const fs::path& target)
+{
+  std::error_code ec;
+
+  fs::create_directories(link_path.parent_path(), ec);
+
+  // replaces an existing link, as systemctl enable --force
+  if (fs::is_symlink(link_path, ec))
+    fs::remove(link_path, ec);
+
+  if (fs::create_symlink(target, link_path, ec); ec)
+  {
+    PLOGE << "Failed to link " << link_path.string() << " to " << target.string() << ": " << ec.message();
+    return false;
+  }
+
+  PLOGI << "Created symlink " << link_path.string() << " -> " << target.string();
+
+  return true;
+}
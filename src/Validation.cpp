@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <format>
+#include <wali/BlockImage.hpp>
+#include <wali/GoldenImage.hpp>
+#include <wali/InstallEstimate.hpp>
+#include <wali/Validation.hpp>
+
+
+using Level = ValidationMessage::Level;
+
+
+bool Validation::mounts(const MountData& data, const Tree& tree, ValidationMessages& messages)
+{
+  ValidationMessages msgs;
+
+  if (!data.image.path.empty())
+    image(data, msgs);
+  else if (data.boot_dev == data.root_dev)
+    msgs.emplace_back(Level::Error, "Boot and root must be on separate partitions");
+  else if (data.boot_dev.empty())
+    msgs.emplace_back(Level::Error, "Boot not set");
+  else if (data.root_dev.empty())
+    msgs.emplace_back(Level::Error, "Root not set");
+
+  if (data.image.path.empty() && data.home_target != HomeMountTarget::Root)
+  {
+    if (data.home_dev == data.boot_dev || data.home_dev == data.root_dev)
+      msgs.emplace_back(Level::Error, "/home is mounted to root or boot partition");
+    else if (data.home_dev.empty())
+      msgs.emplace_back(Level::Error, "/home is invalid");
+  }
+
+  // the UI only offers partitions and these filesystems, but an answer file or the API may not
+  auto check_partition = [&msgs, &tree](const std::string_view name, const std::string& dev)
+  {
+    if (!dev.empty() && DiskUtils::get_partition_disk(tree, dev).empty())
+      msgs.emplace_back(Level::Error, std::format("{} is not a partition: {}", name, dev));
+  };
+
+  auto check_fs = [&msgs](const std::string_view name, const std::string& fs)
+  {
+    if (!rng::contains(Filesystems, fs))
+      msgs.emplace_back(Level::Error, std::format("{} filesystem '{}' is not supported", name, fs));
+  };
+
+  // an image's partitions don't exist until Install creates them, and its boot is always vfat
+  if (data.image.path.empty())
+  {
+    check_partition("Boot", data.boot_dev);
+    check_partition("Root", data.root_dev);
+
+    if (data.home_target != HomeMountTarget::Root)
+      check_partition("/home", data.home_dev);
+
+    for (const auto& dev : data.root_stripe.devs)
+      check_partition("Root stripe", dev);
+
+    if (data.home_target == HomeMountTarget::New)
+    {
+      for (const auto& dev : data.home_stripe.devs)
+        check_partition("/home stripe", dev);
+    }
+
+    if (!data.boot_dev.empty() && data.boot_fs != "vfat")
+      msgs.emplace_back(Level::Error, "Boot filesystem must be vfat");
+  }
+
+  if (!data.root_dev.empty() || !data.image.path.empty())
+    check_fs("Root", data.root_fs);
+
+  if (data.home_target == HomeMountTarget::New && !data.home_dev.empty())
+    check_fs("/home", data.home_fs);
+
+  auto validate_stripe = [&msgs](const std::string_view name, const StripeData& stripe)
+  {
+    // the selected partition on this disk is always a member
+    const auto members = stripe.devs.size() + 1;
+
+    if (stripe.level == RaidLevel::Raid10 && members < 4)
+      msgs.emplace_back(Level::Error, std::format("{} RAID10 requires at least 3 partitions on other disks", name));
+    else if (stripe.level != RaidLevel::None && members < 2)
+      msgs.emplace_back(Level::Error, std::format("{} {} requires a partition on another disk", name, raid_level_name(stripe.level)));
+  };
+
+  validate_stripe("Root", data.root_stripe);
+  validate_stripe("/home", data.home_stripe);
+
+  if (rng::any_of(data.root_stripe.devs, [&data](const std::string& dev){ return rng::contains(data.home_stripe.devs, dev); }))
+    msgs.emplace_back(Level::Error, "Root and /home stripes share a partition");
+
+  if (const auto& luks = data.luks; luks.root || luks.home)
+  {
+    if (luks.passphrase.empty())
+      msgs.emplace_back(Level::Error, "Encryption passphrase not set");
+
+    if (luks.home && data.home_target != HomeMountTarget::New)
+      msgs.emplace_back(Level::Error, "Only a new /home can be encrypted");
+
+    // each device would need its own mapping
+    if ((luks.root && data.root_fs == "btrfs" && data.root_stripe.level != RaidLevel::None) ||
+        (luks.home && data.home_fs == "btrfs" && data.home_stripe.level != RaidLevel::None))
+    {
+      msgs.emplace_back(Level::Error, "Encryption is not supported for btrfs across disks");
+    }
+  }
+
+  // grub-mkconfig runs grub-probe on /, which can't read F2FS with extra features (compression, checksums)
+  if (data.root_fs == "f2fs" && data.boot_loader == Bootloader::Grub)
+    msgs.emplace_back(Level::Error, "GRUB does not support F2FS root, use systemd-boot");
+
+  if (!data.root_dev.empty())
+  {
+    const auto dc = DiskUtils::get_device_class(tree, data.root_dev);
+    const auto recommended = DiskUtils::get_recommended_fs(tree, data.root_dev);
+
+    if (data.root_fs != recommended)
+      msgs.emplace_back(Level::Info, std::format("{} is recommended for root on {}", recommended, DiskUtils::get_device_class_name(dc)));
+  }
+
+  messages.insert(messages.end(), msgs.cbegin(), msgs.cend());
+  return no_errors(msgs);
+}
+
+
+// the devices are the image's partitions, assigned by Install
+void Validation::image(const MountData& data, ValidationMessages& msgs)
+{
+  static const int64_t MinSize = ImageBootSize + RootSizeMin;
+
+  const auto& image = data.image;
+
+  if (std::error_code ec; !fs::is_directory(fs::absolute(image.path).parent_path(), ec))
+    msgs.emplace_back(Level::Error, std::format("Image directory does not exist: {}", image.path));
+
+  if (image.size < MinSize)
+    msgs.emplace_back(Level::Error, std::format("Image must be at least {}", format_size(MinSize)));
+
+  if (data.home_target != HomeMountTarget::Root)
+    msgs.emplace_back(Level::Error, "An image has /home on the root partition");
+
+  if (data.root_stripe.level != RaidLevel::None || !data.root_stripe.devs.empty())
+    msgs.emplace_back(Level::Error, "An image can't be striped across disks");
+}
+
+
+bool Validation::accounts(const AccountsData& data, ValidationMessages& messages)
+{
+  ValidationMessages msgs;
+
+  if (data.root_pass.empty())
+    msgs.emplace_back(Level::Error, "Root password not set");
+
+  if (data.user_username.empty())
+    msgs.emplace_back(Level::Error, "Username not set");
+  else if (data.user_pass.empty())
+    msgs.emplace_back(Level::Error, "User password not set");
+
+  if (!rng::contains(UserShells, data.user_shell))
+    msgs.emplace_back(Level::Error, std::format("Shell '{}' is not supported", data.user_shell));
+
+  messages.insert(messages.end(), msgs.cbegin(), msgs.cend());
+  return no_errors(msgs);
+}
+
+
+bool Validation::network(const netmanagerata& data, ValidationMessages& messages)
+{
+  if (data.hostname.empty())
+  {
+    messages.emplace_back(Level::Error, "Hostname not set");
+    return false;
+  }
+  return true;
+}
+
+
+bool Validation::localise(const LocaliseData& data, const Facts& facts, ValidationMessages& messages)
+{
+  ValidationMessages msgs;
+
+  // each is optional, but if set must be known
+  auto check = [&msgs](const std::string_view name, const std::string& value, const NameIndex& index)
+  {
+    if (!value.empty() && !index.contains(value))
+      msgs.emplace_back(Level::Error, std::format("Unknown {}: {}", name, value));
+  };
+
+  check("timezone", data.timezone, facts.timezones);
+  check("locale", data.locale, facts.locales);
+  check("keymap", data.keymap, facts.keymaps);
+
+  messages.insert(messages.end(), msgs.cbegin(), msgs.cend());
+  return no_errors(msgs);
+}
+
+
+bool Validation::archive(const WidgetData& widget_data, ValidationMessages& messages)
+{
+  const auto& data = widget_data.archive;
+  const auto& mounts = widget_data.mounts;
+
+  ValidationMessages msgs;
+
+  if (ArchiveParts parts; !data.deploy.empty() && !GoldenImage::read_manifest(data.deploy, parts))
+    msgs.emplace_back(Level::Error, std::format("Not a captured install: {}", data.deploy));
+  else if (rng::any_of(parts, GoldenImage::is_blocks) && !BlockImage::can_capture(mounts.root_fs))
+    msgs.emplace_back(Level::Error, "The archive's root is a block image, which requires an ext4 root");
+
+  // a deployed archive replaces pacstrap, so packages are not installed
+  if (!data.deploy.empty())
+  {
+    std::string ignored;
+
+    auto ignore = [&ignored](const bool set, const std::string_view name)
+    {
+      if (set)
+        ignored += std::format("{}{}", ignored.empty() ? "" : ", ", name);
+    };
+
+    ignore(!widget_data.video.drivers.empty(), "video drivers");
+    ignore(!widget_data.desktop.desktop.empty() || !widget_data.desktop.dm.empty() || !widget_data.desktop.services.empty(), "desktop");
+    ignore(!widget_data.packages.additional.empty(), "additional packages");
+
+    if (!ignored.empty())
+      msgs.emplace_back(Level::Warning, std::format("Deploying an archive, so these are ignored: {}", ignored));
+  }
+
+  if (data.blocks && !BlockImage::can_capture(mounts.root_fs))
+    msgs.emplace_back(Level::Error, "Capturing a block image requires an ext4 root");
+
+  if (!data.capture.empty())
+  {
+    if (std::error_code ec; !fs::is_directory(fs::absolute(data.capture).parent_path(), ec))
+      msgs.emplace_back(Level::Error, std::format("Capture directory's parent does not exist: {}", data.capture));
+    else if (fs::equivalent(data.capture, data.deploy, ec))
+      msgs.emplace_back(Level::Error, "Can't capture to the deployed archive");
+  }
+
+  messages.insert(messages.end(), msgs.cbegin(), msgs.cend());
+  return no_errors(msgs);
+}
+
+
+bool Validation::all(const WidgetData& data, const Facts& facts, ValidationMessages& messages)
+{
+  // evaluate all, so every problem is reported
+  const auto valid_mounts = mounts(data.mounts, facts.tree, messages);
+  const auto valid_accounts = accounts(data.accounts, messages);
+  const auto valid_network = network(data.network, messages);
+  const auto valid_localise = localise(data.localise, facts, messages);
+  const auto valid_archive = archive(data, messages);
+
+  const auto est = InstallEstimate::estimate(data);
+
+  if (!est.missing.empty())
+    messages.emplace_back(Level::Warning, std::format("Not found: {}", flatten(est.missing)));
+
+  if (!est.fits())
+  {
+    messages.emplace_back(Level::Error, std::format("Root requires at least {}, but is {}", format_size(static_cast<int64_t>(est.required)),
+                                                                                            format_size(est.root_capacity)));
+  }
+
+  return valid_mounts && valid_accounts && valid_network && valid_localise && valid_archive && est.fits();
+}
+
+
+bool Validation::no_errors(const ValidationMessages& messages)
+{
+  return rng::none_of(messages, [](const ValidationMessage& msg){ return msg.level == Level::Error; });
+}
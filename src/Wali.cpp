@@ -3,7 +3,11 @@
 #include "wali/Common.hpp"
 #include "wali/Install.hpp"
 #include <algorithm>
+#include <charconv>
 #include <concepts>
+#include <functional>
+#include <future>
+#include <optional>
 #include <string>
 #include <string_view>
 
@@ -24,8 +28,12 @@
 #include <Wt/WStackedWidget.h>
 #include <plog/Init.h>
 #include <plog/Appenders/ColorConsoleAppender.h>
+#include <wali/Api.hpp>
 #include <wali/Commands.hpp>
+#include <wali/Headless.hpp>
 #include <wali/LogFormat.hpp>
+#include <wali/PackageLookup.hpp>
+#include <wali/SystemFacts.hpp>
 #include <wali/widgets/Common.hpp>
 #include <wali/widgets/AccountsWidget.hpp>
 #include <wali/widgets/DesktopWidget.hpp>
@@ -40,7 +48,6 @@
 
 
 static plog::ColorConsoleAppender<WaliFormatter> consoleAppender;
-static WidgetDataPtr data;
 
 
 static void init_logger ()
@@ -54,22 +61,6 @@ static void init_logger ()
   }
 }
 
-static bool sync_system_clock()
-{
-  ReadCommand cmd;
-  return cmd.execute("timedatectl") == CmdSuccess;
-}
-
-static std::string startup_checks()
-{
-  if (!PlatformSizeValid{}())
-    return "Platform size not found or not 64bit";
-  else if (!sync_system_clock())
-    return "Sync clock with timedatectl failed";
-  else
-    return "";
-}
-
 
 class NavBar : public WContainerWidget
 {
@@ -132,10 +123,10 @@ class WaliApplication : public Wt::WApplication
         btn->setMinimumSize(100, 40);
         btn->setMaximumSize(100, 40);
         //+1 because the first widget in the stack is home/menu page
-        btn->clicked().connect([stack, widget_index = index+1]()
+        btn->clicked().connect([this, widget_index = index+1]()
         {
-          if (widget_index < stack->count())
-            stack->setCurrentIndex(widget_index);
+          if (widget_index < m_stack->count())
+            show_page(widget_index);
         });
       }
     }
@@ -146,15 +137,29 @@ class WaliApplication : public Wt::WApplication
     #ifndef WALI_SKIP_VALIDATION
       m_btn_install->disable();
     #endif
-    m_btn_install->clicked().connect([=]()
+    m_btn_install->clicked().connect([this]()
     {
+      // pages not yet shown must still write their defaults to WidgetData
+      for (std::size_t i = 0 ; i < m_pages.size() ; ++i)
+        create_page(i);
+
+      #ifndef WALI_SKIP_VALIDATION
+        // a page's defaults may not be valid, i.e. no video driver for the GPU
+        if (const auto it = rng::find_if(m_pages, [](const Page& p){ return !p.widget->is_data_valid(); }); it != m_pages.end())
+        {
+          show_page(std::distance(m_pages.begin(), it) + 1);
+          return;
+        }
+      #endif
+
       // InstallWidget is last in stack
-      stack->setCurrentIndex(stack->count()-1);
+      show_page(m_stack->count()-1);
     });
 
     return cont;
   }
 
+  // Each page has an empty placeholder in the stack, the page is created when first shown
   std::unique_ptr<WStackedWidget> create_stack ()
   {
     auto stack = make_wt<WStackedWidget>();
@@ -162,15 +167,23 @@ class WaliApplication : public Wt::WApplication
 
     auto add_page = [this]<typename W>() requires (std::derived_from<W, WaliWidget>)
     {
-      auto widget = m_stack->addWidget(make_wt<W>(data));
-
-      auto wali_widget = dynamic_cast<WaliWidget *>(widget);
-      wali_widget->data_valid().connect([this](const bool v)
+      auto create = [this](WContainerWidget * placeholder) -> WaliWidget *
       {
-        on_validity(v);
-      });
+        auto widget = placeholder->addWidget(make_wt<W>(m_data));
+        widget->data_valid().connect([this](const bool){ on_validity(); });
+
+        if constexpr (std::same_as<W, InstallWidget>)
+        {
+          widget->install_state().connect([this](InstallState st)
+          {
+            m_nav_bar->setHidden(st == InstallState::Running || st == InstallState::Complete);
+          });
+        }
 
-      return widget;
+        return widget;
+      };
+
+      m_pages.push_back(Page{.placeholder = m_stack->addWidget(make_wt<WContainerWidget>()), .create = create});
     };
 
     stack->addWidget(create_home_widget(stack.get()));
@@ -181,44 +194,56 @@ class WaliApplication : public Wt::WApplication
     add_page.operator()<LocaliseWidget>();
     add_page.operator()<DesktopWidget>();
     add_page.operator()<PackagesWidget>();
-    m_install_widget = add_page.operator()<InstallWidget>();
-    m_install_widget->install_state().connect([this](InstallState st)
-    {
-      m_nav_bar->setHidden(st == InstallState::Running || st == InstallState::Complete);
-    });
+    add_page.operator()<InstallWidget>();
 
     return stack;
   }
 
-  // A WaliWidget has a data_valid() event, which when triggered, will call on_validity().
-  void on_validity(const bool valid)
+  void create_page(const std::size_t index)
+  {
+    if (auto& page = m_pages[index]; !page.widget)
+    {
+      page.widget = page.create(page.placeholder);
+      on_validity();
+    }
+  }
+
+  void show_page(const int stack_index)
+  {
+    // stack index 0 is the home widget, which is not in m_pages
+    if (stack_index > 0)
+    {
+      create_page(stack_index-1);
+      m_pages[stack_index-1].widget->on_show();
+    }
+
+    m_stack->setCurrentIndex(stack_index);
+  }
+
+  // A WaliWidget records its validity in WidgetData then triggers data_valid(),
+  // which calls on_validity(). Pages not yet created have their default validity.
+  void on_validity()
   {
     #ifndef WALI_SKIP_VALIDATION
-      const auto have_invalid = rng::any_of(m_stack->children(), [](const WWidget * w)
-      {
-        const auto wali_widget = dynamic_cast<const WaliWidget *>(w);
-        return wali_widget ? !wali_widget->is_data_valid() : false;
-      });
-      // only valid if the caller is valid and no other widgets are invalid
-      m_btn_install->setEnabled(valid && !have_invalid);
+      m_btn_install->setEnabled(m_data->valid.all());
     #endif
   }
 
 
   void fake_data()
   {
-    data->mounts.boot_dev = "/dev/sda1";
-    data->mounts.root_dev = "/dev/sda2";
-    data->mounts.boot_fs = "vfat";
-    data->mounts.root_fs = "ext4";
-    data->mounts.home_target = HomeMountTarget::Root;
-    data->accounts.user_username = "fake";
-    data->accounts.user_pass = "nessie";
-    data->accounts.user_shell = "zsh";
-    data->accounts.user_sudo = true;
-    data->desktop.iwd = true;
-    data->desktop.netmanager = false;
-    data->desktop.dm = PackageSet{"sddm"};
+    m_data->mounts.boot_dev = "/dev/sda1";
+    m_data->mounts.root_dev = "/dev/sda2";
+    m_data->mounts.boot_fs = "vfat";
+    m_data->mounts.root_fs = "ext4";
+    m_data->mounts.home_target = HomeMountTarget::Root;
+    m_data->accounts.user_username = "fake";
+    m_data->accounts.user_pass = "nessie";
+    m_data->accounts.user_shell = "zsh";
+    m_data->accounts.user_sudo = true;
+    m_data->desktop.iwd = true;
+    m_data->desktop.netmanager = false;
+    m_data->desktop.dm = PackageSet{"sddm"};
     // data->desktop.desktop = PackageSet{"niri"};
   }
 
@@ -229,9 +254,41 @@ public:
     useStyleSheet("wali.css");
     enableUpdates(true);
 
+    // a failed startup check (i.e. the clock couldn't sync without a network) is retried
+    // by a new session, rather than until the server restarts
+    const bool retry = SystemFacts::is_ready() && !SystemFacts::get()->startup_error.empty();
+
+    if (SystemFacts::is_ready() && !retry)
+      create_ui();
+    else
+    {
+      // only when a session starts whilst the server is still collecting, or retrying
+      root()->addWidget(make_wt<WText>("<h2>Reading system information...</h2>"));
+
+      m_facts_loaded = std::async(std::launch::async, [this, retry, sid = sessionId()]
+      {
+        if (retry)
+          SystemFacts::refresh();
+        else
+          SystemFacts::get();
+
+        WServer::instance()->post(sid, [this]()
+        {
+          root()->clear();
+          create_ui();
+          triggerUpdate();
+        });
+      });
+    }
+  }
+
+
+private:
+  void create_ui()
+  {
     auto layout = root()->setLayout(make_wt<WVBoxLayout>());
 
-    if (const auto err = startup_checks() ; !err.empty())
+    if (const auto& err = SystemFacts::get()->startup_error ; !err.empty())
     {
       PLOGE << err;
       layout->addWidget(make_wt<WText>(std::format("<h1>Startup checks failed</h1> <br/> <h2>{}</h2>", err)));
@@ -239,7 +296,7 @@ public:
     }
     else
     {
-      data = std::make_shared<WidgetData>();
+      m_data = std::make_shared<WidgetData>();
 
       root()->setMargin(0);
       root()->setPadding(0);
@@ -280,6 +337,10 @@ public:
       });
 
       #ifdef WALI_FAKE_DATA
+        // pages write their defaults when created, which would replace the fake data
+        for (std::size_t i = 0 ; i < m_pages.size() ; ++i)
+          create_page(i);
+
         fake_data();
 
         #ifdef WALI_SKIP_VALIDATION
@@ -291,10 +352,19 @@ public:
 
 
 private:
+  struct Page
+  {
+    WContainerWidget * placeholder{};
+    WaliWidget * widget{};  // null until first shown
+    std::function<WaliWidget * (WContainerWidget *)> create;
+  };
+
+  WidgetDataPtr m_data; // per session, each may install to different disks
   WStackedWidget * m_stack{};
   WPushButton * m_btn_install{};
   NavBar * m_nav_bar{};
-  InstallWidget * m_install_widget;
+  std::vector<Page> m_pages;  // in stack order, after the home widget
+  std::future<void> m_facts_loaded;
 };
 
 
@@ -302,11 +372,97 @@ int main(int argc, char **argv)
 {
   init_logger();
 
+  // --headless, --answers, --api and the install job options are for wali, the remaining are for Wt
+  std::vector<char *> args {argv, argv + argc};
+  std::optional<fs::path> answers;
+  bool headless{}, api{};
+  InstallJobs jobs;
+
+  auto jobs_value = [](const std::string_view value, std::size_t& limit)
+  {
+    if (std::size_t n{}; std::from_chars(value.data(), value.data() + value.size(), n).ec == std::errc{} && n > 0)
+      limit = n;
+    else
+      PLOGW << "Ignoring invalid number of jobs: " << value;
+  };
+
+  for (auto it = std::next(args.begin()) ; it != args.end() ; )
+  {
+    if (const std::string_view arg {*it}; arg == "--headless")
+    {
+      headless = true;
+      it = args.erase(it);
+    }
+    else if (arg == "--api")
+    {
+      api = true;
+      it = args.erase(it);
+    }
+    else if (arg == "--answers" && std::next(it) != args.end())
+    {
+      answers = *std::next(it);
+      it = args.erase(it, std::next(it, 2));
+    }
+    else if (arg == "--pacman-jobs" && std::next(it) != args.end())
+    {
+      jobs_value(*std::next(it), jobs.pacman);
+      it = args.erase(it, std::next(it, 2));
+    }
+    else if (arg == "--mkfs-jobs" && std::next(it) != args.end())
+    {
+      jobs_value(*std::next(it), jobs.mkfs);
+      it = args.erase(it, std::next(it, 2));
+    }
+    else if (arg == "--package-cache" && std::next(it) != args.end())
+    {
+      jobs.package_cache = *std::next(it);
+      it = args.erase(it, std::next(it, 2));
+    }
+    else
+      ++it;
+  }
+
+  Install::set_jobs(jobs);
+
+  if (headless != answers.has_value())
+  {
+    PLOGE << "--headless and --answers <file> must be used together";
+    return Headless::Invalid;
+  }
+  else if (headless)
+    return Headless::run(*answers);
+
+  // collected whilst the server starts, rather than by the first session
+  SystemFacts::warm();
+
   PLOGI << "Starting webtoolkit";
 
-  return Wt::WRun(argc, argv, [](const Wt::WEnvironment& env)
+  try
   {
-    PLOGI << "Web server running on " << std::format("{}://{}", env.urlScheme(), env.hostName());
-    return std::make_unique<WaliApplication>(env);
-  });
+    // rather than WRun(), so the API resources can be added
+    WServer server {args[0]};
+    server.setServerConfiguration(static_cast<int>(args.size()), args.data(), WTHTTP_CONFIGURATION);
+    server.addEntryPoint(EntryPointType::Application, [](const Wt::WEnvironment& env)
+    {
+      PLOGI << "Web server running on " << std::format("{}://{}", env.urlScheme(), env.hostName());
+      return std::make_unique<WaliApplication>(env);
+    });
+
+    if (api)
+      Api::add_resources(server);
+
+    if (server.start())
+    {
+      WServer::waitForShutdown();
+      server.stop();
+      PackageLookup::shutdown();
+    }
+  }
+  catch (const WServer::Exception& ex)
+  {
+    PLOGE << "Web server: " << ex.what();
+    return 1;
+  }
+
+  return 0;
 }
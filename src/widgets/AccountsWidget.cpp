@@ -1,4 +1,5 @@
 #include <Wt/WComboBox.h>
+#include <wali/Validation.hpp>
 #include <wali/widgets/AccountsWidget.hpp>
 
 
@@ -26,9 +27,8 @@ AccountWidget::AccountWidget(WidgetDataPtr data) : WaliWidget(data, "Accounts")
 
   m_user_shell = add_form_pair<WComboBox>(cont_layout, "Shell", 100);
   m_user_shell->changed().connect(this, &AccountWidget::update_data);
-  m_user_shell->addItem("zsh");
-  m_user_shell->addItem("fish");
-  m_user_shell->addItem("sh");
+  for (const auto shell : UserShells)
+    m_user_shell->addItem(std::string{shell});
 
   m_user_sudo = add_form_pair<WCheckBox>(cont_layout, "Sudo", 100);
   m_user_sudo->setCheckState(CheckState::Checked);
@@ -61,7 +61,6 @@ void AccountWidget::update_data()
 
 bool AccountWidget::check_validity() const
 {
-    return  !m_data->accounts.root_pass.empty() &&
-            !m_data->accounts.user_username.empty() &&
-            !m_data->accounts.user_pass.empty();
+  ValidationMessages messages;
+  return Validation::accounts(m_data->accounts, messages);
 }
@@ -15,6 +15,7 @@
 #include <ranges>
 #include <sstream>
 #include <string_view>
+#include <wali/SystemFacts.hpp>
 #include <wali/widgets/DesktopWidget.hpp>
 #include <wali/Common.hpp>
 
@@ -51,11 +52,15 @@ DesktopWidget::DesktopWidget(WidgetDataPtr data) : WaliWidget(data, "Desktop")
   // video drivers
   layout->addWidget(make_wt<WText>("<h3>Video Drivers</h3>"));
   m_video_widget = layout->addWidget(make_wt<VideoWidget>(m_data));
-  m_video_widget->data_valid().connect([this](const bool valid){ set_valid(valid); });
+  m_video_widget->data_valid().connect([this](const bool valid)
+  {
+    set_valid(valid);
+    set_fits(m_estimate->refresh(*m_data));
+  });
 
   // desktop
   layout->addWidget(make_wt<WText>("<h3>Desktop</h3>"));
-  layout->addWidget(make_wt<WText>("Desktops, except None, ensure your root partition is at least 24GB."));
+  m_estimate = layout->addWidget(make_wt<EstimateWidget>());
   layout->addSpacing(15);
 
   // desktop combo
@@ -70,7 +75,11 @@ DesktopWidget::DesktopWidget(WidgetDataPtr data) : WaliWidget(data, "Desktop")
   wm_layout->addWidget(make_wt<WLabel>("Login"));
   m_dm = wm_layout->addWidget(make_wt<WComboBox>());
   m_dm->addItem("sddm");
-  m_dm->changed().connect([this]{ m_data->desktop.dm = PackageSet{{m_dm->currentText().toUTF8()}}; });
+  m_dm->changed().connect([this]
+  {
+    m_data->desktop.dm = PackageSet{{m_dm->currentText().toUTF8()}};
+    set_fits(m_estimate->refresh(*m_data));
+  });
   wm_layout->addStretch(1);
 
   read_profiles();
@@ -87,7 +96,6 @@ DesktopWidget::DesktopWidget(WidgetDataPtr data) : WaliWidget(data, "Desktop")
 
 void DesktopWidget::read_profiles()
 {
-  static const fs::path ProfileDir {"profiles"};
   static const std::set<std::string> RequiredKeys {KeyName, KeyPackagesRequired, KeyInfo, KeyIwd, KeyNetManager};
 
   auto object_valid = [](const std::set<std::string>& keys)
@@ -123,25 +131,9 @@ void DesktopWidget::read_profiles()
   if (const auto name = read_file("None", NoneJson); name)
     m_desktops->addItem(*name);
 
-  const auto path = WApplication::instance()->docRoot() / ProfileDir;
-
-  if (!fs::exists(path))
-  {
-    PLOGE << "Profile path does not exist: " << path.string();
-    return;
-  }
-
-  for(const auto& entry : fs::directory_iterator{path} | view::filter([](const fs::directory_entry& e){ return e.path().extension() == ".json"; }))
+  for (const auto& [file, json] : SystemFacts::profiles(WApplication::instance()->docRoot()))
   {
-    PLOGI << "Reading profile: " << entry.path().string();
-
-    std::stringstream buff;
-    {
-      std::ifstream stream {entry.path()};
-      buff << stream.rdbuf();
-    }
-
-    if (const auto name = read_file(entry.path().string(), buff.str()); name)
+    if (const auto name = read_file(file, json); name)
       m_desktops->addItem(*name);
   }
 }
@@ -164,7 +156,6 @@ void DesktopWidget::on_desktop_change()
   m_data->desktop.desktop.clear();
   m_data->desktop.dm.clear();
   m_data->desktop.services.clear();
-  //m_warning->setText("");
 
   for (const auto& value : (Json::Array)profile.get(KeyPackagesRequired))
     m_data->desktop.desktop.emplace((PackageSet::value_type)value);
@@ -181,13 +172,14 @@ void DesktopWidget::on_desktop_change()
   {
     m_data->desktop.dm.emplace("sddm");
     m_data->desktop.services.emplace("sddm.service");
+  }
 
-    // if (const auto size = DiskUtils::get_disk_size(m_data->mounts.root_dev); size)
-    // {
-    //   PLOGI << "Root dev size: " << *size;
+  set_fits(m_estimate->refresh(*m_data));
+}
 
-    //   if (size < gb_to_b(12))
-    //     m_warning->setText("<span style='color: red;'>This profile requires the root partition is at least 12Gb.</span>");
-    // }
-  }
+
+void DesktopWidget::on_show()
+{
+  // mounts may have changed since the desktop was chosen
+  set_fits(m_estimate->refresh(*m_data));
 }
@@ -11,9 +11,12 @@
 #include <Wt/WGlobal.h>
 #include <Wt/WLength.h>
 #include <Wt/WLineEdit.h>
+#include <Wt/WLink.h>
+#include <Wt/WMemoryResource.h>
 #include <Wt/WPopupMenu.h>
 #include <Wt/WText.h>
 #include <Wt/WVBoxLayout.h>
+#include <wali/AnswerFile.hpp>
 #include <wali/Common.hpp>
 #include <wali/widgets/Common.hpp>
 #include <wali/Install.hpp>
@@ -109,6 +112,7 @@ InstallWidget::InstallWidget(WidgetDataPtr data) : WaliWidget(data, "Install")
   m_install_btn = controls_layout->addWidget(make_wt<WPushButton>("Install"));
   m_cancel_btn = controls_layout->addWidget(make_wt<WPushButton>("Cancel"));
   m_reboot_btn = controls_layout->addWidget(make_wt<WPushButton>("Reboot"));
+  m_export_btn = controls_layout->addWidget(make_wt<WPushButton>("Export"));
   //m_savelog_btn = controls_layout->addWidget(make_wt<WSplitButton>("Save Log"));
 
   m_install_btn->clicked().connect([this]()
@@ -129,6 +133,12 @@ InstallWidget::InstallWidget(WidgetDataPtr data) : WaliWidget(data, "Install")
   m_reboot_btn->enable();
   m_reboot_btn->clicked().connect([] { Reboot{}(); });
 
+  // answer file for wali --headless, updated in on_show() because other pages change the data
+  m_answers = std::make_shared<WMemoryResource>("application/json");
+  m_answers->suggestFileName("answers.json");
+  m_export_btn->setLink(WLink{m_answers});
+  m_export_btn->setToolTip("Download the configuration as an answer file. This includes passwords.");
+
   // m_savelog_btn->disable();
   // auto savelog_options = make_wt<WPopupMenu>();
   // savelog_options->addItem("Save to single file");
@@ -150,6 +160,9 @@ InstallWidget::InstallWidget(WidgetDataPtr data) : WaliWidget(data, "Install")
   m_install_status->addStyleClass("install_status_partial");
   m_install_status->setStyleClass("install_status_ready");
 
+  m_estimate = layout->addWidget(make_wt<EstimateWidget>(), 0, AlignmentFlag::Center);
+  m_estimate->setWidth(600);
+
   m_summary = layout->addWidget(make_wt<SummaryWidget>(data),  0, AlignmentFlag::Center);
   m_summary->hide();
 
@@ -166,6 +179,20 @@ InstallWidget::InstallWidget(WidgetDataPtr data) : WaliWidget(data, "Install")
 }
 
 
+void InstallWidget::on_show()
+{
+  const auto json = AnswerFile::write(*m_data);
+  m_answers->setData(reinterpret_cast<const unsigned char *>(json.data()), static_cast<int>(json.size()));
+
+  const auto fits = m_estimate->refresh(*m_data);
+  set_fits(fits);
+
+  // only before the first install, after that the install state decides
+  if (!m_install_future.valid())
+    m_install_btn->setEnabled(fits);
+}
+
+
 void InstallWidget::cancel()
 {
   m_cancel_btn->disable();
@@ -339,7 +366,7 @@ void InstallWidget::on_install_status(const InstallState state, const std::strin
     m_on_install_state(state);
     set_install_status(status, css_class);
 
-    m_install_btn->setEnabled(allow_install);
+    m_install_btn->setEnabled(allow_install && m_data->valid.fits());
 
     const auto finished = state == InstallState::Complete || state == InstallState::Fail || state == InstallState::Cancelled;
     m_cancel_btn->setDisabled(finished);
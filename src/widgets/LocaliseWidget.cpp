@@ -1,5 +1,8 @@
 #include "wali/widgets/WaliWidget.hpp"
 #include <algorithm>
+#include <Wt/WStringListModel.h>
+#include <Wt/WSuggestionPopup.h>
+#include <wali/SystemFacts.hpp>
 #include <wali/widgets/LocaliselWidget.hpp>
 
 
@@ -25,42 +28,100 @@ static const std::vector<std::string> PriorityKeymaps =
 };
 
 
+// the popup only asks for suggestions after this many characters,
+// then again as the input changes, until all matches are shown
+static const constexpr int MinFilterLength = 1;
+static const constexpr std::size_t MaxSuggestions = 40;
+
+
 LocaliseWidget::LocaliseWidget(WidgetDataPtr data) : WaliWidget(data, "Locale")
 {
   auto layout = setLayout(make_wt<WVBoxLayout>());
 
-  // timezones
-  m_timezones = add_form_pair<WComboBox>(layout, "Timezone", 100);
-  m_timezones->setStyleClass("localise");
-  m_timezones->setNoSelectionEnabled(true);
-  m_timezones->changed().connect([this](){ m_data->localise.timezone = m_timezones->currentText().toUTF8(); });
+  m_facts = SystemFacts::get();
+
+  m_timezones = add_search(layout, "Timezone", m_facts->timezones, PriorityZones, m_data->localise.timezone);
+  m_locales = add_search(layout, "Locale", m_facts->locales, PriorityLocales, m_data->localise.locale);
+  m_keymap = add_search(layout, "Keymap", m_facts->keymaps, PriorityKeymaps, m_data->localise.keymap);
 
-  const auto zones = GetTimeZones{}();
-  rng::for_each(PriorityZones, [this](const auto zone){ m_timezones->addItem(zone); });
-  rng::for_each(zones, [this](const auto zone){ m_timezones->addItem(zone); });
+  layout->addStretch(1);
+
+  // locale optional
+  set_valid(true);
+}
 
-  // locales
-  m_locales = add_form_pair<WComboBox>(layout, "Locale", 100);
-  m_locales->setStyleClass("localise");
-  m_locales->setNoSelectionEnabled(true);
-  m_locales->changed().connect([this](){ m_data->localise.locale = m_locales->currentText().toUTF8(); });
 
-  const auto locales = GetLocales{}();
-  rng::for_each(PriorityLocales, [this](const auto locale){ m_locales->addItem(locale); });
-  rng::for_each(locales, [this](const auto zone){ m_locales->addItem(zone); });
+WLineEdit * LocaliseWidget::add_search(WVBoxLayout * layout, const std::string_view label, const NameIndex& index,
+                                       const std::vector<std::string>& priority, std::string& value)
+{
+  WSuggestionPopup::Options options;
+  options.highlightBeginTag = "<b>";
+  options.highlightEndTag = "</b>";
+  options.listSeparator = 0;
+  options.whitespace = " \\n";
+  options.wordSeparators = std::string{NameIndex::WordSeparators};
 
-  // terminal key map
-  m_keymap = add_form_pair<WComboBox>(layout, "Keymap", 100);
-  m_keymap->setStyleClass("localise");
-  m_keymap->setNoSelectionEnabled(true);
-  m_keymap->changed().connect([this](){ m_data->localise.keymap = m_keymap->currentText().toUTF8(); });
+  auto edit = add_form_pair<WLineEdit>(layout, label, 100);
+  edit->setStyleClass("localise");
+  edit->setPlaceholderText("Type to search");
 
-  const auto keys = GetKeyMaps{}();
-  rng::for_each(PriorityKeymaps, [this](const auto zone){ m_keymap->addItem(zone); });
-  rng::for_each(keys, [this](const auto key){ m_keymap->addItem(key); });
+  // the model only holds matches for the current input, the full list stays on the server
+  auto model = std::make_shared<WStringListModel>();
 
-  layout->addStretch(1);
+  auto popup = addChild(make_wt<WSuggestionPopup>(options));
+  popup->forEdit(edit);
+  popup->setModel(model);
+  popup->setFilterLength(MinFilterLength);
+  popup->filterModel().connect([&index, &priority, model](const WString& input)
+  {
+    bool more{};
+    const auto matches = index.find(input.toUTF8(), MaxSuggestions, priority, more);
 
-  // locale optional
-  set_valid(true);
+    std::vector<WString> rows;
+    rows.reserve(matches.size());
+    for (const auto name : matches)
+      rows.emplace_back(WString::fromUTF8(std::string{name}));
+
+    model->setStringList(rows);
+
+    // tells the popup to filter again as more is typed
+    if (more)
+    {
+      model->addString("...");
+      model->setData(model->index(model->rowCount()-1, 0), std::string{"Wt-more-data"}, ItemDataRole::StyleClass);
+    }
+  });
+
+  auto set_value = [this, edit, &index, &value]()
+  {
+    const auto text = edit->text().toUTF8();
+    value = index.contains(text) ? text : "";
+    validate();
+  };
+
+  edit->changed().connect(set_value);
+  popup->activated().connect([set_value](const int, WFormWidget *){ set_value(); });
+
+  return edit;
+}
+
+
+void LocaliseWidget::validate()
+{
+  // each is optional, but if set must be in the list
+  auto valid = [](WLineEdit * edit, const std::string& value)
+  {
+    const auto empty = edit->text().empty();
+    edit->toggleStyleClass("invalid", !empty && value.empty());
+    return empty || !value.empty();
+  };
+
+  const auto& data = m_data->localise;
+
+  // evaluate all, so each is styled
+  const auto zone = valid(m_timezones, data.timezone);
+  const auto locale = valid(m_locales, data.locale);
+  const auto keymap = valid(m_keymap, data.keymap);
+
+  set_valid(zone && locale && keymap);
 }
@@ -9,6 +9,8 @@
 #include <Wt/WGlobal.h>
 #include <Wt/WPushButton.h>
 #include <Wt/WTable.h>
+#include <wali/SystemFacts.hpp>
+#include <wali/Validation.hpp>
 #include <wali/widgets/MountsWidget.hpp>
 #include <wali/widgets/PartitionsWidget.hpp>
 #include <wali/widgets/WidgetData.hpp>
@@ -20,9 +22,14 @@ MountsWidget::MountsWidget(WidgetDataPtr data) : WaliWidget(data, "Mounts")
   layout->setSpacing(15);
 
   m_partitions = std::make_shared<Partitions>();
+  m_other_partitions = std::make_shared<Partitions>();
 
   m_disk = add_form_pair<WComboBox>(layout, "Disk", 0);
-  m_disk->changed().connect([this]{ select_disk(m_disk->currentText().toUTF8()); });
+  m_disk->changed().connect([this]
+  {
+    select_disk(m_disk->currentText().toUTF8());
+    validate_selection();
+  });
 
   m_table = layout->addWidget(make_wt<WTable>());
   m_table->setStyleClass("table_partitions");
@@ -43,7 +50,10 @@ MountsWidget::MountsWidget(WidgetDataPtr data) : WaliWidget(data, "Mounts")
     dialog->finished().connect([=, this]()
     {
       if (partitions->is_changed())
+      {
+        SystemFacts::refresh_disks();
         refresh_data();
+      }
     });
     partitions->busy().connect([=](bool busy)
     {
@@ -58,18 +68,17 @@ MountsWidget::MountsWidget(WidgetDataPtr data) : WaliWidget(data, "Mounts")
 
 
   m_boot = layout->addWidget(make_wt<BootPartitionWidget>(m_partitions, [this]{validate_selection();}));
-  m_root = layout->addWidget(make_wt<RootPartitionWidget>(m_partitions, [this]{validate_selection();}));
-  m_home = layout->addWidget(make_wt<HomePartitionWidget>(m_partitions, [this]{validate_selection();}));
+  m_root = layout->addWidget(make_wt<RootPartitionWidget>(m_partitions, m_other_partitions, [this]{validate_selection();}));
+  m_home = layout->addWidget(make_wt<HomePartitionWidget>(m_partitions, m_other_partitions, [this]{validate_selection();}));
+  m_btrfs = layout->addWidget(make_wt<BtrfsWidget>([this]{validate_selection();}));
+  m_luks = layout->addWidget(make_wt<LuksWidget>([this]{validate_selection();}));
 
   layout->addWidget(make_wt<WText>("<h3>Boot loader</h3>"));
   m_boot_loader = layout->addWidget(make_wt<WComboBox>());
   m_boot_loader->setWidth(150);
   m_boot_loader->addItem("systemd-boot");
   m_boot_loader->addItem("grub");
-  m_boot_loader->changed().connect([this]
-  {
-    m_data->mounts.boot_loader = m_boot_loader->currentIndex() == 0 ? Bootloader::SystemdBoot : Bootloader::Grub;
-  });
+  m_boot_loader->changed().connect([this]{ validate_selection(); });
 
   layout->addWidget(make_wt<WText>("<h3>Swap</h3>"));
   m_zram = layout->addWidget(make_wt<WCheckBox>("zram"));
@@ -97,8 +106,9 @@ void MountsWidget::refresh_data()
 {
   auto valid_disk = [](const TreePair& pair){ return pair.first.is_gpt; } ;
 
-  m_tree = DiskUtils::probe();
+  m_tree = SystemFacts::get()->tree;
   m_partitions->clear();
+  m_other_partitions->clear();
   m_table->clear();
   m_disk->clear();
 
@@ -125,6 +135,7 @@ void MountsWidget::select_disk(const std::string& disk)
   auto valid_partition = [](const Partition& part) { return !part.is_mounted; };
 
   m_partitions->clear();
+  m_other_partitions->clear();
   m_table->clear();
 
   m_table->setHeaderCount(1);
@@ -135,6 +146,12 @@ void MountsWidget::select_disk(const std::string& disk)
   const auto& parts = m_tree.at(disk);
   m_partitions->append_range(parts | std::views::filter(valid_partition));
 
+  for (const auto& [other_disk, other_parts] : m_tree)
+  {
+    if (other_disk.dev != disk && other_disk.is_gpt)
+      m_other_partitions->append_range(other_parts | std::views::filter(valid_partition));
+  }
+
   // r=1 because of header row
   for(size_t r = 1, i = 0 ; i < parts.size() ; ++i)
   {
@@ -148,35 +165,28 @@ void MountsWidget::select_disk(const std::string& disk)
   m_boot->refresh_partitions();
   m_root->refresh_partitions();
   m_home->refresh_partitions();
+
+  m_root->set_fs(DiskUtils::get_recommended_fs(m_tree, disk));
 }
 
 
 void MountsWidget::validate_selection()
 {
-  const auto& boot_dev = m_boot->get_device();
-  const auto& root_dev = m_root->get_device();
+  set_data();
 
-  m_messages->clear_messages();
+  ValidationMessages messages;
+  Validation::mounts(m_data->mounts, m_tree, messages);
 
-  if (boot_dev == root_dev)
-    m_messages->add("Boot and root must be on separate partitions", MessageWidget::Level::Error);
-  else if (boot_dev.empty())
-    m_messages->add("Boot not set", MessageWidget::Level::Error);
-  else if (root_dev.empty())
-    m_messages->add("Root not set", MessageWidget::Level::Error);
+  // only the UI has a confirmation
+  if (m_luks->is_enabled() && !m_data->mounts.luks.passphrase.empty() && !m_luks->is_confirmed())
+    messages.emplace_back(ValidationMessage::Level::Error, "Encryption passphrases do not match");
 
-  const auto target = m_home->get_mount_target();
-  if (target != HomeMountTarget::Root)
-  {
-    const auto& home_dev = m_home->get_device();
-    if (home_dev == boot_dev || home_dev == root_dev)
-      m_messages->add("/home is mounted to root or boot partition", MessageWidget::Level::Error);
-    else if (home_dev.empty())
-      m_messages->add("/home is invalid", MessageWidget::Level::Error);
-  }
+  m_messages->clear_messages();
+  m_messages->add(messages);
 
   set_valid(!m_messages->has_errors());
-  set_data();
+
+  m_btrfs->setHidden(m_data->mounts.root_fs != "btrfs" && m_data->mounts.home_fs != "btrfs");
 }
 
 
@@ -188,8 +198,10 @@ void MountsWidget::set_data()
   data.boot_fs = m_boot->get_fs();
   data.root_dev = m_root->get_device();
   data.root_fs = m_root->get_fs();
+  data.root_stripe = m_root->get_stripe();
   data.home_dev = m_home->is_home_on_root() ? data.root_dev : m_home->get_device();
   data.home_target = m_home->get_mount_target();
+  data.home_stripe = m_home->get_stripe();
 
   if (data.home_target == HomeMountTarget::Root)
     data.home_fs = data.root_fs;
@@ -198,8 +210,6 @@ void MountsWidget::set_data()
   else
     data.home_fs = DiskUtils::get_partition_fs(m_tree, data.home_dev);
 
-  if (data.root_fs == "btrfs" || data.home_fs == "btrfs")
-    m_data->packages.additional.emplace("btrfs-progs");
-  else
-    m_data->packages.additional.erase("btrfs-progs");
+  data.btrfs = m_btrfs->get_data();
+  data.luks = m_luks->get_data();
 }
@@ -1,14 +1,25 @@
 #include <Wt/WApplication.h>
+#include <Wt/WFileUpload.h>
 #include <Wt/WGlobal.h>
 #include <Wt/WHBoxLayout.h>
 #include <Wt/WServer.h>
+#include <Wt/WStringListModel.h>
+#include <Wt/WSuggestionPopup.h>
+#include <Wt/WTextArea.h>
+#include <Wt/Utils.h>
 #include <algorithm>
-#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <wali/PackageLookup.hpp>
+#include <wali/PackageResolver.hpp>
+#include <wali/SystemFacts.hpp>
 #include <wali/widgets/PackagesWidget.hpp>
 
 static constexpr const auto IntroText = R"(
   <ul>
-    <li>Enter package names, separated by a space</li>
+    <li>Search by name or description, or enter package names separated by a space or comma</li>
+    <li>Groups, such as base-devel, are replaced by their packages</li>
+    <li>Import a list of packages, one per line, or upload a file. Lines starting with '#' are ignored</li>
     <li>Packages that don't exist, remain in the textbox</li>
     <li>This only checks the Arch repo, not the AUR</li>
   </ul>
@@ -21,15 +32,8 @@ enum class Level
   Error
 };
 
-/// This is more complex than it should because:
-///   1. The Arch search API only allows one package per request
-///   2. Sending requests at a high rate results in a HTTP 429 response or connection close
-///   3. If a package does not exist, the response does not include the name
-/// For (1) and (2), package searches are staggered:
-///   - Sent in groups of 3 requests, 200ms apart
-///   - Only when all responses are received, is the next group sent
-/// For (3):
-///   - A package that does not exist, remains in m_packages_pending
+/// Packages are checked against the local sync databases (see PackageIndex). If those
+/// could not be read, archlinux.org is searched instead (see PackageLookup).
 
 PackagesWidget::PackagesWidget(WidgetDataPtr data) : WaliWidget(data, "Packages")
 {
@@ -37,6 +41,12 @@ PackagesWidget::PackagesWidget(WidgetDataPtr data) : WaliWidget(data, "Packages"
   layout->setSpacing(10);
   layout->addWidget(make_wt<Wt::WText>(IntroText));
 
+  if (const auto facts = SystemFacts::get(); !facts->packages->empty())
+  {
+    m_package_search = facts->package_search;
+    create_finder(layout);
+  }
+
   auto search_cont = layout->addWidget(make_wt<WContainerWidget>());
   auto layout_search = search_cont->setLayout(make_wt<WHBoxLayout>());
 
@@ -51,6 +61,8 @@ PackagesWidget::PackagesWidget(WidgetDataPtr data) : WaliWidget(data, "Packages"
   m_btn_search->clicked().connect(this, &PackagesWidget::search);
   m_btn_search->setStyleClass("packages");
 
+  m_search_msg = layout->addWidget(make_wt<MessageWidget>());
+
   // list of packages to install, control buttons
   auto results_cont = layout->addWidget(make_wt<WContainerWidget>());
   auto layout_results = results_cont->setLayout(make_wt<WHBoxLayout>());
@@ -88,14 +100,21 @@ PackagesWidget::PackagesWidget(WidgetDataPtr data) : WaliWidget(data, "Packages"
     {
       m_list_confirmed->addItem(name);
     });
+
+    refresh_estimate();
   });
 
   m_btn_clear->clicked().connect([this]
   {
     m_data->packages.additional.clear();
     m_list_confirmed->clear();
+    refresh_estimate();
   });
 
+  create_import(layout);
+
+  m_estimate = layout->addWidget(make_wt<EstimateWidget>());
+
   layout->addStretch(1);
 
   // this can't be invalid, ignore packages that are not found
@@ -110,124 +129,240 @@ void PackagesWidget::search ()
   if (package_names.empty())
     return;
 
-  enable_search(false);
-  m_packages_confirmed.clear();
-  m_packages_pending.clear();
-  m_queue.clear();
-  m_sent = m_rcvd = 0;
+  const auto names = PackageResolver::parse_list(package_names);
 
-  for (const auto it : package_names | view::split(' '))
+  if (const auto facts = SystemFacts::get(); !facts->packages->empty())
+    m_line_packages->setText(flatten(add_local(*facts->packages, names)));
+  else
+    search_remote(names);
+}
+
+
+void PackagesWidget::import_list(const std::string& list)
+{
+  const auto names = PackageResolver::parse_list(list);
+
+  m_import_msg->clear_messages();
+
+  if (names.empty())
+    return;
+
+  if (const auto facts = SystemFacts::get(); !facts->packages->empty())
   {
-    const std::string package (std::string_view{it});
+    const auto before = m_data->packages.additional.size();
+    const auto missing = add_local(*facts->packages, names);
 
-    if (package.empty() || m_packages_confirmed.contains(package) || m_data->packages.additional.contains(package))
-      continue;
+    m_import->setText(flatten(missing, '\n'));
 
-    m_queue.add(package);
+    m_import_msg->add(std::format("Added {} packages", m_data->packages.additional.size() - before), MessageWidget::Level::Info);
+    if (!missing.empty())
+      m_import_msg->add(std::format("{} not found, these remain in the list", missing.size()), MessageWidget::Level::Warning);
   }
+  else
+  {
+    // groups can't be expanded without the sync databases
+    m_import->setText("");
+    m_import_msg->add("Checking packages with archlinux.org, those not found are in the search box", MessageWidget::Level::Info);
+    search_remote(names);
+  }
+}
+
+
+PackageSet PackagesWidget::add_local(const PackageIndex& index, const std::vector<std::string>& names)
+{
+  // packages installed by other pages are not repeated here
+  PackageSet exclude {m_data->packages.additional};
+  exclude.insert(m_data->desktop.desktop.cbegin(), m_data->desktop.desktop.cend());
+  exclude.insert(m_data->desktop.dm.cbegin(), m_data->desktop.dm.cend());
+  exclude.insert(m_data->video.drivers.cbegin(), m_data->video.drivers.cend());
 
-  send_next();
+  const auto expansion = PackageResolver::expand(index, names, exclude);
+
+  for (const auto& name : expansion.packages)
+    add_package(name);
+
+  refresh_estimate();
+
+  return expansion.missing;
 }
 
 
-void PackagesWidget::send_next()
+void PackagesWidget::create_import(WVBoxLayout * layout)
 {
-  using milliseconds = std::chrono::milliseconds;
+  static const constexpr std::size_t MaxFileSize = 1024 * 1024;
 
-  static const std::size_t MaxActiveRequests = 3;
-  // put 'any' arch to avoid missing packages, i.e. "reflector" is 'any'
-  static const constexpr auto SearchString =  "https://archlinux.org/packages/search/json/?"
-                                              "arch=x86_64&arch=any&repo=Core&repo=Extra&name={}";
+  auto import_cont = layout->addWidget(make_wt<WContainerWidget>());
+  auto layout_import = import_cont->setLayout(make_wt<WHBoxLayout>());
 
-  const auto session_id = WApplication::instance()->sessionId();
-  milliseconds delay {200};
+  m_import = layout_import->addWidget(make_wt<WTextArea>(), 1);
+  m_import->setStyleClass("packages");
+  m_import->setRows(4);
+  m_import->setPlaceholderText("Paste a package list: one per line, or separated by spaces or commas");
 
-  std::size_t i{};
-  while (!m_queue.empty() && i++ < MaxActiveRequests)
-  {
-    const auto package = m_queue.next();
+  auto layout_import_control = layout_import->addLayout(make_wt<WVBoxLayout>());
 
-    WServer::instance()->schedule(delay, session_id, [this, package]()
+  m_btn_import = layout_import_control->addWidget(make_wt<WPushButton>("Import"));
+  m_btn_import->setStyleClass("packages");
+  m_btn_import->clicked().connect([this]{ import_list(m_import->text().toUTF8()); });
+
+  auto too_large = [this]
+  {
+    m_import_msg->clear_messages();
+    m_import_msg->add("File is too large", MessageWidget::Level::Error);
+  };
+
+  auto upload = layout_import_control->addWidget(make_wt<WFileUpload>());
+  upload->setFilters(".txt,.list,text/plain");
+  // upload as soon as a file is chosen, rather than requiring another button
+  upload->changed().connect(upload, &WFileUpload::upload);
+  upload->uploaded().connect([this, upload, too_large]
+  {
+    if (fs::file_size(upload->spoolFileName()) > MaxFileSize)
+      too_large();
+    else
     {
-      // TODO should be removing each child when done?
-      Http::Client * client = addChild(make_wt<Http::Client>());
-      client->setMaxRedirects(10);
-      client->setMaximumResponseSize(16 * 1024);
-      client->done().connect(this, &PackagesWidget::on_response);
-
-      if (client->get(std::format(SearchString, package)))
-      {
-        ++m_sent;
-        m_packages_pending.emplace(package);
-      }
-      else
-        removeChild(client);
-    });
+      std::ifstream file {upload->spoolFileName()};
+      std::stringstream list;
+      list << file.rdbuf();
+      import_list(list.str());
+    }
+  });
+  upload->fileTooLarge().connect(too_large);
 
-    // need this because the calls to schedule() are microseconds apart
-    delay += milliseconds(200);
-  }
+  layout_import_control->addStretch(1);
+
+  m_import_msg = layout->addWidget(make_wt<MessageWidget>());
 }
 
 
-void PackagesWidget::on_response(std::error_code rsp_err, const Http::Message& rsp)
+void PackagesWidget::create_finder(WVBoxLayout * layout)
 {
-  // note: the response does not include the name of a package that does not exist, only
-  //       an empty results array, so the entry remains in m_packages_pending
+  static const constexpr std::size_t MaxResults = 15;
+
+  // the server has already matched and ranked, so the client shows every row
+  static const constexpr auto MatcherJS = R"(
+    function (edit) {
+      return function (suggestion) {
+        return suggestion ? { match : true, suggestion : suggestion } : edit.value;
+      };
+    })";
+
+  static const constexpr auto ReplacerJS = R"(
+    function (edit, text, value) {
+      edit.value = value;
+    })";
+
+  m_finder = layout->addWidget(make_wt<WLineEdit>());
+  m_finder->setStyleClass("packages");
+  m_finder->setPlaceholderText("Search packages");
+
+  auto model = std::make_shared<WStringListModel>();
+
+  auto popup = addChild(make_wt<WSuggestionPopup>(MatcherJS, ReplacerJS));
+  popup->forEdit(m_finder);
+  popup->setModel(model);
+  popup->setFilterLength(1);
+  popup->filterModel().connect([this, model](const WString& input)
+  {
+    const auto& index = m_package_search->index();
 
-  ++m_rcvd;
+    model->setStringList({});
 
-  const bool error = rsp.status() != 200;
+    for (const auto i : m_package_search->find(input.toUTF8(), MaxResults))
+    {
+      const auto& pkg = index.packages()[i];
+      const std::string name {index.str(pkg.name)};
 
-  // TODO display something on UI
-  if (error)
-    PLOGE << "Package search response: " << rsp.status() << " : " << rsp_err.message();
-  else if (const auto results = parse_response(rsp.body()); !results.empty())
-  {
-    const Json::Object& result = results[0];
-    const auto name = result.get("pkgname");
+      model->addString(WString::fromUTF8(std::format("<b>{}</b> {} ({})<br/><small>{}</small>",
+                                                     Utils::htmlEncode(name),
+                                                     Utils::htmlEncode(std::string{index.str(pkg.version)}),
+                                                     format_size(pkg.installed_size),
+                                                     Utils::htmlEncode(std::string{index.str(pkg.desc)}))));
 
-    m_packages_confirmed.insert(m_packages_pending.extract(name));
+      model->setData(model->index(model->rowCount()-1, 0), name, ItemDataRole::User);
+    }
 
-    m_list_confirmed->addItem(name);
-    m_data->packages.additional.emplace(name);
-  }
+    // always ask the server again as the input changes, rather than filtering these rows
+    model->addString("");
+    model->setData(model->index(model->rowCount()-1, 0), std::string{"Wt-more-data"}, ItemDataRole::StyleClass);
+  });
 
-  if (m_rcvd == m_sent)
+  popup->activated().connect([this, model](const int row, WFormWidget *)
   {
-    m_line_packages->setText(flatten(m_packages_pending));
-
-    if (error)
+    if (const auto value = model->data(model->index(row, 0), ItemDataRole::User); value.has_value())
     {
-      m_packages_pending.clear();
-      m_queue.clear();
+      add_package(cpp17::any_cast<std::string>(value));
+      refresh_estimate();
     }
 
-    if (m_queue.empty())
-      enable_search(true);
-    else
-      send_next();
-  }
+    m_finder->setText("");
+  });
+}
+
 
-  WApplication::instance()->triggerUpdate();
+void PackagesWidget::add_package(const std::string& name)
+{
+  if (m_data->packages.additional.emplace(name).second)
+    m_list_confirmed->addItem(name);
 }
 
 
-Json::Array PackagesWidget::parse_response(const std::string body)
+void PackagesWidget::on_show()
 {
-  Json::Array results{};
-
-  Json::Value root;
-  if (Json::ParseError err; !Json::parse(body, root, err))
-    PLOGE << "Response contains invalid JSON";
-  else if (root.type() != Json::Type::Object)
-    PLOGE << "Response JSON root is not an object";
-  else if (Json::Object root_object = root; !(root_object.contains("results") && root_object.get("results").type() == Json::Type::Array))
-    PLOGE << "Response JSON 'results' does not exist or is not an array";
-  else
-    results = root_object.get("results");
+  // the desktop and video drivers may have changed
+  refresh_estimate();
+}
+
+
+void PackagesWidget::refresh_estimate()
+{
+  set_fits(m_estimate->refresh(*m_data));
+}
+
+
+void PackagesWidget::search_remote(const std::vector<std::string>& names)
+{
+  std::vector<std::string> unique;
+
+  for (const auto& name : names)
+  {
+    if (!m_data->packages.additional.contains(name) && !rng::contains(unique, name))
+      unique.push_back(name);
+  }
+
+  enable_search(false);
+  m_search_msg->clear_messages();
+  m_packages_missing.clear();
+  m_packages_failed.clear();
+
+  auto on_result = [this](const std::string& name, const LookupResult result)
+  {
+    if (result == LookupResult::Found)
+      add_package(name);
+    else if (result == LookupResult::NotFound)
+      m_packages_missing.emplace(name);
+    else
+      m_packages_failed.emplace(name);
+  };
+
+  auto on_done = [this]
+  {
+    if (!m_packages_missing.empty())
+      m_search_msg->add(std::format("Not found: {}", flatten(m_packages_missing)), MessageWidget::Level::Warning);
+
+    if (!m_packages_failed.empty())
+      m_search_msg->add(std::format("Lookup failed, search again to retry: {}", flatten(m_packages_failed)), MessageWidget::Level::Error);
+
+    // both remain in the search box, so searching again retries the failed
+    PackageSet remaining {m_packages_missing};
+    remaining.insert(m_packages_failed.cbegin(), m_packages_failed.cend());
+
+    m_line_packages->setText(flatten(remaining));
+    enable_search(true);
+    refresh_estimate();
+  };
 
-  return results;
+  PackageLookup::lookup(unique, WApplication::instance()->sessionId(), on_result, on_done);
 }
 
 
@@ -237,4 +372,5 @@ void PackagesWidget::enable_search(const bool enable)
   m_btn_search->setEnabled(enable);
   m_btn_clear->setEnabled(enable);
   m_btn_rmv->setEnabled(enable);
+  m_btn_import->setEnabled(enable);
 }
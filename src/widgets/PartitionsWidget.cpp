@@ -8,12 +8,14 @@
 #include <wali/Common.hpp>
 #include <wali/Commands.hpp>
 #include <wali/DiskUtils.hpp>
+#include <wali/SystemFacts.hpp>
 #include <wali/widgets/Common.hpp>
 #include <Wt/WApplication.h>
 #include <Wt/WComboBox.h>
 #include <Wt/WCompositeWidget.h>
 #include <Wt/WHBoxLayout.h>
 #include <Wt/WPushButton.h>
+#include <Wt/WSelectionBox.h>
 #include <Wt/WSpinBox.h>
 #include <Wt/WServer.h>
 #include <Wt/WText.h>
@@ -32,11 +34,15 @@ static const constexpr auto waffle_info = R"(
     To use a dedicated partition, select "Use remaining".<br/>
     Otherwise /home must mount to the root partition.
     </li>
+    <li><b>Stripe across:</b> Optional disks to stripe or mirror root and home with.<br/>
+    Each is given a root sized partition, then the remaining for home.<br/>
+    The RAID level is chosen in Mounts.
+    </li>
   </ul>
   )";
 
 static const constexpr auto waffle_warning = R"(
-  <p style="color: red;">When you press 'Create', all data on the selected device is lost.</p>
+  <p style="color: red;">When you press 'Create', all data on the selected devices is lost.</p>
   )";
 
 
@@ -51,6 +57,7 @@ PartitionsWidget::PartitionsWidget(WidgetDataPtr data) : WaliWidget(data, "Parti
   auto boot_layout = layout->addLayout(make_wt<WHBoxLayout>());
   auto root_layout = layout->addLayout(make_wt<WHBoxLayout>());
   auto home_layout = layout->addLayout(make_wt<WHBoxLayout>());
+  auto stripe_layout = layout->addLayout(make_wt<WHBoxLayout>());
 
 
   auto lbl_disk = disk_layout->addWidget(make_wt<WLabel>("Disk"));
@@ -89,6 +96,14 @@ PartitionsWidget::PartitionsWidget(WidgetDataPtr data) : WaliWidget(data, "Parti
   m_home->addItem("Do nothing");
   home_layout->addStretch(1);
 
+  auto lbl_stripe = stripe_layout->addWidget(make_wt<WLabel>("Stripe across"));
+  lbl_stripe->setWidth(100);
+  m_stripe = stripe_layout->addWidget(make_wt<WSelectionBox>());
+  m_stripe->setSelectionMode(Wt::SelectionMode::Extended);
+  m_stripe->setVerticalSize(3);
+  m_stripe->changed().connect(this, &PartitionsWidget::calculate_sizes);
+  stripe_layout->addStretch(1);
+
   layout->addWidget(make_wt<WText>(waffle_warning));
 
   m_create = layout->addWidget(make_wt<WPushButton>("Create"));
@@ -102,7 +117,7 @@ PartitionsWidget::PartitionsWidget(WidgetDataPtr data) : WaliWidget(data, "Parti
 
 void PartitionsWidget::read_partitions()
 {
-  m_tree = DiskUtils::probe();
+  m_tree = SystemFacts::get()->tree;
   set_devices();
 }
 
@@ -116,6 +131,7 @@ void PartitionsWidget::set_devices()
     {
       PLOGI << disk.dev << " : " << format_size(disk.size);
       m_disk->addItem(disk.dev);
+      m_stripe->addItem(disk.dev);
       m_disk_sizes[disk.dev] = disk.size;
     }
   }
@@ -131,7 +147,11 @@ void PartitionsWidget::calculate_sizes()
   {
     const auto disk_size = m_disk_sizes.at(disk);
     const auto boot_size = mb_to_b(std::strtoll(m_boot->currentText().toUTF8().data(), nullptr, 10));
-    const int64_t max_root_size = disk_size - boot_size;
+    int64_t max_root_size = disk_size - boot_size;
+
+    // stripe disks have no boot partition, but root must fit on each
+    for (const auto& stripe_disk : get_stripe_disks())
+      max_root_size = std::min(max_root_size, m_disk_sizes.at(stripe_disk));
 
     m_total->setText(std::format("<b>Size:</b> {}", format_size(disk_size)));
     m_root->setRange(b_to_gb(RootSizeMin), b_to_gb(max_root_size));
@@ -182,6 +202,12 @@ void PartitionsWidget::create()
           CreatePartition{}(disk, 3, log);
           SetPartitionType{}(disk, 3, PartTypeHome);
         }
+
+        for (const auto& stripe_disk : get_stripe_disks())
+        {
+          if (stripe_disk != disk)
+            create_stripe_disk(stripe_disk, root_size);
+        }
       }
 
       m_changed = true;
@@ -196,3 +222,41 @@ void PartitionsWidget::create()
     WApplication::instance()->triggerUpdate();
   });
 }
+
+void PartitionsWidget::create_stripe_disk(const std::string& disk, const int64_t root_size)
+{
+  auto log = [](const std::string_view m)
+  {
+    PLOGI << m;
+  };
+
+  PLOGI << "Stripe disk: " << disk;
+
+  if (!CreatePartitionTable{}(disk, log))
+    PLOGE << "Failed to create parition table on " << disk;
+  else
+  {
+    // type is set to RAID when the array is created, if required
+    CreatePartition{}(disk, 1, root_size, log);
+    SetPartitionType{}(disk, 1, PartTypeRoot);
+
+    if (m_home->currentIndex() == 0)
+    {
+      CreatePartition{}(disk, 2, log);
+      SetPartitionType{}(disk, 2, PartTypeHome);
+    }
+  }
+}
+
+std::vector<std::string> PartitionsWidget::get_stripe_disks() const
+{
+  std::vector<std::string> disks;
+
+  for (const int i : m_stripe->selectedIndexes())
+  {
+    if (const auto disk = m_stripe->itemText(i).toUTF8(); disk != m_disk->currentText().toUTF8())
+      disks.push_back(disk);
+  }
+
+  return disks;
+}
@@ -4,6 +4,7 @@
 #include "wali/widgets/WidgetData.hpp"
 #include <Wt/WApplication.h>
 #include <Wt/WComboBox.h>
+#include <wali/SystemFacts.hpp>
 #include <wali/widgets/VideoWidget.hpp>
 #include <ranges>
 
@@ -173,7 +174,7 @@ void VideoWidget::init_combos()
 
 void VideoWidget::set_default_driver()
 {
-  switch (GetGpuVendor{}())
+  switch (SystemFacts::get()->gpu)
   {
     case GpuVendor::Vm:
       m_group_vendor->setSelectedButtonIndex(1);
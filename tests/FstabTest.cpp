@@ -0,0 +1,115 @@
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <wali/Fstab.hpp>
+
+
+// Fstab::read(), Fstab::prepare() and Fstab::format() against fixture mount tables. The fixtures
+// directory is the only argument.
+
+static int failures{};
+
+
+static void check(const bool ok, const std::string_view what)
+{
+  if (!ok)
+  {
+    std::cerr << "FAIL: " << what << '\n';
+    ++failures;
+  }
+}
+
+
+static std::string read_file(const fs::path& path)
+{
+  std::ifstream stream{path};
+  std::stringstream ss;
+  ss << stream.rdbuf();
+  return ss.str();
+}
+
+
+static void ext4(const fs::path& fixtures)
+{
+  const auto entries = Fstab::read("/mnt/wali-1", fixtures / "mountinfo_ext4");
+
+  // the host's mounts and /mnt/wali-12 (same prefix) are not included
+  check(entries.size() == 3, "ext4: three mounts");
+
+  if (entries.size() != 3)
+    return;
+
+  check(entries[0].target == "/" && entries[0].source == "/dev/sda2" && entries[0].fstype == "ext4", "ext4: root");
+  check(entries[1].target == "/boot" && entries[1].source == "/dev/sda1" && entries[1].fstype == "vfat", "ext4: boot");
+  check(entries[2].target == "/home" && entries[2].source == "/dev/sda3", "ext4: home");
+  check(entries[0].options.find("noatime") != std::string::npos, "ext4: root options");
+  check(entries[0].subvol.empty(), "ext4: no subvolume");
+
+  // without a UUID, the device path is kept
+  auto prepared = entries;
+  Fstab::prepare(prepared, "/mnt/wali-1", {}, "", [](const std::string& dev){ return dev == "/dev/sda3" ? std::string{} : std::string{"u"}; });
+
+  check(prepared[0].source == "UUID=u" && prepared[2].source == "/dev/sda3", "ext4: sources");
+  check(prepared[0].options == entries[0].options, "ext4: options as the kernel reports");
+  check(prepared[0].passno == 1 && prepared[1].passno == 2 && prepared[2].passno == 2, "ext4: passno");
+}
+
+
+static void btrfs(const fs::path& fixtures)
+{
+  auto entries = Fstab::read("/mnt/wali-2", fixtures / "mountinfo_btrfs");
+
+  check(entries.size() == 4, "btrfs: four mounts");
+
+  if (entries.size() != 4)
+    return;
+
+  check(entries[0].subvol == "@", "btrfs: root subvolume");
+  check(entries[1].subvol.empty(), "btrfs: boot is vfat");
+  check(entries[2].target == "/home" && entries[2].subvol == "@home", "btrfs: home subvolume");
+  check(entries[3].target == "/var/log" && entries[3].subvol == "@log", "btrfs: log subvolume");
+
+  // as Install::fstab() mounts them, except /var/log which falls back to btrfs_options
+  const std::map<std::string, std::string> options
+  {
+    {"/mnt/wali-2", "noatime,compress=zstd:3,subvol=@"},
+    {"/mnt/wali-2/boot", "fmask=0077,dmask=0077"},
+    {"/mnt/wali-2/home", "noatime,compress=zstd:3,subvol=@home"}
+  };
+
+  auto uuid = [](const std::string& dev) -> std::string
+  {
+    return dev == "/dev/vda1" ? "1234-ABCD" : "0a1b2c3d-0000-4000-8000-000000000001";
+  };
+
+  Fstab::prepare(entries, "/mnt/wali-2", options, "rw,noatime,compress=zstd:3", uuid);
+
+  check(entries.size() == 5 && entries.back().target == "/tmp", "btrfs: tmpfs appended");
+  check(Fstab::format(entries) == read_file(fixtures / "fstab_btrfs"), "btrfs: formatted fstab");
+}
+
+
+static void missing(const fs::path& fixtures)
+{
+  check(Fstab::read("/mnt/wali-1", fixtures / "does_not_exist").empty(), "missing: no entries");
+  check(Fstab::read("/mnt/wali-3", fixtures / "mountinfo_ext4").empty(), "missing: root not mounted");
+}
+
+
+int main(int argc, char ** argv)
+{
+  if (argc != 2)
+  {
+    std::cerr << "Usage: fstab_test <fixtures dir>\n";
+    return 1;
+  }
+
+  const fs::path fixtures {argv[1]};
+
+  ext4(fixtures);
+  btrfs(fixtures);
+  missing(fixtures);
+
+  return failures ? 1 : 0;
+}
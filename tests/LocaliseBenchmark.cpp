@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <wali/Commands.hpp>
+#include <wali/Localise.hpp>
+
+
+// Localise's native lists against timedatectl and localectl, which they replace.
+// Each is run several times, reporting the mean, then the lists are compared.
+
+using List = std::vector<std::string>;
+
+
+static List timed(const std::string_view name, const int runs, const std::function<List()>& f)
+{
+  List list;
+
+  const auto start = WaliClock::now();
+
+  for (int i = 0 ; i < runs ; ++i)
+    list = f();
+
+  const auto mean = chrono::duration<double, std::milli>(WaliClock::now() - start) / runs;
+
+  std::cout << std::format("{:<24} {:>5} entries {:>10.3f} ms\n", name, list.size(), mean.count());
+  return list;
+}
+
+
+static void compare(const std::string_view name, List native, List command)
+{
+  if (command.empty())
+  {
+    std::cout << std::format("{}: command unavailable, not compared\n\n", name);
+    return;
+  }
+
+  rng::sort(native);
+  rng::sort(command);
+
+  List missing, extra;
+  rng::set_difference(command, native, std::back_inserter(missing));
+  rng::set_difference(native, command, std::back_inserter(extra));
+
+  std::cout << std::format("{}: {} only from command, {} only native\n\n", name, missing.size(), extra.size());
+}
+
+
+int main()
+{
+  static const int NativeRuns = 50;
+  static const int CommandRuns = 5;
+
+  const auto zones = timed("Localise::timezones", NativeRuns, &Localise::timezones);
+  const auto zones_cmd = timed("timedatectl", CommandRuns, []{ return GetTimeZones{}(); });
+  compare("timezones", zones, zones_cmd);
+
+  const auto keys = timed("Localise::keymaps", NativeRuns, &Localise::keymaps);
+  const auto keys_cmd = timed("localectl", CommandRuns, []{ return GetKeyMaps{}(); });
+  compare("keymaps", keys, keys_cmd);
+
+  // the previous implementation also read SUPPORTED, so there's no command to compare
+  timed("Localise::locales", NativeRuns, &Localise::locales);
+
+  return 0;
+}